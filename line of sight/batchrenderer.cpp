@@ -0,0 +1,118 @@
+#include "batchrenderer.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cmath>
+
+BatchRenderer::BatchRenderer(int discSides) :
+    useBuffers(sf::VertexBuffer::isAvailable()),
+    levelBuffer(sf::PrimitiveType::Triangles, sf::VertexBuffer::Static),
+    triangleBuffer(sf::PrimitiveType::Triangles, sf::VertexBuffer::Stream),
+    lineBuffer(sf::PrimitiveType::Lines, sf::VertexBuffer::Stream)
+{
+    for (int k = 0; k <= discSides; k++)
+    {
+        float angle = k * 2 * pi / discSides;
+        unitDisc.push_back(Vec2(std::cos(angle), std::sin(angle)));
+    }
+}
+
+void BatchRenderer::setLevel(const Level& level, sf::Color color)
+{
+    levelVertices.clear();
+    for (size_t i = 0; i < level.shapes.size(); i++)
+    {
+        // the shapes are convex, a fan from their first corner covers them
+        const Polygon& shape = level.shapes[i];
+        for (size_t j = 1; j + 1 < shape.size(); j++)
+        {
+            levelVertices.push_back({ toSf(shape[0]), color });
+            levelVertices.push_back({ toSf(shape[j]), color });
+            levelVertices.push_back({ toSf(shape[j + 1]), color });
+        }
+    }
+    if (useBuffers && !levelVertices.empty())
+    {
+        levelBuffer.create(levelVertices.size());
+        levelBuffer.update(levelVertices.data(), levelVertices.size(), 0);
+    }
+}
+
+void BatchRenderer::clear()
+{
+    triangles.clear();
+    lines.clear();
+}
+
+void BatchRenderer::addDisc(Vec2 center, float radius, sf::Color color)
+{
+    sf::Vector2f middle = toSf(center);
+    for (size_t k = 0; k + 1 < unitDisc.size(); k++)
+    {
+        triangles.push_back({ middle, color });
+        triangles.push_back({ toSf(center + radius * unitDisc[k]), color });
+        triangles.push_back({ toSf(center + radius * unitDisc[k + 1]), color });
+    }
+}
+
+void BatchRenderer::addTriangles(const std::vector<Vec2>& points, sf::Color color)
+{
+    for (size_t i = 0; i + 2 < points.size(); i += 3)
+    {
+        triangles.push_back({ toSf(points[i]), color });
+        triangles.push_back({ toSf(points[i + 1]), color });
+        triangles.push_back({ toSf(points[i + 2]), color });
+    }
+}
+
+void BatchRenderer::addLine(Vec2 start, Vec2 end, sf::Color color)
+{
+    lines.push_back({ toSf(start), color });
+    lines.push_back({ toSf(end), color });
+}
+
+void BatchRenderer::stream(sf::VertexBuffer& buffer, const std::vector<sf::Vertex>& vertices)
+{
+    if (vertices.empty())
+    {
+        return;
+    }
+    // grows by doubling, so the GPU side storage settles after the first busy frames like the arrays do
+    if (buffer.getVertexCount() < vertices.size())
+    {
+        buffer.create(std::max(vertices.size(), 2 * buffer.getVertexCount()));
+    }
+    buffer.update(vertices.data(), vertices.size(), 0);
+}
+
+void BatchRenderer::upload()
+{
+    if (useBuffers)
+    {
+        stream(triangleBuffer, triangles);
+        stream(lineBuffer, lines);
+    }
+}
+
+void BatchRenderer::drawLayer(sf::RenderTarget& target, const sf::VertexBuffer& buffer, const std::vector<sf::Vertex>& vertices, sf::PrimitiveType type, sf::RenderStates states) const
+{
+    if (vertices.empty())
+    {
+        return;
+    }
+    if (useBuffers)
+    {
+        target.draw(buffer, 0, vertices.size(), states);
+    }
+    else
+    {
+        target.draw(vertices.data(), vertices.size(), type, states);
+    }
+}
+
+void BatchRenderer::draw(sf::RenderTarget& target, sf::RenderStates states) const
+{
+    drawLayer(target, levelBuffer, levelVertices, sf::PrimitiveType::Triangles, states);
+    drawLayer(target, triangleBuffer, triangles, sf::PrimitiveType::Triangles, states);
+    drawLayer(target, lineBuffer, lines, sf::PrimitiveType::Lines, states);
+}
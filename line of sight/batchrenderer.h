@@ -0,0 +1,44 @@
+#pragma once
+
+#include "level.h"
+
+#include <SFML/Graphics.hpp>
+
+// ===== ===== =====
+// BATCHED RENDERING
+// ===== ===== =====
+// the whole scene in three draw calls, however many entities there are: the level shapes, uploaded once into a
+// static vertex buffer, then every filled shape and every line of the frame, each gathered into an array that keeps
+// its capacity and streamed into its own buffer
+// discs are stamped from one precomputed unit circle, so a disc costs a multiply add per vertex and no trigonometry
+// within a frame, filled shapes are drawn in the order they were added, and lines go on top of them
+// without vertex buffer support in the driver the arrays are drawn directly, still one call each
+
+class BatchRenderer : public sf::Drawable
+{
+public:
+    explicit BatchRenderer(int discSides = 16);
+
+    // triangulates the level's convex shapes and uploads them, call again only when the level changes
+    void setLevel(const Level& level, sf::Color color);
+
+    // empties the frame's triangles and lines
+    void clear();
+    void addDisc(Vec2 center, float radius, sf::Color color);
+    // every three points are a triangle, like VisibilityResult::fan
+    void addTriangles(const std::vector<Vec2>& points, sf::Color color);
+    void addLine(Vec2 start, Vec2 end, sf::Color color);
+    // streams the frame to the GPU, call after the last add and before drawing
+    void upload();
+
+    virtual void draw(sf::RenderTarget& target, sf::RenderStates states) const override;
+
+private:
+    static void stream(sf::VertexBuffer& buffer, const std::vector<sf::Vertex>& vertices);
+    void drawLayer(sf::RenderTarget& target, const sf::VertexBuffer& buffer, const std::vector<sf::Vertex>& vertices, sf::PrimitiveType type, sf::RenderStates states) const;
+
+    std::vector<Vec2> unitDisc;     // points around the unit circle, the first one repeated at the end
+    bool useBuffers;
+    sf::VertexBuffer levelBuffer, triangleBuffer, lineBuffer;
+    std::vector<sf::Vertex> levelVertices, triangles, lines;
+};
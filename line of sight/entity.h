@@ -0,0 +1,56 @@
+#pragma once
+
+#include "geometry.h"
+
+class IUpdatable
+{
+public:
+    virtual void update(float dt) = 0;
+};
+
+class Entity : public IUpdatable
+{
+public:
+    Vec2 position;
+    Vec2 lastPosition;
+    Vec2 velocity;
+    Vec2 acceleration;
+    float max_speed;
+
+    Entity(Vec2 position, Vec2 velocity = { 0,0 }, Vec2 acceleration = { 0, 0 }, float max_speed = 200.0f) :
+        position(position),
+        lastPosition(position),
+        velocity(velocity),
+        acceleration(acceleration),
+        max_speed(max_speed)
+    {}
+
+    virtual void update(float dt) override
+    {
+        lastPosition = position;
+
+        velocity += acceleration * dt;
+        position += velocity * dt;
+    }
+};
+
+class IInputComponent
+{
+public:
+    bool movingLeft;
+    bool movingRight;
+    bool movingUp;
+    bool movingDown;
+    bool moving;
+
+    IInputComponent() :
+        movingLeft(false),
+        movingRight(false),
+        movingUp(false),
+        movingDown(false),
+        moving(false)
+    {
+    }
+
+    virtual void update(Entity& actor, float dt) = 0;
+};
@@ -0,0 +1,160 @@
+#include "entitystore.h"
+#include "logger.h"
+#include "physics.h"
+#include "profiler.h"
+#include "threadpool.h"
+#include "visibility.h"
+
+#include <algorithm>
+
+void EntityStore::clear()
+{
+    x.clear();
+    y.clear();
+    vx.clear();
+    vy.clear();
+    ax.clear();
+    ay.clear();
+    flags.clear();
+    bounceEdge.clear();
+}
+
+void EntityStore::add(Vec2 position, Vec2 velocity, Vec2 acceleration)
+{
+    x.push_back(position.x);
+    y.push_back(position.y);
+    vx.push_back(velocity.x);
+    vy.push_back(velocity.y);
+    ax.push_back(acceleration.x);
+    ay.push_back(acceleration.y);
+    flags.push_back(0);
+    bounceEdge.push_back(-1);
+}
+
+// equal mass discs: each one of an approaching touching pair keeps its tangential velocity and takes the other's normal one,
+// and both are pushed half the overlap apart
+// every entity reads the old state of its neighbours and writes only its own next state, so chunks need no ordering
+// an entity touching several others takes the average of those responses, summing them would overshoot in a packed crowd
+void EntityStore::resolveContacts(int begin, int end)
+{
+    // walked in cell order, so neighbouring entities and their cells stay in cache
+    const PointGrid& grid = broadphase;
+    float contact = 2.0f * radius;
+    int begins[3], ends[3];
+    for (int e = begin; e < end; e++)
+    {
+        int i = grid.entries[e];
+        Vec2 position(grid.entryX[e], grid.entryY[e]);
+        Vec2 velocity(entryVX[e], entryVY[e]);
+        Vec2 push, impulse;
+        int touching = 0;
+        int approaching = 0;
+
+        int rangeCount = grid.neighbourRanges(position.x, position.y, begins, ends);
+        for (int r = 0; r < rangeCount; r++)
+        {
+            for (int k = begins[r]; k < ends[r]; k++)
+            {
+                Vec2 away = position - Vec2(grid.entryX[k], grid.entryY[k]);
+                float distance2 = dot(away, away);
+                // the entity itself lands here too, coincident entities have no contact normal
+                if (distance2 >= contact * contact || distance2 == 0.0f)
+                {
+                    continue;
+                }
+                float distance = std::sqrt(distance2);
+                Vec2 normal = away / distance;
+                float approach = dot(velocity - Vec2(entryVX[k], entryVY[k]), normal);
+                if (approach < 0.0f)
+                {
+                    impulse -= approach * normal;
+                    approaching++;
+                }
+                push += (0.5f * (contact - distance)) * normal;
+                touching++;
+            }
+        }
+
+        Vec2 nextPosition = touching > 0 ? position + push / (float)touching : position;
+        Vec2 nextVelocity = approaching > 0 ? velocity + impulse / (float)approaching : velocity;
+
+        nextX[i] = nextPosition.x;
+        nextY[i] = nextPosition.y;
+        nextVX[i] = nextVelocity.x;
+        nextVY[i] = nextVelocity.y;
+    }
+}
+
+void EntityStore::update(const Level& level, const VisibilityQuery* view, float dt, ThreadPool* pool)
+{
+    LOS_PROFILE_ZONE("EntityStore::update");
+    if (pool == nullptr)
+    {
+        pool = &ThreadPool::shared();
+    }
+
+    // big enough chunks that scheduling disappears next to the work, small enough that stealing can balance walls vs open space
+    const int grain = 1024;
+
+    if (collideEntities && size() > 1)
+    {
+        // cells as wide as the contact distance, so every touching pair shares a 3 x 3 neighbourhood
+        broadphase.build(x.data(), y.data(), size(), 2.0f * radius);
+        entryVX.resize(size());
+        entryVY.resize(size());
+        for (int e = 0; e < size(); e++)
+        {
+            entryVX[e] = vx[broadphase.entries[e]];
+            entryVY[e] = vy[broadphase.entries[e]];
+        }
+        nextX.resize(size());
+        nextY.resize(size());
+        nextVX.resize(size());
+        nextVY.resize(size());
+        pool->parallelFor(size(), grain, [&](int begin, int end, int)
+        {
+            resolveContacts(begin, end);
+        });
+        x.swap(nextX);
+        y.swap(nextY);
+        vx.swap(nextVX);
+        vy.swap(nextVY);
+    }
+
+    pool->parallelFor(size(), grain, [&](int begin, int end, int)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            Vec2 position(x[i], y[i]);
+            Vec2 velocity(vx[i], vy[i]);
+            Vec2 acceleration(ax[i], ay[i]);
+            uint8_t state = 0;
+
+            // collision and change direction
+            int edge = bounceOffWalls(level, position, velocity, acceleration, dt, radius);
+            if (edge >= 0)
+            {
+                state |= EntityBounced;
+                bounceEdge[i] = edge;
+            }
+
+            velocity += acceleration * dt;
+            position += velocity * dt;
+
+            // is the entity inside the vision polygon
+            if (view != nullptr && view->overlapsCircle(position, radius))
+            {
+                state |= EntitySeen;
+            }
+
+            x[i] = position.x;
+            y[i] = position.y;
+            vx[i] = velocity.x;
+            vy[i] = velocity.y;
+            ax[i] = acceleration.x;
+            ay[i] = acceleration.y;
+            flags[i] = state;
+            LOS_LOG_RATE(LogTrace, 1000, "enemy {} at {} {} seen {}", i, position.x, position.y, (state & EntitySeen) != 0);
+        }
+    });
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "level.h"
+#include "pointgrid.h"
+
+#include <cstdint>
+
+class ThreadPool;
+struct VisibilityQuery;
+
+enum EntityFlags : uint8_t
+{
+    EntitySeen = 1 << 0,        // disc overlaps the observer's visibility polygon
+    EntityBounced = 1 << 1      // bounced off a wall this tick, bounceEdge holds the edge
+};
+
+// structure-of-arrays storage for crowds of simple movers (the enemies)
+// entity i is entry i of every array, the update walks them in chunks on the thread pool
+struct EntityStore
+{
+    std::vector<float> x, y;            // position
+    std::vector<float> vx, vy;          // velocity
+    std::vector<float> ax, ay;          // acceleration
+    std::vector<uint8_t> flags;         // EntityFlags
+    std::vector<int> bounceEdge;        // index into level.segments of the last wall bounced off, -1 if none
+    float radius = 10.0f;               // shared by every entity
+    bool collideEntities = true;        // elastic bounces between entities, off leaves them passing through each other
+
+    PointGrid broadphase;               // grid over the positions at the start of the last update
+    std::vector<float> entryVX, entryVY; // velocities in broadphase.entries order
+    std::vector<float> nextX, nextY, nextVX, nextVY; // contact pass output, swapped in afterwards
+
+    int size() const { return (int)x.size(); }
+    void clear();
+    void add(Vec2 position, Vec2 velocity = { 0, 0 }, Vec2 acceleration = { 0, 0 });
+
+    Vec2 position(int i) const { return Vec2(x[i], y[i]); }
+    Vec2 velocity(int i) const { return Vec2(vx[i], vy[i]); }
+    bool isSeen(int i) const { return (flags[i] & EntitySeen) != 0; }
+
+    // bounces the entities off each other, then off the level walls, integrates and tests against view (skipped when null)
+    // both passes only write entity i while handling entity i, so chunks run in parallel on pool (ThreadPool::shared() when null)
+    // nothing is allocated once the arrays have grown to the crowd size
+    void update(const Level& level, const VisibilityQuery* view, float dt, ThreadPool* pool = nullptr);
+
+private:
+    void resolveContacts(int begin, int end);
+};
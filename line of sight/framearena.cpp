@@ -0,0 +1,84 @@
+#include "framearena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+FrameArena::FrameArena(size_t blockSize) :
+    blockSize(blockSize)
+{
+}
+
+void* FrameArena::allocate(size_t size, size_t alignment)
+{
+    while (current < blocks.size())
+    {
+        uintptr_t base = (uintptr_t)blocks[current].memory.get();
+        size_t aligned = ((base + offset + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+        if (aligned + size <= blocks[current].size)
+        {
+            offset = aligned + size;
+            return blocks[current].memory.get() + aligned;
+        }
+        if (current + 1 == blocks.size())
+        {
+            break;
+        }
+        // later blocks are left over from an earlier, larger frame
+        current++;
+        offset = 0;
+    }
+
+    // only while the arena is still growing to the largest frame
+    size_t bytes = std::max(blockSize, size + alignment);
+    blocks.push_back({ std::unique_ptr<char[]>(new char[bytes]), bytes });
+    current = blocks.size() - 1;
+    offset = 0;
+    return allocate(size, alignment);
+}
+
+void FrameArena::rewind(Mark mark)
+{
+    peak = std::max(peak, bytesUsed());
+    current = mark.block;
+    offset = mark.offset;
+}
+
+void FrameArena::reset()
+{
+    peak = std::max(peak, bytesUsed());
+    // one block that holds the largest frame so far, the next frames bump through it without switching blocks
+    if (blocks.size() > 1)
+    {
+        size_t size = std::max(blockSize, peak);
+        blocks.clear();
+        blocks.push_back({ std::unique_ptr<char[]>(new char[size]), size });
+    }
+    current = 0;
+    offset = 0;
+}
+
+size_t FrameArena::bytesUsed() const
+{
+    size_t used = offset;
+    for (size_t b = 0; b < current && b < blocks.size(); b++)
+    {
+        used += blocks[b].size;
+    }
+    return used;
+}
+
+size_t FrameArena::bytesReserved() const
+{
+    size_t reserved = 0;
+    for (size_t b = 0; b < blocks.size(); b++)
+    {
+        reserved += blocks[b].size;
+    }
+    return reserved;
+}
+
+FrameArena& threadFrameArena()
+{
+    thread_local FrameArena arena;
+    return arena;
+}
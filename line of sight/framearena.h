@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// ===== ===== =====
+// FRAME ARENA
+// ===== ===== =====
+// bump allocator for scratch memory that never outlives a frame: allocating moves a pointer forward, nothing is
+// freed on its own, reset (or rewinding to a mark) gives everything back at once
+// the blocks are kept across frames and merged into one on reset, so after the first frames of a session the
+// arena stops touching the heap and its size stays at the largest frame seen
+// one arena per thread (threadFrameArena), so a thread pool worker allocates without locking
+
+class FrameArena
+{
+public:
+    explicit FrameArena(size_t blockSize = 1 << 16);
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    // alignment must be a power of two
+    void* allocate(size_t size, size_t alignment);
+
+    // position to rewind to, marks are only valid until the next reset
+    struct Mark
+    {
+        size_t block;
+        size_t offset;
+    };
+
+    Mark mark() const { return { current, offset }; }
+    // frees everything allocated since the mark
+    void rewind(Mark mark);
+    // frees everything, call once per frame when no scratch from the frame is in use
+    void reset();
+
+    size_t bytesUsed() const;
+    size_t bytesReserved() const;
+
+private:
+    struct Block
+    {
+        std::unique_ptr<char[]> memory;
+        size_t size;
+    };
+
+    std::vector<Block> blocks;
+    size_t current = 0;     // block being bumped
+    size_t offset = 0;      // first free byte in it
+    size_t blockSize;
+    size_t peak = 0;        // most bytes any frame used, the single block reset merges into
+};
+
+// the calling thread's arena
+FrameArena& threadFrameArena();
+
+// rewinds an arena to where it was when the scope opened, for scratch of one pass inside a longer frame
+class FrameArenaScope
+{
+public:
+    explicit FrameArenaScope(FrameArena& arena) : arena(arena), start(arena.mark()) {}
+    ~FrameArenaScope() { arena.rewind(start); }
+
+    FrameArenaScope(const FrameArenaScope&) = delete;
+    FrameArenaScope& operator=(const FrameArenaScope&) = delete;
+
+private:
+    FrameArena& arena;
+    FrameArena::Mark start;
+};
+
+// standard allocator over an arena, so node based containers (std::set, std::map) and vectors can live in it
+// deallocate does nothing, the memory comes back when the arena is rewound
+template <typename T>
+struct ArenaAllocator
+{
+    using value_type = T;
+
+    FrameArena* arena;
+
+    explicit ArenaAllocator(FrameArena& arena) : arena(&arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t count) { return (T*)arena->allocate(count * sizeof(T), alignof(T)); }
+    void deallocate(T*, size_t) {}
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+};
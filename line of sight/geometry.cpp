@@ -0,0 +1,313 @@
+#include "geometry.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+float distanceBetweenPoints(Vec2 v1, Vec2 v2)
+{
+    return std::sqrt((v2.x - v1.x) * (v2.x - v1.x) + (v2.y - v1.y) * (v2.y - v1.y));
+}
+
+float dot(Vec2 v1, Vec2 v2)
+{
+    return v1.x * v2.x + v1.y * v2.y;
+}
+
+float norm(Vec2 v)
+{
+    return std::sqrt(v.x * v.x + v.y * v.y);
+}
+
+Vec2 normalize(Vec2 v)
+{
+    return v / norm(v);
+}
+
+float cross2D(Vec2 v1, Vec2 v2)
+{
+    return v1.x * v2.y - v1.y * v2.x;
+}
+
+int orientation(Vec2 a, Vec2 b, Vec2 c)
+{
+    double determinant = ((double)b.x - a.x) * ((double)c.y - b.y) - ((double)b.y - a.y) * ((double)c.x - b.x);
+    return determinant > 0.0 ? 1 : (determinant < 0.0 ? -1 : 0);
+}
+
+// 0 -> 2*pi range
+// value based on cos of angle, so
+// 0 -> pi = 1 to -1
+// pi -> 2*pi = -1 to 1
+// we ned to figure out if we're below
+float computeAngleBetweenVectors360(Vec2 v1, Vec2 v2)
+{
+    Vec2 rotated = { -v2.y, v2.x };
+    v1 = normalize(v1);
+    v2 = normalize(v2);
+    if (dot(v1, rotated) > 0)
+    {
+        return std::acos(dot(v1, v2));
+    }
+    else
+    {
+        return 2 * pi - std::acos(dot(v1, v2));
+    }
+}
+
+// utility function for comparison
+// angles are measured based on value of cos on unit circle
+// 0 -> pi = 1 -> -1
+// pi -> 2*pi = -1 -> 1
+int isFirstAngleSmaller(Vec2 v1, Vec2 v2)
+{
+    Vec2 baseline = { 1, 0 };
+    baseline = normalize(baseline);
+    float angle1 = computeAngleBetweenVectors360(baseline, v1);
+    float angle2 = computeAngleBetweenVectors360(baseline, v2);
+
+    if (angle1 < angle2) return -1; else return 1;
+}
+
+// diamond angle: position along the unit diamond |x| + |y| = 1, one unit per quadrant
+float pseudoAngle(Vec2 v)
+{
+    float sum = std::abs(v.x) + std::abs(v.y);
+    if (sum == 0.0f)
+    {
+        return 0.0f;
+    }
+    float p = v.y / sum;
+    if (v.x < 0.0f)
+    {
+        return 2.0f - p;
+    }
+    if (v.y < 0.0f)
+    {
+        return 4.0f + p;
+    }
+    return p;
+}
+
+namespace
+{
+    struct AngleKey
+    {
+        uint32_t key;
+        int index;
+    };
+
+    const int radixBits = 11;
+    const int radixBuckets = 1 << radixBits;
+    const int radixPasses = 3;
+
+    thread_local std::vector<AngleKey> angleKeys;
+    thread_local std::vector<AngleKey> angleKeysBuffer;
+    thread_local std::vector<Vec2> sortedPoints;
+
+    // leaves angleKeys holding the point indices in angle order
+    void sortAngleKeys(const std::vector<Vec2>& points, Vec2 origin)
+    {
+        size_t n = points.size();
+        std::vector<AngleKey>& keys = angleKeys;
+        std::vector<AngleKey>& buffer = angleKeysBuffer;
+        // sized for all the points' buffer can hold, so a count that varies below that never regrows the scratch
+        keys.reserve(points.capacity());
+        buffer.reserve(points.capacity());
+        keys.resize(n);
+        buffer.resize(n);
+
+        // pseudo angles are never negative, so their bit patterns sort like the floats
+        for (size_t i = 0; i < n; i++)
+        {
+            // + 0 folds -0 into 0, whose bit pattern would otherwise sort last
+            float angle = pseudoAngle(points[i] - origin) + 0.0f;
+            if (angle >= 4.0f)
+            {
+                angle = std::nextafter(4.0f, 0.0f); // just below OX rounds up to a full turn
+            }
+            std::memcpy(&keys[i].key, &angle, sizeof(angle));
+            keys[i].index = (int)i;
+        }
+
+        // least significant digit first, stable, so points at equal angles keep their input order
+        for (int pass = 0; pass < radixPasses && n > 1; pass++)
+        {
+            int shift = pass * radixBits;
+            size_t counts[radixBuckets + 1] = {};
+            for (size_t i = 0; i < n; i++)
+            {
+                counts[((keys[i].key >> shift) & (radixBuckets - 1)) + 1]++;
+            }
+            // every key shares this digit, nothing moves
+            if (counts[((keys[0].key >> shift) & (radixBuckets - 1)) + 1] == n)
+            {
+                continue;
+            }
+            for (int b = 0; b < radixBuckets; b++)
+            {
+                counts[b + 1] += counts[b];
+            }
+            for (size_t i = 0; i < n; i++)
+            {
+                buffer[counts[(keys[i].key >> shift) & (radixBuckets - 1)]++] = keys[i];
+            }
+            keys.swap(buffer);
+        }
+    }
+}
+
+void sortByAngle(std::vector<Vec2>& points, Vec2 origin)
+{
+    if (points.size() < 2)
+    {
+        return;
+    }
+
+    sortAngleKeys(points, origin);
+    sortedPoints.resize(points.size());
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        sortedPoints[i] = points[angleKeys[i].index];
+    }
+    std::copy(sortedPoints.begin(), sortedPoints.end(), points.begin());
+}
+
+void sortIndicesByAngle(const std::vector<Vec2>& points, Vec2 origin, std::vector<int>& order)
+{
+    sortAngleKeys(points, origin);
+    order.reserve(points.capacity());
+    order.resize(points.size());
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        order[i] = angleKeys[i].index;
+    }
+}
+
+Vec2 rotateVector(Vec2 v, float angle)
+{
+    float oldAngle = std::atan2(v.y, v.x);
+    return Vec2(norm(v) * std::cos(oldAngle + angle), norm(v) * std::sin(oldAngle + angle));
+}
+
+Vec2 raySegmentIntersectionPoint(Vec2 origin, Vec2 ray, Vec2 s1, Vec2 s2)
+{
+    Vec2 solution = origin;
+    Vec2 rotated = { -(s2 - s1).y, (s2 - s1).x };
+    solution += (dot(s1 - origin, normalize(rotated))) / (dot(normalize(rotated), ray)) * ray;
+
+    return solution;
+}
+
+bool rayInstersectsSegment(Vec2 origin, Vec2 ray, Vec2 s1, Vec2 s2)
+{
+    // s2-s1 = AB
+
+    // check if ray origin collinear with AB
+    if (std::abs(cross2D(origin - s1, s2 - s1)) - 0.01f < 0)
+    {
+        return false;
+    }
+
+    Vec2 I = raySegmentIntersectionPoint(origin, ray, s1, s2);
+
+    // check if intersection point is outside of AB
+    float ratio = dot(I - s1, I - s1) / dot(I - s1, s2 - s1); // I = point where ray intersects segment AB, ratio = AI/AB
+    if (ratio < 0 || ratio > 1)
+    {
+        return false;
+    }
+
+    // check if intersection point in opposite direction to ray
+    Vec2 rotated = { -(s2 - s1).y, (s2 - s1).x }; // AB rotated by 90 deg
+    if (-(dot(origin - s1, normalize(rotated))) / (dot(normalize(rotated), ray)) < 0)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+// check (s1, s2) and (s1, point) slope to establish collinearity OR cross product must be zero
+// then min(s1, s2) < coordinate(point) < max(s1, s2) to see if it's on the segment
+bool isPointOnSegment(Vec2 point, Vec2 s1, Vec2 s2)
+{
+    if (cross2D(s1 - point, s1 - s2) == 0)
+        return false;
+    if (
+        point.x >= std::fmin(s1.x, s2.x) && point.x <= std::fmax(s1.x, s2.x)
+        && (point.y >= std::fmin(s1.y, s2.y) && point.y <= std::fmax(s1.y, s2.y))
+        )
+        return true;
+    else
+        return false;
+}
+
+bool isRightOfSegment(Vec2 origin1, Vec2 origin2, Vec2 point)
+{
+    Vec2 segment = { -(origin2.y - origin1.y), origin2.x - origin1.x }; // B-A then rotate left
+    Vec2 movedPoint = point - origin1; // C-A
+    float dotProduct = segment.x * movedPoint.x + segment.y * movedPoint.y;
+    if (dotProduct > 0)
+    {
+        return true;
+    }
+    return false;
+}
+
+bool insideTriangle(const std::vector<Vec2>& triangle, Vec2 point)
+{
+    if (isRightOfSegment(triangle[0], triangle[1], point))
+    {
+        if (!isRightOfSegment(triangle[1], triangle[2], point))
+            return false;
+        if (!isRightOfSegment(triangle[2], triangle[0], point))
+            return false;
+        return true;
+    }
+    else
+    {
+        if (isRightOfSegment(triangle[1], triangle[2], point))
+            return false;
+        if (isRightOfSegment(triangle[2], triangle[0], point))
+            return false;
+        return true;
+    }
+}
+
+std::vector<Segment> getSegmentsFromPolygon(const Polygon& s)
+{
+    std::vector<Segment> solution;
+    if (s.size() > 1)
+    {
+        size_t i = 0;
+        Segment seg;
+        while (i < s.size() - 1)
+        {
+            seg.startPoint = s[i];
+            i++;
+            seg.endPoint = s[i];
+            solution.push_back(seg);
+        }
+        seg.startPoint = s[i];
+        seg.endPoint = s[0];
+        solution.push_back(seg);
+    }
+    return solution;
+}
+
+bool isPointInsideConvexPolygon(const Polygon& cs, Vec2 point)
+{
+    std::vector<Segment> vs = getSegmentsFromPolygon(cs);
+    bool side = isRightOfSegment(vs[0].startPoint, vs[0].endPoint, point);
+
+    for (size_t i = 1; i < vs.size(); i++)
+    {
+        if (isRightOfSegment(vs[i].startPoint, vs[i].endPoint, point) != side)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+
+// ===== ===== =====
+// BASIC TYPES
+// ===== ===== =====
+
+const float pi = 3.141592f;
+
+// plain 2D vector, mirrors the parts of sf::Vector2f the geometry code needs
+struct Vec2
+{
+    float x;
+    float y;
+
+    Vec2() : x(0.0f), y(0.0f) {}
+    Vec2(float x, float y) : x(x), y(y) {}
+
+    Vec2& operator+=(Vec2 v) { x += v.x; y += v.y; return *this; }
+    Vec2& operator-=(Vec2 v) { x -= v.x; y -= v.y; return *this; }
+    Vec2& operator*=(float f) { x *= f; y *= f; return *this; }
+    Vec2& operator/=(float f) { x /= f; y /= f; return *this; }
+};
+
+inline Vec2 operator+(Vec2 v1, Vec2 v2) { return Vec2(v1.x + v2.x, v1.y + v2.y); }
+inline Vec2 operator-(Vec2 v1, Vec2 v2) { return Vec2(v1.x - v2.x, v1.y - v2.y); }
+inline Vec2 operator-(Vec2 v) { return Vec2(-v.x, -v.y); }
+inline Vec2 operator*(Vec2 v, float f) { return Vec2(v.x * f, v.y * f); }
+inline Vec2 operator*(float f, Vec2 v) { return Vec2(v.x * f, v.y * f); }
+inline Vec2 operator/(Vec2 v, float f) { return Vec2(v.x / f, v.y / f); }
+inline bool operator==(Vec2 v1, Vec2 v2) { return v1.x == v2.x && v1.y == v2.y; }
+inline bool operator!=(Vec2 v1, Vec2 v2) { return !(v1 == v2); }
+
+struct Segment
+{
+    Vec2 startPoint;
+    Vec2 endPoint;
+};
+
+// convex polygon, points in winding order
+typedef std::vector<Vec2> Polygon;
+
+// ===== ===== =====
+// UTILITY FUNCTIONS
+// ===== ===== =====
+
+// utility function for quicksort
+template <typename T>
+int partition(std::vector<T>& v, int si, int ei, int (*f)(T, T))
+{
+    T pivot = v[ei];
+    int i = (si - 1);
+    for (int j = si; j <= ei - 1; j++)
+    {
+        if ((*f)(v[j], pivot) > 0)
+        {
+            i++;
+            std::swap(v[i], v[j]);
+        }
+    }
+    std::swap(v[i + 1], v[ei]);
+    return (i + 1);
+}
+
+template <typename T>
+void quicksort(std::vector<T>& v, int si, int ei, int (*f)(T, T))
+{
+    if (si < ei)
+    {
+        int pi = partition<T>(v, si, ei, f);
+
+        quicksort(v, si, pi - 1, f);
+        quicksort(v, pi + 1, ei, f);
+    }
+}
+
+float distanceBetweenPoints(Vec2 v1, Vec2 v2);
+float dot(Vec2 v1, Vec2 v2);
+float norm(Vec2 v);
+Vec2 normalize(Vec2 v);
+float cross2D(Vec2 v1, Vec2 v2);
+// sign of cross2D(b - a, c - b): 1 if c lies on the side of larger angles (counterclockwise), -1 on the other side, 0 collinear
+// evaluated in double, where the differences of the float coordinates and (for coordinates of similar magnitude)
+// their products are exact, so the sign doesn't flip on points that float rounding makes look collinear
+int orientation(Vec2 a, Vec2 b, Vec2 c);
+
+// 0 -> 2*pi range
+float computeAngleBetweenVectors360(Vec2 v1, Vec2 v2);
+
+// utility function for comparison, angles measured against OX
+int isFirstAngleSmaller(Vec2 v1, Vec2 v2);
+
+// cheap stand-in for the angle of v against OX, no trig
+// grows with the angle and maps [0, 2*pi) onto [0, 4), the zero vector maps to 0
+float pseudoAngle(Vec2 v);
+
+// sorts points by the angle around origin, same order as isFirstAngleSmaller on (point - origin)
+// one pseudo angle key per point and a stable radix sort of key / point pairs, O(n)
+void sortByAngle(std::vector<Vec2>& points, Vec2 origin);
+// same order, written as indices into points
+void sortIndicesByAngle(const std::vector<Vec2>& points, Vec2 origin, std::vector<int>& order);
+
+Vec2 rotateVector(Vec2 v, float angle);
+
+Vec2 raySegmentIntersectionPoint(Vec2 origin, Vec2 ray, Vec2 s1, Vec2 s2);
+bool rayInstersectsSegment(Vec2 origin, Vec2 ray, Vec2 s1, Vec2 s2);
+bool isPointOnSegment(Vec2 point, Vec2 s1, Vec2 s2);
+
+bool isRightOfSegment(Vec2 origin1, Vec2 origin2, Vec2 point);
+bool insideTriangle(const std::vector<Vec2>& triangle, Vec2 point);
+
+std::vector<Segment> getSegmentsFromPolygon(const Polygon& s);
+bool isPointInsideConvexPolygon(const Polygon& cs, Vec2 point);
@@ -0,0 +1,152 @@
+#include "level.h"
+
+void loadShapes(std::vector<Polygon>& shapes)
+{
+    Polygon shape(4);
+    // top left
+    shape[0] = { 100, 100 };
+    shape[1] = { 350, 100 };
+    shape[2] = { 300, 200 };
+    shape[3] = { 100, 150 };
+    shapes.push_back(shape);
+
+    shape[0] = { 100, 200 };
+    shape[1] = { 250, 200 };
+    shape[2] = { 200, 300 };
+    shape[3] = { 100, 250 };
+    shapes.push_back(shape);
+
+    // bottom left
+    shape[0] = { 100, 400 };
+    shape[1] = { 200, 400 };
+    shape[2] = { 200, 500 };
+    shape[3] = { 100, 500 };
+    shapes.push_back(shape);
+
+    shape[0] = { 100, 500 };
+    shape[1] = { 400, 500 };
+    shape[2] = { 400, 600 };
+    shape[3] = { 100, 600 };
+    shapes.push_back(shape);
+
+    // middle top
+    shape[0] = { 400, 100 };
+    shape[1] = { 500, 100 };
+    shape[2] = { 500, 400 };
+    shape[3] = { 400, 400 };
+    shapes.push_back(shape);
+
+    shape[0] = { 500, 300 };
+    shape[1] = { 700, 300 };
+    shape[2] = { 700, 400 };
+    shape[3] = { 500, 400 };
+    shapes.push_back(shape);
+
+    // middle bottom
+    shape[0] = { 500, 500 };
+    shape[1] = { 600, 500 };
+    shape[2] = { 600, 700 };
+    shape[3] = { 500, 700 };
+    shapes.push_back(shape);
+
+    // right top
+    shape[0] = { 800, 100 };
+    shape[1] = { 1200, 100 };
+    shape[2] = { 1200, 200 };
+    shape[3] = { 800, 200 };
+    shapes.push_back(shape);
+
+    shape[0] = { 1100, 200 };
+    shape[1] = { 1200, 200 };
+    shape[2] = { 1200, 500 };
+    shape[3] = { 1100, 500 };
+    shapes.push_back(shape);
+
+    // right bottom
+    shape[0] = { 800, 400 };
+    shape[1] = { 900, 400 };
+    shape[2] = { 900, 500 };
+    shape[3] = { 800, 500 };
+    shapes.push_back(shape);
+
+    shape[0] = { 800, 600 };
+    shape[1] = { 900, 600 };
+    shape[2] = { 900, 700 };
+    shape[3] = { 800, 700 };
+    shapes.push_back(shape);
+
+    shape[0] = { 900, 400 };
+    shape[1] = { 1000, 400 };
+    shape[2] = { 1000, 700 };
+    shape[3] = { 900, 700 };
+    shapes.push_back(shape);
+}
+
+void loadEdges(Polygon& screenEdges)
+{
+    screenEdges.resize(4);
+    screenEdges[0] = { 0, 0 };
+    screenEdges[1] = { 1600, 0 };
+    screenEdges[2] = { 1600, 800 };
+    screenEdges[3] = { 0, 800 };
+}
+
+void loadDefaultLevel(Level& level)
+{
+    level.shapes.clear();
+    loadShapes(level.shapes);
+    loadEdges(level.screenEdges);
+    rebuildSegments(level);
+}
+
+void updateBounds(Level& level)
+{
+    if (level.screenEdges.empty())
+    {
+        level.boundsMin = Vec2();
+        level.boundsMax = Vec2();
+        return;
+    }
+    level.boundsMin = level.screenEdges[0];
+    level.boundsMax = level.screenEdges[0];
+    for (size_t i = 1; i < level.screenEdges.size(); i++)
+    {
+        level.boundsMin = Vec2(std::fmin(level.boundsMin.x, level.screenEdges[i].x), std::fmin(level.boundsMin.y, level.screenEdges[i].y));
+        level.boundsMax = Vec2(std::fmax(level.boundsMax.x, level.screenEdges[i].x), std::fmax(level.boundsMax.y, level.screenEdges[i].y));
+    }
+}
+
+void rebuildSegments(Level& level)
+{
+    level.segments.build(level.shapes, level.screenEdges);
+    level.grid.build(level.segments, level.gridCellSize);
+    level.bvh.build(level.segments);
+    updateBounds(level);
+    level.geometryVersion++;
+}
+
+void refitSegments(Level& level)
+{
+    level.segments.build(level.shapes, level.screenEdges);
+    level.grid.build(level.segments, level.gridCellSize);
+    level.bvh.refit(level.segments);
+    updateBounds(level);
+    level.geometryVersion++;
+}
+
+void bakePVS(Level& level, float cellSize, ThreadPool* pool)
+{
+    level.pvs.bake(level.segments, level.grid, cellSize, pool);
+    level.pvs.geometryVersion = level.geometryVersion;
+}
+
+bool loadOrBakePVS(Level& level, const char* path, float cellSize)
+{
+    if (level.pvs.load(path, level.segments) && (cellSize <= 0.0f || level.pvs.cellSize == cellSize))
+    {
+        level.pvs.geometryVersion = level.geometryVersion;
+        return true;
+    }
+    bakePVS(level, cellSize);
+    return level.pvs.save(path);
+}
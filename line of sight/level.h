@@ -0,0 +1,58 @@
+#pragma once
+
+#include "geometry.h"
+#include "pvs.h"
+#include "segmentbvh.h"
+#include "segmentgrid.h"
+#include "segmentstore.h"
+
+// acceleration structure castRay walks
+enum class SpatialIndex
+{
+    Grid,   // uniform grid, best for evenly dense levels
+    BVH,    // bounding volume hierarchy, best for dense interiors inside large empty areas
+    None,   // every edge for every ray
+    PVS     // baked list of the edges visible from the ray origin's cell, Grid where there is none (see bakePVS)
+};
+
+// static scene geometry: the convex obstacles and the world bounds
+struct Level
+{
+    std::vector<Polygon> shapes;
+    Polygon screenEdges;
+
+    // flattened edges of shapes + screenEdges, call rebuildSegments after touching either
+    SegmentStore segments;
+    SegmentGrid grid;
+    float gridCellSize = 0.0f; // 0 lets the grid pick a cell size from the segment density
+    SegmentBVH bvh;
+    SpatialIndex spatialIndex = SpatialIndex::Grid;
+    unsigned geometryVersion = 0;
+
+    // box around screenEdges, the world movers are kept in
+    Vec2 boundsMin;
+    Vec2 boundsMax;
+
+    // only used while pvs.geometryVersion == geometryVersion, geometry changes leave it stale until baked again
+    PotentiallyVisibleSet pvs;
+};
+
+void loadShapes(std::vector<Polygon>& shapes);
+void loadEdges(Polygon& screenEdges);
+void loadDefaultLevel(Level& level);
+
+// recomputes boundsMin / boundsMax from the screen edges, the rebuild functions call it
+void updateBounds(Level& level);
+
+// refreshes level.segments, level.grid, level.bvh and the bounds from the polygons and bumps geometryVersion
+void rebuildSegments(Level& level);
+
+// cheaper update after shape points moved without adding or removing any: the BVH is refit instead of rebuilt
+void refitSegments(Level& level);
+
+// bakes level.pvs for the current geometry, cellSize <= 0 reuses the grid's
+void bakePVS(Level& level, float cellSize = 0.0f, ThreadPool* pool = nullptr);
+
+// loads level.pvs from path if it was baked for the current geometry, otherwise bakes it and writes it there
+// returns false if a fresh bake could not be saved
+bool loadOrBakePVS(Level& level, const char* path, float cellSize = 0.0f);
@@ -0,0 +1,508 @@
+#include "levelfile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+    const char levelMagic[4] = { 'L', 'L', 'V', 'L' };
+    const uint32_t levelFormatVersion = 1;
+    const uint64_t sectionAlignment = 16;
+
+    enum LevelSection : uint32_t
+    {
+        ShapeStarts,        // int, shapes + 1 offsets into ShapePoints
+        ShapePoints,        // Vec2
+        ScreenEdges,        // Vec2
+        SegmentX0,          // float, one per edge
+        SegmentY0,
+        SegmentDX,
+        SegmentDY,
+        SegmentNX,
+        SegmentNY,
+        SegmentShapeStart,  // int, shapes + 1
+        GridShape,          // GridInfo, exactly one
+        GridCellStart,      // int, cells + 1
+        GridCellSegments,   // int
+        GridCellX0,         // float, one per cell segment
+        GridCellY0,
+        GridCellDX,
+        GridCellDY,
+        GridCellShapeStart, // int, cells + 1
+        GridCellShapes,     // int
+        BVHNodes,           // BVHNode
+        BVHIndices,         // int
+        SectionCount
+    };
+
+    struct LevelFileHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t sectionCount;
+        int32_t screenEdgesStart;
+        float gridCellSize;
+        uint32_t reserved[3];
+    };
+
+    struct LevelFileSection
+    {
+        uint32_t tag;
+        uint32_t elementSize;
+        uint64_t offset;
+        uint64_t count;
+    };
+
+    struct GridInfo
+    {
+        float originX;
+        float originY;
+        float cellSize;
+        int32_t columns;
+        int32_t rows;
+    };
+
+    struct PendingSection
+    {
+        LevelSection tag;
+        uint32_t elementSize;
+        const void* data;
+        uint64_t count;
+    };
+
+    template <typename T>
+    void addSection(std::vector<PendingSection>& sections, LevelSection tag, const std::vector<T>& values)
+    {
+        sections.push_back({ tag, (uint32_t)sizeof(T), values.data(), values.size() });
+    }
+
+    // section lookup over a file's bytes whose table was already checked against the file size
+    struct SectionTable
+    {
+        const std::vector<unsigned char>* file = nullptr;
+        const LevelFileSection* sections[SectionCount] = {};
+
+        bool has(LevelSection tag) const { return sections[tag] != nullptr; }
+
+        template <typename T>
+        bool read(LevelSection tag, std::vector<T>& values) const
+        {
+            const LevelFileSection* section = sections[tag];
+            if (section == nullptr || section->elementSize != sizeof(T))
+            {
+                return false;
+            }
+            const T* first = (const T*)(file->data() + section->offset);
+            values.assign(first, first + section->count);
+            return true;
+        }
+    };
+
+    // start[0] == 0, never decreasing, start.back() == itemCount
+    bool isValidRanges(const std::vector<int>& start, size_t itemCount)
+    {
+        if (start.empty() || start.front() != 0 || (size_t)start.back() != itemCount)
+        {
+            return false;
+        }
+        for (size_t i = 1; i < start.size(); i++)
+        {
+            if (start[i] < start[i - 1])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool isValidIndices(const std::vector<int>& items, int limit)
+    {
+        for (size_t i = 0; i < items.size(); i++)
+        {
+            if (items[i] < 0 || items[i] >= limit)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool readGrid(const SectionTable& table, int segmentCount, int shapeCount, SegmentGrid& grid)
+    {
+        std::vector<GridInfo> info;
+        if (!table.read(GridShape, info) || info.size() != 1 || !(info[0].cellSize > 0.0f) || info[0].columns <= 0 || info[0].rows <= 0 ||
+            (int64_t)info[0].columns * info[0].rows > (1 << 26))
+        {
+            return false;
+        }
+        grid.originX = info[0].originX;
+        grid.originY = info[0].originY;
+        grid.cellSize = info[0].cellSize;
+        grid.inverseCellSize = 1.0f / info[0].cellSize;
+        grid.columns = info[0].columns;
+        grid.rows = info[0].rows;
+        size_t cellCount = (size_t)grid.columns * grid.rows;
+
+        if (!table.read(GridCellStart, grid.cellStart) || !table.read(GridCellSegments, grid.cellSegments) ||
+            !table.read(GridCellX0, grid.cellX0) || !table.read(GridCellY0, grid.cellY0) || !table.read(GridCellDX, grid.cellDX) || !table.read(GridCellDY, grid.cellDY) ||
+            !table.read(GridCellShapeStart, grid.cellShapeStart) || !table.read(GridCellShapes, grid.cellShapes))
+        {
+            return false;
+        }
+        size_t entries = grid.cellSegments.size();
+        return grid.cellStart.size() == cellCount + 1 && isValidRanges(grid.cellStart, entries) && isValidIndices(grid.cellSegments, segmentCount) &&
+            grid.cellX0.size() == entries && grid.cellY0.size() == entries && grid.cellDX.size() == entries && grid.cellDY.size() == entries &&
+            grid.cellShapeStart.size() == cellCount + 1 && isValidRanges(grid.cellShapeStart, grid.cellShapes.size()) && isValidIndices(grid.cellShapes, shapeCount);
+    }
+
+    bool readBVH(const SectionTable& table, int segmentCount, SegmentBVH& bvh)
+    {
+        if (!table.read(BVHNodes, bvh.nodes) || !table.read(BVHIndices, bvh.indices) || bvh.nodes.empty())
+        {
+            return false;
+        }
+        // children always come after their parent, so the traversal can't loop, and no node lies deeper than the
+        // traversal stacks allow; parents come first, so a node's depth is final by the time it is reached
+        int nodeCount = (int)bvh.nodes.size();
+        int indexCount = (int)bvh.indices.size();
+        std::vector<int> depth(nodeCount, 0);
+        for (int n = 0; n < nodeCount; n++)
+        {
+            const BVHNode& node = bvh.nodes[n];
+            bool validInner = node.count == 0 && node.first > n && node.first + 1 < nodeCount;
+            bool validLeaf = node.count > 0 && node.first >= 0 && node.first <= indexCount - node.count;
+            if ((!validInner && !validLeaf) || depth[n] > SegmentBVH::maxDepth)
+            {
+                return false;
+            }
+            if (validInner)
+            {
+                depth[node.first] = std::max(depth[node.first], depth[n] + 1);
+                depth[node.first + 1] = std::max(depth[node.first + 1], depth[n] + 1);
+            }
+        }
+        return isValidIndices(bvh.indices, segmentCount);
+    }
+}
+
+bool saveLevelFile(const Level& level, const char* path, bool withAccelerationStructures)
+{
+    // polygons flattened into one point array
+    std::vector<int> shapeStarts(1, 0);
+    std::vector<Vec2> shapePoints;
+    for (size_t i = 0; i < level.shapes.size(); i++)
+    {
+        shapePoints.insert(shapePoints.end(), level.shapes[i].begin(), level.shapes[i].end());
+        shapeStarts.push_back((int)shapePoints.size());
+    }
+
+    const SegmentStore& segments = level.segments;
+    std::vector<PendingSection> sections;
+    addSection(sections, ShapeStarts, shapeStarts);
+    addSection(sections, ShapePoints, shapePoints);
+    addSection(sections, ScreenEdges, level.screenEdges);
+    addSection(sections, SegmentX0, segments.x0);
+    addSection(sections, SegmentY0, segments.y0);
+    addSection(sections, SegmentDX, segments.dx);
+    addSection(sections, SegmentDY, segments.dy);
+    addSection(sections, SegmentNX, segments.nx);
+    addSection(sections, SegmentNY, segments.ny);
+    addSection(sections, SegmentShapeStart, segments.shapeStart);
+
+    std::vector<GridInfo> gridInfo;
+    const SegmentGrid& grid = level.grid;
+    if (withAccelerationStructures && !grid.isEmpty())
+    {
+        gridInfo.push_back({ grid.originX, grid.originY, grid.cellSize, grid.columns, grid.rows });
+        addSection(sections, GridShape, gridInfo);
+        addSection(sections, GridCellStart, grid.cellStart);
+        addSection(sections, GridCellSegments, grid.cellSegments);
+        addSection(sections, GridCellX0, grid.cellX0);
+        addSection(sections, GridCellY0, grid.cellY0);
+        addSection(sections, GridCellDX, grid.cellDX);
+        addSection(sections, GridCellDY, grid.cellDY);
+        addSection(sections, GridCellShapeStart, grid.cellShapeStart);
+        addSection(sections, GridCellShapes, grid.cellShapes);
+    }
+    if (withAccelerationStructures && !level.bvh.isEmpty())
+    {
+        addSection(sections, BVHNodes, level.bvh.nodes);
+        addSection(sections, BVHIndices, level.bvh.indices);
+    }
+
+    LevelFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, levelMagic, 4);
+    header.version = levelFormatVersion;
+    header.sectionCount = (uint32_t)sections.size();
+    header.screenEdgesStart = segments.screenEdgesStart;
+    header.gridCellSize = level.gridCellSize;
+
+    std::vector<LevelFileSection> table(sections.size());
+    uint64_t offset = sizeof(LevelFileHeader) + sections.size() * sizeof(LevelFileSection);
+    for (size_t s = 0; s < sections.size(); s++)
+    {
+        offset = (offset + sectionAlignment - 1) / sectionAlignment * sectionAlignment;
+        table[s] = { (uint32_t)sections[s].tag, sections[s].elementSize, offset, sections[s].count };
+        offset += sections[s].count * sections[s].elementSize;
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)table.data(), table.size() * sizeof(LevelFileSection));
+    const char padding[sectionAlignment] = {};
+    uint64_t written = sizeof(LevelFileHeader) + table.size() * sizeof(LevelFileSection);
+    for (size_t s = 0; s < sections.size(); s++)
+    {
+        file.write(padding, table[s].offset - written);
+        file.write((const char*)sections[s].data, sections[s].count * sections[s].elementSize);
+        written = table[s].offset + sections[s].count * sections[s].elementSize;
+    }
+    return (bool)file;
+}
+
+// the whole file in one read, the sections are copied out of it into the level's arrays anyway
+static bool readWholeFile(const char* path, std::vector<unsigned char>& bytes)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+    {
+        return false;
+    }
+    std::streamoff size = file.tellg();
+    if (size <= 0)
+    {
+        return false;
+    }
+    bytes.resize((size_t)size);
+    file.seekg(0);
+    return (bool)file.read((char*)bytes.data(), size);
+}
+
+// reads path and checks the header and every section's range against the file size
+static bool openLevelSections(std::vector<unsigned char>& file, const char* path, LevelFileHeader& header, SectionTable& table)
+{
+    if (!readWholeFile(path, file) || file.size() < sizeof(LevelFileHeader))
+    {
+        return false;
+    }
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (!std::equal(header.magic, header.magic + 4, levelMagic) || header.version != levelFormatVersion ||
+        header.sectionCount > 4 * SectionCount || sizeof(LevelFileHeader) + (uint64_t)header.sectionCount * sizeof(LevelFileSection) > file.size())
+    {
+        return false;
+    }
+
+    table.file = &file;
+    const LevelFileSection* sections = (const LevelFileSection*)(file.data() + sizeof(LevelFileHeader));
+    for (uint32_t s = 0; s < header.sectionCount; s++)
+    {
+        const LevelFileSection& section = sections[s];
+        // unknown tags are skipped, so later versions can add sections old readers ignore
+        if (section.tag >= SectionCount)
+        {
+            continue;
+        }
+        if (section.elementSize == 0 || section.offset % sectionAlignment != 0 || section.offset > file.size() ||
+            section.count > (file.size() - section.offset) / section.elementSize || table.sections[section.tag] != nullptr)
+        {
+            return false;
+        }
+        table.sections[section.tag] = &section;
+    }
+    return true;
+}
+
+static bool readPolygons(const SectionTable& table, std::vector<Polygon>& shapes, Polygon& screenEdges)
+{
+    std::vector<int> shapeStarts;
+    std::vector<Vec2> shapePoints;
+    if (!table.read(ShapeStarts, shapeStarts) || !table.read(ShapePoints, shapePoints) || !table.read(ScreenEdges, screenEdges) ||
+        !isValidRanges(shapeStarts, shapePoints.size()))
+    {
+        return false;
+    }
+    shapes.resize(shapeStarts.size() - 1);
+    for (size_t i = 0; i + 1 < shapeStarts.size(); i++)
+    {
+        shapes[i].assign(shapePoints.begin() + shapeStarts[i], shapePoints.begin() + shapeStarts[i + 1]);
+    }
+    return true;
+}
+
+bool loadLevelFile(Level& level, const char* path)
+{
+    std::vector<unsigned char> file;
+    LevelFileHeader header;
+    SectionTable table;
+    if (!openLevelSections(file, path, header, table))
+    {
+        return false;
+    }
+
+    Level loaded;
+    SegmentStore& segments = loaded.segments;
+    if (!readPolygons(table, loaded.shapes, loaded.screenEdges) ||
+        !table.read(SegmentX0, segments.x0) || !table.read(SegmentY0, segments.y0) || !table.read(SegmentDX, segments.dx) ||
+        !table.read(SegmentDY, segments.dy) || !table.read(SegmentNX, segments.nx) || !table.read(SegmentNY, segments.ny) ||
+        !table.read(SegmentShapeStart, segments.shapeStart))
+    {
+        return false;
+    }
+    segments.screenEdgesStart = header.screenEdgesStart;
+    size_t edgeCount = segments.x0.size();
+    // the store appends the shapes' points in order, so its shape offsets follow the polygon sizes
+    bool sameShapes = segments.shapeStart.size() == loaded.shapes.size() + 1;
+    for (size_t i = 0; sameShapes && i < loaded.shapes.size(); i++)
+    {
+        sameShapes = segments.shapeStart[i + 1] - segments.shapeStart[i] == (int)loaded.shapes[i].size();
+    }
+    if (!sameShapes || segments.y0.size() != edgeCount || segments.dx.size() != edgeCount || segments.dy.size() != edgeCount || segments.nx.size() != edgeCount || segments.ny.size() != edgeCount ||
+        !isValidRanges(segments.shapeStart, (size_t)std::max(0, segments.screenEdgesStart)) || edgeCount != (size_t)segments.screenEdgesStart + loaded.screenEdges.size())
+    {
+        return false;
+    }
+
+    // derived from the edges, too cheap to be worth a section
+    segments.computeWindings();
+    loaded.gridCellSize = header.gridCellSize;
+
+    int segmentCount = (int)edgeCount;
+    if (table.has(GridShape))
+    {
+        if (!readGrid(table, segmentCount, segments.shapeCount(), loaded.grid))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        loaded.grid.build(segments, loaded.gridCellSize);
+    }
+    if (table.has(BVHNodes))
+    {
+        if (!readBVH(table, segmentCount, loaded.bvh))
+        {
+            return false;
+        }
+        loaded.bvh.copyLeafEdges(segments);
+    }
+    else
+    {
+        loaded.bvh.build(segments);
+    }
+
+    level.shapes = std::move(loaded.shapes);
+    level.screenEdges = std::move(loaded.screenEdges);
+    level.segments = std::move(loaded.segments);
+    level.grid = std::move(loaded.grid);
+    level.bvh = std::move(loaded.bvh);
+    level.gridCellSize = loaded.gridCellSize;
+    updateBounds(level);
+    level.geometryVersion++;
+    return true;
+}
+
+bool loadLevelShapes(const char* path, std::vector<Polygon>& shapes, Polygon& screenEdges)
+{
+    std::vector<unsigned char> file;
+    LevelFileHeader header;
+    SectionTable table;
+    std::vector<Polygon> loadedShapes;
+    Polygon loadedEdges;
+    if (!openLevelSections(file, path, header, table) || !readPolygons(table, loadedShapes, loadedEdges))
+    {
+        return false;
+    }
+    shapes = std::move(loadedShapes);
+    screenEdges = std::move(loadedEdges);
+    return true;
+}
+
+bool loadLevelText(Level& level, const char* path, int* errorLine)
+{
+    int failedLine = 0;
+    if (errorLine == nullptr)
+    {
+        errorLine = &failedLine;
+    }
+    *errorLine = 0;
+
+    std::ifstream file(path);
+    if (!file)
+    {
+        return false;
+    }
+
+    std::vector<Polygon> shapes;
+    Polygon screenEdges;
+    float gridCellSize = 0.0f;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line))
+    {
+        lineNumber++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream words(line);
+        std::string keyword;
+        if (!(words >> keyword))
+        {
+            continue;
+        }
+
+        bool valid = true;
+        if (keyword == "bounds")
+        {
+            float minX, minY, maxX, maxY;
+            valid = (bool)(words >> minX >> minY >> maxX >> maxY) && minX < maxX && minY < maxY;
+            screenEdges = { Vec2(minX, minY), Vec2(maxX, minY), Vec2(maxX, maxY), Vec2(minX, maxY) };
+        }
+        else if (keyword == "shape")
+        {
+            std::vector<float> coordinates;
+            float value;
+            while (words >> value)
+            {
+                coordinates.push_back(value);
+            }
+            valid = words.eof() && coordinates.size() % 2 == 0 && coordinates.size() >= 6;
+            Polygon shape;
+            for (size_t i = 0; i + 1 < coordinates.size(); i += 2)
+            {
+                shape.push_back(Vec2(coordinates[i], coordinates[i + 1]));
+            }
+            shapes.push_back(shape);
+        }
+        else if (keyword == "grid")
+        {
+            valid = (bool)(words >> gridCellSize) && gridCellSize >= 0.0f;
+        }
+        else
+        {
+            valid = false;
+        }
+
+        std::string rest;
+        if (!valid || (keyword != "shape" && words >> rest))
+        {
+            *errorLine = lineNumber;
+            return false;
+        }
+    }
+    if (screenEdges.empty())
+    {
+        return false;
+    }
+
+    level.shapes = shapes;
+    level.screenEdges = screenEdges;
+    level.gridCellSize = gridCellSize;
+    rebuildSegments(level);
+    return true;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "level.h"
+
+// ===== ===== =====
+// LEVEL FILES
+// ===== ===== =====
+// binary level (.lvl): a header, a section table, then one 16 byte aligned array per section, all in the
+// machine's byte order
+// sections: polygons (shape offsets + points), screen edges, the flat SegmentStore table and, optionally,
+// the SegmentGrid and SegmentBVH arrays
+// loading reads the file in one go and bulk copies every section into the level's arrays, nothing is parsed, and a
+// file saved with its acceleration structures skips the grid and BVH builds
+
+// saves shapes, screen edges and segments, plus grid and bvh when withAccelerationStructures is set
+bool saveLevelFile(const Level& level, const char* path, bool withAccelerationStructures = true);
+
+// replaces the level's geometry with the file's and bumps geometryVersion, the level is left untouched on failure
+// (missing file, other format version, any section out of range or inconsistent)
+bool loadLevelFile(Level& level, const char* path);
+
+// only the polygons and screen edges, for callers that assemble their own level (streamed chunks)
+bool loadLevelShapes(const char* path, std::vector<Polygon>& shapes, Polygon& screenEdges);
+
+// text description, one entry per line, # starts a comment:
+//   bounds minX minY maxX maxY        world rectangle (the screen edges), required
+//   shape x y x y x y ...             convex polygon, at least 3 points, in winding order
+//   grid cellSize                     optional grid cell size, 0 or missing picks one from the density
+// errorLine receives the 1 based line that failed to parse (0 for a missing file or bounds)
+bool loadLevelText(Level& level, const char* path, int* errorLine = nullptr);
@@ -0,0 +1,236 @@
+#include "levelgen.h"
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+
+static Polygon box(float x, float y, float width, float height)
+{
+    return { Vec2(x, y), Vec2(x + width, y), Vec2(x + width, y + height), Vec2(x, y + height) };
+}
+
+static void setWorld(Level& level, float width, float height)
+{
+    level.screenEdges = box(0.0f, 0.0f, width, height);
+    rebuildSegments(level);
+}
+
+// ===== ===== =====
+// MAZE
+// ===== ===== =====
+
+void generateMaze(Level& level, int segmentCount, unsigned seed)
+{
+    const float cellSize = 40.0f;
+    const float wall = 4.0f;
+
+    // a perfect maze on n x n cells keeps about n * n + 2n walls, every one a 4 edge slab
+    int n = std::max(2, (int)std::sqrt(std::max(0, segmentCount) / 4.0f));
+    std::mt19937 generator(seed);
+
+    // open[c] bit 0: wall to the right of cell c removed, bit 1: wall below removed
+    std::vector<uint8_t> open(n * n, 0);
+    std::vector<uint8_t> visited(n * n, 0);
+    std::vector<int> stack(1, 0);
+    visited[0] = 1;
+    while (!stack.empty())
+    {
+        int cell = stack.back();
+        int cx = cell % n;
+        int cy = cell / n;
+        // left, right, up, down
+        int candidates[4] = { cx > 0 ? cell - 1 : -1, cx < n - 1 ? cell + 1 : -1, cy > 0 ? cell - n : -1, cy < n - 1 ? cell + n : -1 };
+        int neighbours[4];
+        int count = 0;
+        for (int k = 0; k < 4; k++)
+        {
+            if (candidates[k] >= 0 && !visited[candidates[k]])
+            {
+                neighbours[count++] = candidates[k];
+            }
+        }
+        if (count == 0)
+        {
+            stack.pop_back();
+            continue;
+        }
+        int next = neighbours[generator() % count];
+        int low = std::min(cell, next);
+        open[low] |= (next - cell == 1 || cell - next == 1) ? 1 : 2;
+        visited[next] = 1;
+        stack.push_back(next);
+    }
+
+    level.shapes.clear();
+    float size = n * cellSize;
+    for (int cy = 0; cy < n; cy++)
+    {
+        for (int cx = 0; cx < n; cx++)
+        {
+            int cell = cy * n + cx;
+            float x = cx * cellSize;
+            float y = cy * cellSize;
+            // the outer walls are the world bounds, so only the inner walls become shapes
+            if (cx < n - 1 && !(open[cell] & 1))
+            {
+                level.shapes.push_back(box(x + cellSize - wall / 2, y - wall / 2, wall, cellSize + wall));
+            }
+            if (cy < n - 1 && !(open[cell] & 2))
+            {
+                level.shapes.push_back(box(x - wall / 2, y + cellSize - wall / 2, cellSize + wall, wall));
+            }
+        }
+    }
+    setWorld(level, size, size);
+}
+
+// ===== ===== =====
+// OBSTACLE FIELD
+// ===== ===== =====
+
+void generateObstacleField(Level& level, int segmentCount, unsigned seed)
+{
+    const float cellSize = 60.0f;
+    const float maxRadius = 22.0f;
+
+    // 3 to 8 sided polygons average 5.5 edges, one per cell of a jittered grid so they never overlap
+    int count = std::max(1, (int)(std::max(0, segmentCount) / 5.5f));
+    int n = std::max(1, (int)std::ceil(std::sqrt((float)count)));
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    level.shapes.clear();
+    std::vector<float> angles;
+    for (int i = 0; i < count; i++)
+    {
+        float radius = maxRadius * (0.4f + 0.6f * unit(generator));
+        float slack = cellSize / 2 - radius;
+        Vec2 center((i % n + 0.5f) * cellSize + slack * (2 * unit(generator) - 1), (i / n + 0.5f) * cellSize + slack * (2 * unit(generator) - 1));
+
+        // points on a circle at sorted angles are convex and already in winding order
+        int sides = 3 + (int)(generator() % 6);
+        angles.resize(sides);
+        for (int k = 0; k < sides; k++)
+        {
+            angles[k] = (k + 0.8f * unit(generator)) * 2 * pi / sides;
+        }
+        Polygon shape(sides);
+        for (int k = 0; k < sides; k++)
+        {
+            shape[k] = center + radius * Vec2(std::cos(angles[k]), std::sin(angles[k]));
+        }
+        level.shapes.push_back(shape);
+    }
+    float size = n * cellSize;
+    setWorld(level, size, size);
+}
+
+// ===== ===== =====
+// CITY BLOCKS
+// ===== ===== =====
+
+void generateCityBlocks(Level& level, int segmentCount, unsigned seed)
+{
+    const float street = 30.0f;
+    const float lot = 40.0f;
+    const float alley = 4.0f;
+    const int lotsPerSide = 3;
+
+    // every block holds lotsPerSide^2 rectangular buildings of 4 edges
+    int buildings = std::max(1, std::max(0, segmentCount) / 4);
+    int blocks = std::max(1, (int)std::ceil(std::sqrt(buildings / (float)(lotsPerSide * lotsPerSide))));
+    float blockSize = lotsPerSide * lot;
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    level.shapes.clear();
+    for (int by = 0; by < blocks; by++)
+    {
+        for (int bx = 0; bx < blocks; bx++)
+        {
+            float blockX = street + bx * (blockSize + street);
+            float blockY = street + by * (blockSize + street);
+            for (int ly = 0; ly < lotsPerSide; ly++)
+            {
+                for (int lx = 0; lx < lotsPerSide; lx++)
+                {
+                    // buildings fill most of their lot, set back a random bit from the alleys
+                    float insetX = alley + 6.0f * unit(generator);
+                    float insetY = alley + 6.0f * unit(generator);
+                    float width = lot - insetX - alley - 6.0f * unit(generator);
+                    float height = lot - insetY - alley - 6.0f * unit(generator);
+                    level.shapes.push_back(box(blockX + lx * lot + insetX, blockY + ly * lot + insetY, width, height));
+                }
+            }
+        }
+    }
+    float size = street + blocks * (blockSize + street);
+    setWorld(level, size, size);
+}
+
+void generateLevel(Level& level, LevelLayout layout, int segmentCount, unsigned seed)
+{
+    switch (layout)
+    {
+    case LevelLayout::Maze:
+        generateMaze(level, segmentCount, seed);
+        break;
+    case LevelLayout::ObstacleField:
+        generateObstacleField(level, segmentCount, seed);
+        break;
+    case LevelLayout::CityBlocks:
+        generateCityBlocks(level, segmentCount, seed);
+        break;
+    }
+}
+
+bool parseLevelLayout(const char* name, LevelLayout& layout)
+{
+    for (LevelLayout candidate : { LevelLayout::Maze, LevelLayout::ObstacleField, LevelLayout::CityBlocks })
+    {
+        if (std::strcmp(name, levelLayoutName(candidate)) == 0)
+        {
+            layout = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* levelLayoutName(LevelLayout layout)
+{
+    switch (layout)
+    {
+    case LevelLayout::Maze:
+        return "maze";
+    case LevelLayout::ObstacleField:
+        return "field";
+    case LevelLayout::CityBlocks:
+        return "city";
+    }
+    return "";
+}
+
+void randomFreePoints(const Level& level, int count, float clearance, unsigned seed, std::vector<Vec2>& points)
+{
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<float> unitX(level.boundsMin.x + clearance, level.boundsMax.x - clearance);
+    std::uniform_real_distribution<float> unitY(level.boundsMin.y + clearance, level.boundsMax.y - clearance);
+    const Vec2 offsets[5] = { Vec2(0, 0), Vec2(-clearance, 0), Vec2(clearance, 0), Vec2(0, -clearance), Vec2(0, clearance) };
+
+    points.clear();
+    // gives up after many misses, so a level with no room still returns
+    for (int attempt = 0; (int)points.size() < count && attempt < 100 * count + 1000; attempt++)
+    {
+        Vec2 point(unitX(generator), unitY(generator));
+        bool free = true;
+        for (int k = 0; free && k < 5; k++)
+        {
+            free = level.grid.findShapeContaining(level.segments, point + offsets[k]) < 0;
+        }
+        if (free)
+        {
+            points.push_back(point);
+        }
+    }
+}
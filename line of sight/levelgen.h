@@ -0,0 +1,29 @@
+#pragma once
+
+#include "level.h"
+
+// ===== ===== =====
+// PROCEDURAL LEVELS
+// ===== ===== =====
+// deterministic scenes for benchmarks and stress runs, the same seed always gives the same level
+// each one replaces the level's shapes and screen edges, sizes the world to land close to segmentCount edges
+// and calls rebuildSegments
+
+enum class LevelLayout
+{
+    Maze,           // perfect maze of thin wall slabs, long corridors with short sight lines
+    ObstacleField,  // random convex polygons scattered over open ground, long sight lines
+    CityBlocks      // rectangular buildings in blocks separated by streets, dense with narrow gaps
+};
+
+void generateMaze(Level& level, int segmentCount, unsigned seed = 1);
+void generateObstacleField(Level& level, int segmentCount, unsigned seed = 1);
+void generateCityBlocks(Level& level, int segmentCount, unsigned seed = 1);
+void generateLevel(Level& level, LevelLayout layout, int segmentCount, unsigned seed = 1);
+
+// parses "maze", "field" or "city", false for anything else
+bool parseLevelLayout(const char* name, LevelLayout& layout);
+const char* levelLayoutName(LevelLayout layout);
+
+// count points of the level's free space (outside every shape, at least clearance from the walls)
+void randomFreePoints(const Level& level, int count, float clearance, unsigned seed, std::vector<Vec2>& points);
@@ -0,0 +1,320 @@
+#include "logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    const uint64_t ringCapacity = 1 << 12;  // records buffered per thread, a power of two
+    const int writeIntervalMilliseconds = 20;
+
+    struct LogRecord
+    {
+        int64_t time;
+        const char* format;
+        LogLevel level;
+        uint8_t count;
+        LogArgument arguments[logMaxArguments];
+    };
+
+    // single producer (its thread) and single consumer (the writer thread)
+    struct LogRing
+    {
+        int threadIndex = 0;
+        std::vector<LogRecord> records = std::vector<LogRecord>(ringCapacity);
+        std::atomic<uint64_t> written{ 0 };
+        std::atomic<uint64_t> read{ 0 };
+        std::atomic<uint64_t> dropped{ 0 };
+        uint64_t reportedDropped = 0;   // writer thread only
+        bool exited = false;            // its thread is gone, the next new thread takes it over
+    };
+
+    struct Registry
+    {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<LogRing>> rings;
+
+        std::mutex writerMutex;
+        std::condition_variable wake;
+        bool stopping = false;
+        std::thread writer;
+        std::ofstream file;
+        std::ostream* output = nullptr;
+
+        // a program that never called stopLogging still gets its last records out
+        ~Registry() { stopLogging(); }
+    };
+
+    const std::chrono::steady_clock::time_point logEpoch = std::chrono::steady_clock::now();
+    thread_local LogRing* currentRing = nullptr;
+
+    Registry& registry()
+    {
+        static Registry instance;
+        return instance;
+    }
+
+    int64_t logNow()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - logEpoch).count();
+    }
+
+    // hands the ring over to the next thread once this one exits
+    struct RingOwner
+    {
+        ~RingOwner()
+        {
+            std::lock_guard<std::mutex> lock(registry().mutex);
+            currentRing->exited = true;
+        }
+    };
+    thread_local RingOwner ringOwner;
+
+    LogRing& threadRing()
+    {
+        if (currentRing == nullptr)
+        {
+            Registry& shared = registry();
+            std::lock_guard<std::mutex> lock(shared.mutex);
+            auto reusable = std::find_if(shared.rings.begin(), shared.rings.end(), [](const std::unique_ptr<LogRing>& ring) { return ring->exited; });
+            if (reusable != shared.rings.end())
+            {
+                currentRing = reusable->get();
+                currentRing->exited = false;
+            }
+            else
+            {
+                shared.rings.push_back(std::unique_ptr<LogRing>(new LogRing()));
+                currentRing = shared.rings.back().get();
+                currentRing->threadIndex = (int)shared.rings.size() - 1;
+            }
+            // first use constructs it, so its destructor runs when this thread exits
+            (void)&ringOwner;
+        }
+        return *currentRing;
+    }
+
+    void appendArgument(std::string& line, const LogArgument& argument)
+    {
+        char buffer[32];
+        switch (argument.type)
+        {
+        case LogArgument::Integer:
+            std::snprintf(buffer, sizeof(buffer), "%lld", (long long)argument.integer);
+            break;
+        case LogArgument::Unsigned:
+            std::snprintf(buffer, sizeof(buffer), "%llu", (unsigned long long)argument.unsignedInteger);
+            break;
+        case LogArgument::Real:
+            std::snprintf(buffer, sizeof(buffer), "%g", argument.real);
+            break;
+        case LogArgument::Text:
+            line += argument.text != nullptr ? argument.text : "(null)";
+            return;
+        }
+        line += buffer;
+    }
+
+    // "seconds level tthread message", placeholders past the last argument are kept as they are
+    void appendRecord(std::string& line, const LogRecord& record, int threadIndex)
+    {
+        char prefix[64];
+        std::snprintf(prefix, sizeof(prefix), "%.6f %s t%d ", record.time * 1e-9, logLevelName(record.level), threadIndex);
+        line += prefix;
+        int next = 0;
+        for (const char* c = record.format; *c != '\0'; c++)
+        {
+            if (c[0] == '{' && c[1] == '}' && next < record.count)
+            {
+                appendArgument(line, record.arguments[next++]);
+                c++;
+            }
+            else
+            {
+                line += *c;
+            }
+        }
+        line += '\n';
+    }
+
+    // moves everything the producers finished into the output, oldest first across threads
+    void drainRings(Registry& shared, std::vector<std::pair<int, LogRecord>>& batch, std::string& text)
+    {
+        batch.clear();
+        text.clear();
+        {
+            std::lock_guard<std::mutex> lock(shared.mutex);
+            for (size_t r = 0; r < shared.rings.size(); r++)
+            {
+                LogRing& ring = *shared.rings[r];
+                uint64_t first = ring.read.load(std::memory_order_relaxed);
+                uint64_t last = ring.written.load(std::memory_order_acquire);
+                for (uint64_t i = first; i < last; i++)
+                {
+                    batch.push_back({ ring.threadIndex, ring.records[i & (ringCapacity - 1)] });
+                }
+                ring.read.store(last, std::memory_order_release);
+
+                uint64_t dropped = ring.dropped.load(std::memory_order_relaxed);
+                if (dropped != ring.reportedDropped)
+                {
+                    LogRecord report = {};
+                    report.time = logNow();
+                    report.format = "dropped {} records, the ring was full";
+                    report.level = LogWarning;
+                    report.count = 1;
+                    report.arguments[0] = LogArgument(dropped - ring.reportedDropped);
+                    batch.push_back({ ring.threadIndex, report });
+                    ring.reportedDropped = dropped;
+                }
+            }
+        }
+        std::stable_sort(batch.begin(), batch.end(), [](const std::pair<int, LogRecord>& a, const std::pair<int, LogRecord>& b) { return a.second.time < b.second.time; });
+        for (size_t k = 0; k < batch.size(); k++)
+        {
+            appendRecord(text, batch[k].second, batch[k].first);
+        }
+        if (!text.empty())
+        {
+            shared.output->write(text.data(), text.size());
+            shared.output->flush();
+        }
+    }
+
+    void writerLoop()
+    {
+        Registry& shared = registry();
+        std::vector<std::pair<int, LogRecord>> batch;
+        std::string text;
+        std::unique_lock<std::mutex> lock(shared.writerMutex);
+        while (!shared.stopping)
+        {
+            shared.wake.wait_for(lock, std::chrono::milliseconds(writeIntervalMilliseconds));
+            lock.unlock();
+            drainRings(shared, batch, text);
+            lock.lock();
+        }
+        lock.unlock();
+        drainRings(shared, batch, text);
+    }
+}
+
+const char* logLevelName(LogLevel level)
+{
+    switch (level)
+    {
+    case LogTrace:
+        return "trace";
+    case LogDebug:
+        return "debug";
+    case LogInfo:
+        return "info";
+    case LogWarning:
+        return "warning";
+    case LogError:
+        return "error";
+    default:
+        return "off";
+    }
+}
+
+bool parseLogLevel(const char* name, LogLevel& level)
+{
+    for (int candidate = LogTrace; candidate <= LogOff; candidate++)
+    {
+        if (std::strcmp(name, logLevelName((LogLevel)candidate)) == 0)
+        {
+            level = (LogLevel)candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void logPush(LogLevel level, const char* format, const LogArgument* arguments, int count)
+{
+    LogRing& ring = threadRing();
+    uint64_t index = ring.written.load(std::memory_order_relaxed);
+    if (index - ring.read.load(std::memory_order_acquire) >= ringCapacity)
+    {
+        ring.dropped.store(ring.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+    LogRecord& record = ring.records[index & (ringCapacity - 1)];
+    record.time = logNow();
+    record.format = format;
+    record.level = level;
+    record.count = (uint8_t)count;
+    for (int i = 0; i < count; i++)
+    {
+        record.arguments[i] = arguments[i];
+    }
+    ring.written.store(index + 1, std::memory_order_release);
+}
+
+bool LogRateLimit::allow()
+{
+    int64_t now = logNow();
+    int64_t start = windowStart.load(std::memory_order_relaxed);
+    if (now - start >= 1000000000 && windowStart.compare_exchange_strong(start, now, std::memory_order_relaxed))
+    {
+        count.store(0, std::memory_order_relaxed);
+    }
+    return count.fetch_add(1, std::memory_order_relaxed) < perSecond;
+}
+
+bool startLogging(const char* path, LogLevel threshold)
+{
+    stopLogging();
+
+    Registry& shared = registry();
+    if (path != nullptr)
+    {
+        shared.file.open(path, std::ios::app);
+        if (!shared.file)
+        {
+            shared.file.clear();
+            return false;
+        }
+        shared.output = &shared.file;
+    }
+    else
+    {
+        shared.output = &std::cerr;
+    }
+    shared.stopping = false;
+    shared.writer = std::thread(writerLoop);
+    logThreshold.store(threshold, std::memory_order_relaxed);
+    return true;
+}
+
+void stopLogging()
+{
+    Registry& shared = registry();
+    if (!shared.writer.joinable())
+    {
+        return;
+    }
+    logThreshold.store(LogOff, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(shared.writerMutex);
+        shared.stopping = true;
+    }
+    shared.wake.notify_one();
+    shared.writer.join();
+    if (shared.file.is_open())
+    {
+        shared.file.close();
+    }
+    shared.output = nullptr;
+}
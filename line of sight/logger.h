@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// ===== ===== =====
+// LOGGER
+// ===== ===== =====
+// LOS_LOG(level, "enemy {} at {} {}", i, x, y) copies the format pointer and the raw arguments into the calling
+// thread's own ring buffer, a background thread formats and writes them, so the hot path never locks, formats or
+// touches the console; a level below the threshold costs one relaxed load and a compare
+// formats and text arguments are kept by pointer until written: string literals, or strings that live as long (argv)
+// a full ring drops the record and counts it, the writer reports the count
+
+enum LogLevel : uint8_t
+{
+    LogTrace,
+    LogDebug,
+    LogInfo,
+    LogWarning,
+    LogError,
+    LogOff
+};
+
+const char* logLevelName(LogLevel level);
+// parses "trace", "debug", "info", "warning", "error" or "off", false for anything else
+bool parseLogLevel(const char* name, LogLevel& level);
+
+// records below it are dropped at the call site, LogOff until startLogging
+inline std::atomic<uint8_t> logThreshold{ LogOff };
+
+inline bool logEnabled(LogLevel level)
+{
+    return level >= logThreshold.load(std::memory_order_relaxed);
+}
+
+// one {} placeholder of the format
+struct LogArgument
+{
+    enum Type : uint8_t
+    {
+        Integer,
+        Unsigned,
+        Real,
+        Text
+    };
+
+    Type type = Integer;
+    union
+    {
+        int64_t integer;
+        uint64_t unsignedInteger;
+        double real;
+        const char* text;
+    };
+
+    LogArgument() : integer(0) {}
+    LogArgument(bool value) : type(Integer), integer(value ? 1 : 0) {}
+    LogArgument(int value) : type(Integer), integer(value) {}
+    LogArgument(long value) : type(Integer), integer(value) {}
+    LogArgument(long long value) : type(Integer), integer(value) {}
+    LogArgument(unsigned value) : type(Unsigned), unsignedInteger(value) {}
+    LogArgument(unsigned long value) : type(Unsigned), unsignedInteger(value) {}
+    LogArgument(unsigned long long value) : type(Unsigned), unsignedInteger(value) {}
+    LogArgument(float value) : type(Real), real(value) {}
+    LogArgument(double value) : type(Real), real(value) {}
+    LogArgument(const char* value) : type(Text), text(value) {}
+};
+
+const int logMaxArguments = 6;
+
+void logPush(LogLevel level, const char* format, const LogArgument* arguments, int count);
+
+template <typename... Args>
+void logWrite(LogLevel level, const char* format, const Args&... args)
+{
+    static_assert(sizeof...(Args) <= logMaxArguments, "too many log arguments");
+    const LogArgument arguments[sizeof...(Args) + 1] = { LogArgument(args)... };
+    logPush(level, format, arguments, (int)sizeof...(Args));
+}
+
+// at most perSecond records a second from one call site, over all threads
+class LogRateLimit
+{
+public:
+    explicit LogRateLimit(int perSecond) : perSecond(perSecond) {}
+
+    bool allow();
+
+private:
+    int perSecond;
+    std::atomic<int64_t> windowStart{ 0 };
+    std::atomic<int> count{ 0 };
+};
+
+// starts the writer thread and sets the threshold, records go to path (appended) or to stderr when path is null
+// returns false if the file can't be opened, logging stays off then
+bool startLogging(const char* path, LogLevel threshold);
+// turns logging off, writes everything still in the rings and joins the writer thread
+void stopLogging();
+
+#define LOS_LOG(level, ...) \
+    do \
+    { \
+        if (logEnabled(level)) \
+        { \
+            logWrite(level, __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define LOS_LOG_RATE(level, perSecond, ...) \
+    do \
+    { \
+        static LogRateLimit logRateLimit(perSecond); \
+        if (logEnabled(level) && logRateLimit.allow()) \
+        { \
+            logWrite(level, __VA_ARGS__); \
+        } \
+    } while (0)
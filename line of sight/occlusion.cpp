@@ -0,0 +1,172 @@
+#include "occlusion.h"
+#include "framearena.h"
+#include "profiler.h"
+#include "threadpool.h"
+
+#include <algorithm>
+
+bool hasLineOfSight(const Level& level, Vec2 from, Vec2 to)
+{
+    Vec2 ray = to - from;
+    if (ray.x == 0.0f && ray.y == 0.0f)
+    {
+        return true;
+    }
+    // ray parameter 1 lands on the target, so anything hit before it is in the way
+    // the grid walk only visits the cells between the two agents, the BVH has to descend from the root for every pair
+    if (!level.grid.isEmpty())
+    {
+        return !level.grid.anyHit(from, ray, 1.0f);
+    }
+    if (!level.bvh.isEmpty())
+    {
+        return !level.bvh.anyHit(level.segments, from, ray, 1.0f);
+    }
+    const SegmentStore& segments = level.segments;
+    for (int i = 0; i < segments.size(); i++)
+    {
+        float t;
+        if (segments.intersect(i, from, ray, t) && t < 1.0f)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+namespace
+{
+    // filter constants shared by every pair of a batch
+    struct SightTest
+    {
+        float maxRange2;
+        float coneCosine;
+        bool useRange;
+        bool useCone;
+
+        explicit SightTest(const SightFilter& filter)
+        {
+            useRange = filter.maxRange > 0.0f;
+            maxRange2 = filter.maxRange * filter.maxRange;
+            useCone = filter.facing != nullptr && filter.coneHalfAngle < pi;
+            coneCosine = std::cos(filter.coneHalfAngle);
+        }
+
+        bool inRange(Vec2 delta) const
+        {
+            return !useRange || dot(delta, delta) <= maxRange2;
+        }
+
+        // angle between facing and delta within the half angle, compared without normalizing either
+        bool inCone(Vec2 facing, Vec2 delta) const
+        {
+            if (!useCone)
+            {
+                return true;
+            }
+            float along = dot(facing, delta);
+            float limit = coneCosine * std::sqrt(dot(facing, facing) * dot(delta, delta));
+            return along >= limit;
+        }
+    };
+}
+
+void computeLineOfSightBatch(const Level& level, const std::vector<Vec2>& agents, const std::vector<SightPair>& pairs, std::vector<uint64_t>& visible, const SightFilter& filter, ThreadPool* pool)
+{
+    LOS_PROFILE_ZONE("computeLineOfSightBatch");
+    if (pool == nullptr)
+    {
+        pool = &ThreadPool::shared();
+    }
+    int pairCount = (int)pairs.size();
+    int wordCount = rowWords(pairCount);
+    visible.assign(wordCount, 0);
+
+    SightTest test(filter);
+    pool->parallelFor(wordCount, std::max(1, wordCount / (8 * pool->size())), [&](int begin, int end, int)
+    {
+        for (int word = begin; word < end; word++)
+        {
+            uint64_t bits = 0;
+            int last = std::min(pairCount, (word + 1) * 64);
+            for (int i = word * 64; i < last; i++)
+            {
+                Vec2 from = agents[pairs[i].from];
+                Vec2 to = agents[pairs[i].to];
+                Vec2 delta = to - from;
+                if (test.inRange(delta) && (!test.useCone || test.inCone((*filter.facing)[pairs[i].from], delta)) && hasLineOfSight(level, from, to))
+                {
+                    bits |= uint64_t(1) << (i % 64);
+                }
+            }
+            visible[word] = bits;
+        }
+    });
+}
+
+void computeLineOfSightMatrix(const Level& level, const std::vector<Vec2>& agents, std::vector<uint64_t>& visible, const SightFilter& filter, ThreadPool* pool)
+{
+    LOS_PROFILE_ZONE("computeLineOfSightMatrix");
+    if (pool == nullptr)
+    {
+        pool = &ThreadPool::shared();
+    }
+    int agentCount = (int)agents.size();
+    int words = rowWords(agentCount);
+    visible.assign((size_t)agentCount * words, 0);
+
+    // rows get shorter towards the end of the upper triangle, small chunks let stealing even them out
+    SightTest test(filter);
+    int grain = std::max(1, agentCount / (16 * pool->size()));
+
+    // upper triangle: range and walls, traced when either side could see the other, every row only writes its own words
+    pool->parallelFor(agentCount, grain, [&](int begin, int end, int)
+    {
+        for (int a = begin; a < end; a++)
+        {
+            uint64_t* row = visible.data() + (size_t)a * words;
+            for (int b = a + 1; b < agentCount; b++)
+            {
+                Vec2 delta = agents[b] - agents[a];
+                bool eitherCone = !test.useCone || test.inCone((*filter.facing)[a], delta) || test.inCone((*filter.facing)[b], -delta);
+                if (test.inRange(delta) && eitherCone && hasLineOfSight(level, agents[a], agents[b]))
+                {
+                    row[b / 64] |= uint64_t(1) << (b % 64);
+                }
+            }
+        }
+    });
+
+    // lower triangle mirrored from a copy of the upper one (rows share words near the diagonal),
+    // then the observer's cone on the whole row; the copy is frame scratch
+    FrameArenaScope arenaScope(threadFrameArena());
+    uint64_t* upper = (uint64_t*)threadFrameArena().allocate(visible.size() * sizeof(uint64_t), alignof(uint64_t));
+    std::copy(visible.begin(), visible.end(), upper);
+    pool->parallelFor(agentCount, grain, [&](int begin, int end, int)
+    {
+        for (int a = begin; a < end; a++)
+        {
+            uint64_t* row = visible.data() + (size_t)a * words;
+            for (int b = 0; b < a; b++)
+            {
+                size_t mirrored = (size_t)b * words * 64 + a;
+                if ((upper[mirrored / 64] >> (mirrored % 64)) & 1)
+                {
+                    row[b / 64] |= uint64_t(1) << (b % 64);
+                }
+            }
+            if (!test.useCone)
+            {
+                continue;
+            }
+            Vec2 facing = (*filter.facing)[a];
+            for (int b = 0; b < agentCount; b++)
+            {
+                if (((row[b / 64] >> (b % 64)) & 1) && !test.inCone(facing, agents[b] - agents[a]))
+                {
+                    row[b / 64] &= ~(uint64_t(1) << (b % 64));
+                }
+            }
+        }
+    });
+}
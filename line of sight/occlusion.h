@@ -0,0 +1,43 @@
+#pragma once
+
+#include "level.h"
+
+#include <cstdint>
+
+class ThreadPool;
+
+// ===== ===== =====
+// LINE OF SIGHT BETWEEN AGENTS
+// ===== ===== =====
+// answers "can agent a see agent b" as an any-hit test of the segment a -> b against the level edges,
+// walking the grid cells between the two and stopping at the first wall, no visibility polygon is built
+
+// one directed query, from looks at to
+struct SightPair
+{
+    int from;
+    int to;
+};
+
+// cheap rejections applied before the wall test, a pair failing any of them is reported as not visible
+struct SightFilter
+{
+    float maxRange = 0.0f;                      // <= 0 means unlimited
+    float coneHalfAngle = pi;                   // field of view half angle around facing, >= pi sees all around
+    const std::vector<Vec2>* facing = nullptr;  // view direction of every agent, the cone is skipped while null
+};
+
+// bit i of visible (word i / 64, bit i % 64) is set when pairs[i] has a clear line of sight
+// pairs are split in runs of whole words over pool (ThreadPool::shared() when null), so workers never share a word
+void computeLineOfSightBatch(const Level& level, const std::vector<Vec2>& agents, const std::vector<SightPair>& pairs, std::vector<uint64_t>& visible, const SightFilter& filter = SightFilter(), ThreadPool* pool = nullptr);
+
+// every ordered pair of agents without listing them: row a holds rowWords(agents.size()) words, bit b set when a sees b
+// the wall test is symmetric, so each unordered pair is traced once and the cone is applied per row afterwards
+void computeLineOfSightMatrix(const Level& level, const std::vector<Vec2>& agents, std::vector<uint64_t>& visible, const SightFilter& filter = SightFilter(), ThreadPool* pool = nullptr);
+
+inline int rowWords(int agentCount) { return (agentCount + 63) / 64; }
+
+inline bool isBitSet(const std::vector<uint64_t>& bits, size_t i) { return (bits[i / 64] >> (i % 64)) & 1; }
+
+// single segment test the batches run, true when no edge lies between from and to
+bool hasLineOfSight(const Level& level, Vec2 from, Vec2 to);
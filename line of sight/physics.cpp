@@ -0,0 +1,165 @@
+#include "physics.h"
+
+#include <algorithm>
+#include <cfloat>
+
+// zeroes the velocity along every axis that would take the actor into a wall, true if there was one
+static bool stopAtWalls(const Level& level, Entity& actor, float radius)
+{
+    bool collisionDetected{ false };
+
+    const SegmentStore& segments = level.segments;
+    const SegmentGrid& grid = level.grid;
+
+    // left
+    if (grid.findShapeContaining(segments, (actor.position + Vec2({ -radius, 0.0f }))) >= 0)
+    {
+        collisionDetected = true;
+        actor.acceleration.x = 0.0f;
+        actor.velocity.x = 0.0f;
+    }
+    // right
+    if (grid.findShapeContaining(segments, (actor.position + Vec2({ radius, 0.0f }))) >= 0)
+    {
+        collisionDetected = true;
+        actor.acceleration.x = 0.0f;
+        actor.velocity.x = 0.0f;
+    }
+    // up
+    if (grid.findShapeContaining(segments, (actor.position + Vec2({ 0.0f, -radius }))) >= 0)
+    {
+        collisionDetected = true;
+        actor.acceleration.y = 0.0f;
+        actor.velocity.y = 0.0f;
+    }
+    // down
+    if (grid.findShapeContaining(segments, (actor.position + Vec2({ 0.0f, radius }))) >= 0)
+    {
+        collisionDetected = true;
+        actor.acceleration.y = 0.0f;
+        actor.velocity.y = 0.0f;
+    }
+
+    return collisionDetected;
+}
+
+static void pushOutOfEdge(Entity& actor, const Segment& collisionEdge, float radius)
+{
+    Vec2 edge = collisionEdge.endPoint - collisionEdge.startPoint;
+    Vec2 normalVector = { edge.y, -edge.x };
+    normalVector = normalize(normalVector);
+    if (dot(normalVector, actor.velocity) > 0)
+    {
+        normalVector = -normalVector;
+    }
+    Vec2 segmentRotated = { edge.y, -edge.x };
+    if (rayInstersectsSegment(actor.position, -normalize(segmentRotated), collisionEdge.startPoint, collisionEdge.endPoint))
+    {
+        Vec2 projection = raySegmentIntersectionPoint(actor.position, -normalize(segmentRotated), collisionEdge.startPoint, collisionEdge.endPoint);
+        Vec2 newPosition = collisionEdge.startPoint + norm(actor.position - collisionEdge.startPoint) * (dot(projection - collisionEdge.startPoint, actor.position - collisionEdge.startPoint) / (norm(projection - collisionEdge.startPoint) * norm(actor.position - collisionEdge.startPoint))) * normalize(edge) + 1.05f * radius * normalVector;
+        actor.position = newPosition;
+    }
+}
+
+void resolveActorCollision(const Level& level, Entity& actor, const Segment& collisionEdge, float radius)
+{
+    if (stopAtWalls(level, actor, radius))
+    {
+        pushOutOfEdge(actor, collisionEdge, radius);
+    }
+}
+
+void resolveActorCollision(const Level& level, Entity& actor, float radius)
+{
+    if (!stopAtWalls(level, actor, radius))
+    {
+        return;
+    }
+
+    // the wall is within radius of the actor, so are the edges of the grid cells around it
+    const SegmentStore& segments = level.segments;
+    const SegmentGrid& grid = level.grid;
+    int nearestEdge = -1;
+    float nearestDistance{ FLT_MAX };
+    auto consider = [&](int i)
+    {
+        Vec2 start(segments.x0[i], segments.y0[i]);
+        Vec2 edge(segments.dx[i], segments.dy[i]);
+        float length2 = dot(edge, edge);
+        float t = length2 > 0.0f ? std::clamp(dot(actor.position - start, edge) / length2, 0.0f, 1.0f) : 0.0f;
+        float distance = norm(actor.position - (start + t * edge));
+        if (distance < nearestDistance)
+        {
+            nearestDistance = distance;
+            nearestEdge = i;
+        }
+    };
+    if (!grid.isEmpty())
+    {
+        float reach = 2.0f * radius;
+        for (int cy = grid.cellY(actor.position.y - reach); cy <= grid.cellY(actor.position.y + reach); cy++)
+        {
+            for (int cx = grid.cellX(actor.position.x - reach); cx <= grid.cellX(actor.position.x + reach); cx++)
+            {
+                int cell = cy * grid.columns + cx;
+                for (int k = grid.cellStart[cell]; k < grid.cellStart[cell + 1]; k++)
+                {
+                    consider(grid.cellSegments[k]);
+                }
+            }
+        }
+    }
+    if (nearestEdge < 0)
+    {
+        for (int i = 0; i < segments.size(); i++)
+        {
+            consider(i);
+        }
+    }
+    if (nearestEdge >= 0)
+    {
+        pushOutOfEdge(actor, segments.getSegment(nearestEdge), radius);
+    }
+}
+
+int bounceOffWalls(const Level& level, Vec2 position, Vec2& velocity, Vec2& acceleration, float dt, float radius)
+{
+    if (position.x < level.boundsMin.x || position.x > level.boundsMax.x) velocity.x = -velocity.x;
+    if (position.y < level.boundsMin.y || position.y > level.boundsMax.y) velocity.y = -velocity.y;
+
+    // a mover at rest has no direction to probe along
+    if (velocity.x == 0.0f && velocity.y == 0.0f)
+    {
+        return -1;
+    }
+
+    const SegmentStore& segments = level.segments;
+    int wall = level.grid.findShapeContaining(segments, position + normalize(velocity) * radius + velocity * dt + acceleration * dt);
+    if (wall < 0)
+    {
+        return -1;
+    }
+
+    // nearest edge of the wall, distance from the mover to the edge's supporting line
+    int nearestEdge = segments.shapeStart[wall];
+    float nearestCollision{ FLT_MAX };
+    for (int j = segments.shapeStart[wall]; j < segments.shapeStart[wall + 1]; j++)
+    {
+        float distance = std::abs(segments.nx[j] * (segments.x0[j] - position.x) + segments.ny[j] * (segments.y0[j] - position.y));
+        if (distance < nearestCollision)
+        {
+            nearestCollision = distance;
+            nearestEdge = j;
+        }
+    }
+
+    acceleration = { 0, 0 };
+    Vec2 normalVector = { segments.nx[nearestEdge], segments.ny[nearestEdge] };
+    if (dot(normalVector, velocity) < 0)
+    {
+        normalVector = -normalVector;
+    }
+    velocity = velocity - 2 * dot(normalVector, velocity) * normalVector;
+
+    return nearestEdge;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "entity.h"
+#include "level.h"
+
+// stops the actor at walls and pushes it back out along the normal of collisionEdge
+void resolveActorCollision(const Level& level, Entity& actor, const Segment& collisionEdge, float radius = 10.0f);
+// same, but looks the wall edge up itself, for actors whose visibility doesn't see all around them (vision cones)
+void resolveActorCollision(const Level& level, Entity& actor, float radius = 10.0f);
+
+// reflects velocity off the first wall a mover of the given radius at position is about to enter (and off level.boundsMin / boundsMax)
+// returns the index into level.segments of the wall edge it bounced off, -1 if it didn't hit a wall
+// takes loose values so both Entity and the arrays of EntityStore can use it, allocates nothing
+int bounceOffWalls(const Level& level, Vec2 position, Vec2& velocity, Vec2& acceleration, float dt, float radius);
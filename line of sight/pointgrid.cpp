@@ -0,0 +1,99 @@
+#include "pointgrid.h"
+
+#include <algorithm>
+#include <cmath>
+
+void PointGrid::build(const float* x, const float* y, int count, float requestedCellSize)
+{
+    columns = 0;
+    rows = 0;
+    if (count == 0)
+    {
+        return;
+    }
+
+    float minX = x[0], minY = y[0], maxX = x[0], maxY = y[0];
+    for (int i = 1; i < count; i++)
+    {
+        minX = std::min(minX, x[i]);
+        minY = std::min(minY, y[i]);
+        maxX = std::max(maxX, x[i]);
+        maxY = std::max(maxY, y[i]);
+    }
+
+    // a few stray points far away must not blow up the cell count
+    cellSize = requestedCellSize;
+    double maxCells = 4.0 * count + 64.0;
+    while (((maxX - minX) / cellSize + 1.0) * ((maxY - minY) / cellSize + 1.0) > maxCells)
+    {
+        cellSize *= 2.0f;
+    }
+    inverseCellSize = 1.0f / cellSize;
+    originX = minX;
+    originY = minY;
+    columns = (int)((maxX - minX) * inverseCellSize) + 1;
+    rows = (int)((maxY - minY) * inverseCellSize) + 1;
+    int cellCount = columns * rows;
+
+    pointCells.resize(count);
+    cellStart.assign(cellCount + 1, 0);
+    for (int i = 0; i < count; i++)
+    {
+        pointCells[i] = cellY(y[i]) * columns + cellX(x[i]);
+        cellStart[pointCells[i] + 1]++;
+    }
+    for (int c = 0; c < cellCount; c++)
+    {
+        cellStart[c + 1] += cellStart[c];
+    }
+
+    // scatter, cellStart[c] walks forward and ends at the start of c + 1, shift it back afterwards
+    entries.resize(count);
+    for (int i = 0; i < count; i++)
+    {
+        entries[cellStart[pointCells[i]]++] = i;
+    }
+    for (int c = cellCount; c > 0; c--)
+    {
+        cellStart[c] = cellStart[c - 1];
+    }
+    cellStart[0] = 0;
+
+    entryX.resize(count);
+    entryY.resize(count);
+    for (int k = 0; k < count; k++)
+    {
+        entryX[k] = x[entries[k]];
+        entryY[k] = y[entries[k]];
+    }
+}
+
+int PointGrid::cellX(float x) const
+{
+    return std::min(columns - 1, std::max(0, (int)((x - originX) * inverseCellSize)));
+}
+
+int PointGrid::cellY(float y) const
+{
+    return std::min(rows - 1, std::max(0, (int)((y - originY) * inverseCellSize)));
+}
+
+int PointGrid::neighbourRanges(float x, float y, int begins[3], int ends[3]) const
+{
+    if (isEmpty())
+    {
+        return 0;
+    }
+    int centerX = cellX(x);
+    int centerY = cellY(y);
+    int firstColumn = std::max(0, centerX - 1);
+    int lastColumn = std::min(columns - 1, centerX + 1);
+    int found = 0;
+    for (int row = std::max(0, centerY - 1); row <= std::min(rows - 1, centerY + 1); row++)
+    {
+        begins[found] = cellStart[row * columns + firstColumn];
+        ends[found] = cellStart[row * columns + lastColumn + 1];
+        found++;
+    }
+    return found;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+
+// uniform grid over moving points, fitted to their bounds and rebuilt from scratch every tick with a counting sort
+// cells are row major and the points are stored in cell order, so the 3 x 3 neighbourhood of a point is three
+// contiguous runs of entries instead of nine scattered lookups
+struct PointGrid
+{
+    float originX = 0.0f;
+    float originY = 0.0f;
+    float cellSize = 1.0f;
+    float inverseCellSize = 1.0f;
+    int columns = 0;
+    int rows = 0;
+
+    // compressed cell lists, cell c owns [cellStart[c], cellStart[c + 1]) of entries (point indices)
+    std::vector<int> cellStart;
+    std::vector<int> entries;
+    std::vector<float> entryX, entryY;  // point positions in entries order
+    std::vector<int> pointCells;        // cell of every point, kept from the build
+
+    // cellSize is a lower bound, it grows when the points are spread so thin that the grid would outnumber them
+    void build(const float* x, const float* y, int count, float cellSize);
+
+    bool isEmpty() const { return columns == 0 || rows == 0; }
+
+    int cellX(float x) const;
+    int cellY(float y) const;
+
+    // entry ranges [begins[r], ends[r]) covering the 3 x 3 cells around (x, y), returns how many rows were written (at most 3)
+    // with a cell size of at least the interaction distance every neighbour within it is in one of them
+    int neighbourRanges(float x, float y, int begins[3], int ends[3]) const;
+};
@@ -0,0 +1,256 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+
+namespace
+{
+    const uint64_t ringCapacity = 1 << 15;     // zones kept per thread, a power of two
+    const size_t frameSampleCapacity = 4096;   // frames of counter samples kept for the trace
+
+    struct ZoneRecord
+    {
+        const char* name;
+        int64_t start;
+        int64_t end;
+    };
+
+    // written only by its own thread, read by the main thread between frames
+    struct ThreadRing
+    {
+        int threadIndex = 0;
+        std::vector<ZoneRecord> records = std::vector<ZoneRecord>(ringCapacity);
+        std::atomic<uint64_t> written{ 0 };
+        const std::atomic<uint64_t>* counters = nullptr;   // the thread's profileThreadCounters, null once it exited
+        uint64_t exitedCounters[ProfileCounterCount] = {};  // their last values after that
+    };
+
+    struct FrameSample
+    {
+        int64_t time;
+        uint64_t counters[ProfileCounterCount];
+    };
+
+    struct Registry
+    {
+        std::mutex mutex;
+        // rings outlive their threads, so a trace still shows work done by threads that already exited
+        std::vector<std::unique_ptr<ThreadRing>> threads;
+        int64_t frameStart = 0;
+        uint64_t counterTotals[ProfileCounterCount] = {};
+        std::vector<FrameSample> samples;
+        size_t nextSample = 0;
+    };
+
+    const std::chrono::steady_clock::time_point profileEpoch = std::chrono::steady_clock::now();
+    thread_local ThreadRing* currentRing = nullptr;
+
+    Registry& registry()
+    {
+        static Registry instance;
+        return instance;
+    }
+
+    // keeps the counters of a thread that exits, its profileThreadCounters go away with it
+    struct RingOwner
+    {
+        ~RingOwner()
+        {
+            Registry& shared = registry();
+            std::lock_guard<std::mutex> lock(shared.mutex);
+            for (int c = 0; c < ProfileCounterCount; c++)
+            {
+                currentRing->exitedCounters[c] = profileThreadCounters[c].load(std::memory_order_relaxed);
+            }
+            currentRing->counters = nullptr;
+        }
+    };
+    thread_local RingOwner ringOwner;
+
+    ThreadRing& threadRing()
+    {
+        if (currentRing == nullptr)
+        {
+            Registry& shared = registry();
+            std::lock_guard<std::mutex> lock(shared.mutex);
+            shared.threads.push_back(std::unique_ptr<ThreadRing>(new ThreadRing()));
+            currentRing = shared.threads.back().get();
+            currentRing->threadIndex = (int)shared.threads.size() - 1;
+            currentRing->counters = profileThreadCounters;
+            // first use constructs it, so its destructor runs when this thread exits
+            (void)&ringOwner;
+        }
+        return *currentRing;
+    }
+
+    // the records still in the ring, oldest first
+    void recentRecords(const ThreadRing& ring, uint64_t& first, uint64_t& last)
+    {
+        last = ring.written.load(std::memory_order_acquire);
+        first = last > ringCapacity ? last - ringCapacity : 0;
+    }
+}
+
+const char* profileCounterName(ProfileCounter counter)
+{
+    switch (counter)
+    {
+    case CounterRaysCast:
+        return "rays cast";
+    case CounterSegmentsTested:
+        return "segments tested";
+    case CounterPolygonsBuilt:
+        return "polygons built";
+    default:
+        return "";
+    }
+}
+
+int64_t profileNow()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - profileEpoch).count();
+}
+
+void profileRecordZone(const char* name, int64_t start, int64_t end)
+{
+    ThreadRing& ring = threadRing();
+    uint64_t index = ring.written.load(std::memory_order_relaxed);
+    ring.records[index & (ringCapacity - 1)] = { name, start, end };
+    ring.written.store(index + 1, std::memory_order_release);
+}
+
+void profileEndFrame(ProfileFrameSummary& summary)
+{
+    Registry& shared = registry();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    int64_t now = profileNow();
+
+    summary.frameMilliseconds = (now - shared.frameStart) * 1e-6;
+    summary.zones.clear();
+    uint64_t totals[ProfileCounterCount] = {};
+    for (size_t t = 0; t < shared.threads.size(); t++)
+    {
+        const ThreadRing& ring = *shared.threads[t];
+        uint64_t first, last;
+        recentRecords(ring, first, last);
+        // zones are recorded as they close, so walking back from the newest stops at the first one closed before the frame
+        for (uint64_t i = last; i > first; i--)
+        {
+            const ZoneRecord& record = ring.records[(i - 1) & (ringCapacity - 1)];
+            if (record.end < shared.frameStart)
+            {
+                break;
+            }
+            auto zone = std::find_if(summary.zones.begin(), summary.zones.end(), [&](const ProfileFrameSummary::Zone& z) { return z.name == record.name; });
+            if (zone == summary.zones.end())
+            {
+                summary.zones.push_back({ record.name, 0.0, 0 });
+                zone = summary.zones.end() - 1;
+            }
+            zone->milliseconds += (record.end - record.start) * 1e-6;
+            zone->calls++;
+        }
+        for (int c = 0; c < ProfileCounterCount; c++)
+        {
+            totals[c] += ring.counters != nullptr ? ring.counters[c].load(std::memory_order_relaxed) : ring.exitedCounters[c];
+        }
+    }
+    std::sort(summary.zones.begin(), summary.zones.end(), [](const ProfileFrameSummary::Zone& a, const ProfileFrameSummary::Zone& b) { return a.milliseconds > b.milliseconds; });
+
+    FrameSample sample;
+    sample.time = now;
+    for (int c = 0; c < ProfileCounterCount; c++)
+    {
+        summary.counters[c] = totals[c] - shared.counterTotals[c];
+        sample.counters[c] = summary.counters[c];
+        shared.counterTotals[c] = totals[c];
+    }
+    if (shared.samples.size() < frameSampleCapacity)
+    {
+        shared.samples.push_back(sample);
+    }
+    else
+    {
+        shared.samples[shared.nextSample] = sample;
+    }
+    shared.nextSample = (shared.nextSample + 1) % frameSampleCapacity;
+    shared.frameStart = now;
+}
+
+std::string ProfileFrameSummary::text() const
+{
+    std::ostringstream out;
+    out.setf(std::ios::fixed);
+    out.precision(2);
+    out << "frame " << frameMilliseconds << " ms\n";
+    for (size_t i = 0; i < zones.size(); i++)
+    {
+        out << zones[i].name << " " << zones[i].milliseconds << " ms";
+        if (zones[i].calls > 1)
+        {
+            out << " (" << zones[i].calls << "x)";
+        }
+        out << "\n";
+    }
+    for (int c = 0; c < ProfileCounterCount; c++)
+    {
+        out << profileCounterName((ProfileCounter)c) << " " << counters[c] << "\n";
+    }
+    return out.str();
+}
+
+bool writeChromeTrace(const char* path)
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        return false;
+    }
+
+    Registry& shared = registry();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    file.setf(std::ios::fixed);
+    file.precision(3);
+
+    // timestamps and durations are in microseconds
+    file << "{\"traceEvents\":[\n";
+    bool first = true;
+    for (size_t t = 0; t < shared.threads.size(); t++)
+    {
+        const ThreadRing& ring = *shared.threads[t];
+        file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << ring.threadIndex
+            << ",\"args\":{\"name\":\"thread " << ring.threadIndex << "\"}}";
+        first = false;
+
+        uint64_t begin, end;
+        recentRecords(ring, begin, end);
+        for (uint64_t i = begin; i < end; i++)
+        {
+            const ZoneRecord& record = ring.records[i & (ringCapacity - 1)];
+            file << ",\n{\"name\":\"" << record.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << ring.threadIndex
+                << ",\"ts\":" << record.start * 1e-3 << ",\"dur\":" << (record.end - record.start) * 1e-3 << "}";
+        }
+    }
+
+    // oldest sample first once the sample ring has wrapped
+    size_t sampleCount = shared.samples.size();
+    size_t oldest = sampleCount < frameSampleCapacity ? 0 : shared.nextSample;
+    for (size_t k = 0; k < sampleCount; k++)
+    {
+        const FrameSample& sample = shared.samples[(oldest + k) % sampleCount];
+        file << (first ? "" : ",\n") << "{\"name\":\"counters\",\"ph\":\"C\",\"pid\":1,\"ts\":" << sample.time * 1e-3 << ",\"args\":{";
+        first = false;
+        for (int c = 0; c < ProfileCounterCount; c++)
+        {
+            file << (c > 0 ? "," : "") << "\"" << profileCounterName((ProfileCounter)c) << "\":" << sample.counters[c];
+        }
+        file << "}}";
+    }
+    file << "\n]}\n";
+    return (bool)file;
+}
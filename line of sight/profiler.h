@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// ===== ===== =====
+// PROFILER
+// ===== ===== =====
+// LOS_PROFILE_ZONE("name") times the rest of the enclosing scope, LOS_PROFILE_COUNT(counter, n) adds n to a counter
+// every thread records into its own ring of recent zones and its own counters, so recording never locks or shares
+// a cache line; the main thread folds them into a per frame summary and exports Chrome trace_event JSON
+// both macros compile to nothing unless LOS_PROFILE is 1, which is the default only in builds without NDEBUG
+// zone names must be string literals (they are kept by pointer and written to JSON unescaped)
+
+#ifndef LOS_PROFILE
+#ifdef NDEBUG
+#define LOS_PROFILE 0
+#else
+#define LOS_PROFILE 1
+#endif
+#endif
+
+enum ProfileCounter
+{
+    CounterRaysCast,
+    CounterSegmentsTested,
+    CounterPolygonsBuilt,
+    ProfileCounterCount
+};
+
+const char* profileCounterName(ProfileCounter counter);
+
+// what happened between the last two profileEndFrame calls
+struct ProfileFrameSummary
+{
+    struct Zone
+    {
+        const char* name;
+        double milliseconds;    // inclusive, summed over every call on every thread
+        int calls;
+    };
+
+    double frameMilliseconds = 0.0;
+    std::vector<Zone> zones;    // slowest first
+    uint64_t counters[ProfileCounterCount] = {};
+
+    // one line per zone and counter, for an on screen overlay
+    std::string text() const;
+};
+
+// this thread's counters, constant initialized so a hot loop adds to them straight through the thread pointer
+// only the owning thread writes them, the frame summary reads them once the thread has closed its first zone
+inline thread_local std::atomic<uint64_t> profileThreadCounters[ProfileCounterCount];
+
+// nanoseconds since the profiler started
+int64_t profileNow();
+void profileRecordZone(const char* name, int64_t start, int64_t end);
+
+inline void profileAddCounter(ProfileCounter counter, uint64_t amount)
+{
+    // a plain load and store, there is no other writer to lock out
+    std::atomic<uint64_t>& value = profileThreadCounters[counter];
+    value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+// closes the current frame, call once per frame from the main thread while no other thread is inside a zone
+// (between parallelFor jobs), zones that closed since the last call count towards it
+void profileEndFrame(ProfileFrameSummary& summary);
+
+// every zone still in the rings as a complete event ("X") plus one counter sample ("C") per recent frame
+// open the file in chrome://tracing or Perfetto, same threading rule as profileEndFrame
+bool writeChromeTrace(const char* path);
+
+class ProfileZone
+{
+public:
+    explicit ProfileZone(const char* name) : name(name), start(profileNow()) {}
+    ~ProfileZone() { profileRecordZone(name, start, profileNow()); }
+
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+    const char* name;
+    int64_t start;
+};
+
+#if LOS_PROFILE
+#define LOS_PROFILE_JOIN2(a, b) a##b
+#define LOS_PROFILE_JOIN(a, b) LOS_PROFILE_JOIN2(a, b)
+#define LOS_PROFILE_ZONE(name) ProfileZone LOS_PROFILE_JOIN(profileZone, __LINE__)(name)
+#define LOS_PROFILE_COUNT(counter, amount) profileAddCounter(counter, amount)
+#else
+#define LOS_PROFILE_ZONE(name) ((void)0)
+#define LOS_PROFILE_COUNT(counter, amount) ((void)sizeof(amount))
+#endif
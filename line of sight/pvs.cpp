@@ -0,0 +1,374 @@
+#include "pvs.h"
+#include "profiler.h"
+#include "raykernel.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <fstream>
+
+static const char pvsMagic[4] = { 'L', 'P', 'V', 'S' };
+static const uint32_t pvsFormatVersion = 2;
+
+static void copyCellEdges(PotentiallyVisibleSet& pvs, const SegmentStore& segments)
+{
+    size_t count = pvs.cellSegments.size();
+    pvs.cellX0.resize(count);
+    pvs.cellY0.resize(count);
+    pvs.cellDX.resize(count);
+    pvs.cellDY.resize(count);
+    for (size_t k = 0; k < count; k++)
+    {
+        int i = pvs.cellSegments[k];
+        pvs.cellX0[k] = segments.x0[i];
+        pvs.cellY0[k] = segments.y0[i];
+        pvs.cellDX[k] = segments.dx[i];
+        pvs.cellDY[k] = segments.dy[i];
+    }
+}
+
+// does the segment a -> b pass through shape s at least margin deep, clipped against the shape's edges pushed in by margin
+static bool passesThroughShape(const SegmentStore& segments, int shape, Vec2 a, Vec2 b, float margin)
+{
+    float outward = -(float)segments.windingOf(shape);
+    Vec2 delta = b - a;
+    float tEnter = 0.0f, tLeave = 1.0f;
+    for (int j = segments.shapeStart[shape]; j < segments.shapeStart[shape + 1]; j++)
+    {
+        Vec2 normal = outward * Vec2(segments.nx[j], segments.ny[j]);
+        float start = dot(normal, a - Vec2(segments.x0[j], segments.y0[j])) + margin;
+        float along = dot(normal, delta);
+        if (along == 0.0f)
+        {
+            if (start > 0.0f)
+            {
+                return false;
+            }
+            continue;
+        }
+        float t = -start / along;
+        if (along > 0.0f)
+        {
+            tLeave = std::min(tLeave, t);
+        }
+        else
+        {
+            tEnter = std::max(tEnter, t);
+        }
+        if (tEnter > tLeave)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// does shape s stay more than margin away from the box, separating axis test on the box axes and the shape's edge normals
+static bool shapeClearOfBox(const SegmentStore& segments, int shape, const float* bounds, const Vec2* corners, float margin)
+{
+    if (bounds[0] > corners[2].x + margin || bounds[2] < corners[0].x - margin || bounds[1] > corners[2].y + margin || bounds[3] < corners[0].y - margin)
+    {
+        return true;
+    }
+    float outward = -(float)segments.windingOf(shape);
+    for (int j = segments.shapeStart[shape]; j < segments.shapeStart[shape + 1]; j++)
+    {
+        Vec2 normal = outward * Vec2(segments.nx[j], segments.ny[j]);
+        Vec2 vertex(segments.x0[j], segments.y0[j]);
+        float nearest = FLT_MAX;
+        for (int k = 0; k < 4; k++)
+        {
+            nearest = std::min(nearest, dot(normal, corners[k] - vertex));
+        }
+        if (nearest > margin)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void PotentiallyVisibleSet::bake(const SegmentStore& segments, const SegmentGrid& grid, float requestedCellSize, ThreadPool* pool)
+{
+    LOS_PROFILE_ZONE("PotentiallyVisibleSet::bake");
+    columns = 0;
+    rows = 0;
+    fingerprint = segments.fingerprint();
+    cellStart.clear();
+    cellSegments.clear();
+    if (grid.isEmpty())
+    {
+        return;
+    }
+    if (pool == nullptr)
+    {
+        pool = &ThreadPool::shared();
+    }
+
+    // same bounds as the grid
+    cellSize = requestedCellSize > 0.0f ? requestedCellSize : grid.cellSize;
+    inverseCellSize = 1.0f / cellSize;
+    originX = grid.originX;
+    originY = grid.originY;
+    columns = std::max(1, (int)std::ceil(grid.columns * grid.cellSize * inverseCellSize));
+    rows = std::max(1, (int)std::ceil(grid.rows * grid.cellSize * inverseCellSize));
+    int cellCount = columns * rows;
+
+    int segmentCount = segments.size();
+    int shapeCount = segments.shapeCount();
+    std::vector<int> edgeShape(segmentCount);
+    for (int i = 0; i < segmentCount; i++)
+    {
+        edgeShape[i] = segments.shapeOf(i);
+    }
+    std::vector<float> shapeBounds(4 * shapeCount);
+    for (int s = 0; s < shapeCount; s++)
+    {
+        float* bounds = &shapeBounds[4 * s];
+        bounds[0] = bounds[1] = FLT_MAX;
+        bounds[2] = bounds[3] = -FLT_MAX;
+        for (int j = segments.shapeStart[s]; j < segments.shapeStart[s + 1]; j++)
+        {
+            bounds[0] = std::min(bounds[0], segments.x0[j]);
+            bounds[1] = std::min(bounds[1], segments.y0[j]);
+            bounds[2] = std::max(bounds[2], segments.x0[j]);
+            bounds[3] = std::max(bounds[3], segments.y0[j]);
+        }
+    }
+
+    // per worker: whether each shape may occlude for the current cell, stamps of the cell (and edge) that last looked at each shape
+    std::vector<std::vector<uint8_t>> occludes(pool->size(), std::vector<uint8_t>(shapeCount));
+    std::vector<std::vector<int>> cellStamps(pool->size(), std::vector<int>(shapeCount, -1));
+    std::vector<std::vector<int>> edgeStamps(pool->size(), std::vector<int>(shapeCount, -1));
+    std::vector<int> edgeCounters(pool->size(), 0);
+    std::vector<std::vector<int>> walks(pool->size());
+    std::vector<std::vector<int>> cellLists(cellCount);
+
+    // the margins keep every blocked sight line at least that deep inside its occluder,
+    // well clear of the tolerances of the ray tests at the occluder's corners and edges
+    float slack = cellSize * 1e-3f;
+    float margin = cellSize * 0.02f;
+
+    pool->parallelFor(cellCount, 1, [&](int begin, int end, int worker)
+    {
+        std::vector<uint8_t>& occluder = occludes[worker];
+        std::vector<int>& cellStamp = cellStamps[worker];
+        std::vector<int>& edgeStamp = edgeStamps[worker];
+        std::vector<int>& walk = walks[worker];
+        int& stamp = edgeCounters[worker];
+        for (int cell = begin; cell < end; cell++)
+        {
+            std::vector<int>& list = cellLists[cell];
+            float boxX = originX + (cell % columns) * cellSize;
+            float boxY = originY + (cell / columns) * cellSize;
+            Vec2 corners[4] = { Vec2(boxX - slack, boxY - slack), Vec2(boxX + cellSize + slack, boxY - slack),
+                                Vec2(boxX + cellSize + slack, boxY + cellSize + slack), Vec2(boxX - slack, boxY + cellSize + slack) };
+            Vec2 center(boxX + 0.5f * cellSize, boxY + 0.5f * cellSize);
+
+            // a shape occludes for this cell when it has an inside and no point of the cell lies in it,
+            // then every sight line from the cell that passes through it meets one of its edges first
+            auto usable = [&](int s)
+            {
+                if (cellStamp[s] != cell)
+                {
+                    cellStamp[s] = cell;
+                    occluder[s] = segments.windingOf(s) != 0 && shapeClearOfBox(segments, s, &shapeBounds[4 * s], corners, margin);
+                }
+                return occluder[s] != 0;
+            };
+            // the points hidden behind a convex occluder from all of the cell form a convex region, so the edge is
+            // hidden from the whole cell once the sight lines from the four corners to both of its ends pass through it
+            auto hides = [&](int s, Vec2 a, Vec2 b)
+            {
+                for (int k = 0; k < 4; k++)
+                {
+                    if (!passesThroughShape(segments, s, corners[k], a, margin) || !passesThroughShape(segments, s, corners[k], b, margin))
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            };
+
+            for (int i = 0; i < segmentCount; i++)
+            {
+                Vec2 edgeStart(segments.x0[i], segments.y0[i]);
+                Vec2 edgeEnd = edgeStart + Vec2(segments.dx[i], segments.dy[i]);
+
+                // the edge's own shape hides it when it faces away from the whole cell
+                int own = edgeShape[i];
+                if (own >= 0 && usable(own) && hides(own, edgeStart, edgeEnd))
+                {
+                    continue;
+                }
+
+                // an occluder hiding the edge crosses the line from the cell's center to the edge's middle,
+                // so only the shapes in the grid cells along that line are tried
+                stamp++;
+                walk.clear();
+                grid.cellsAlong(center, 0.5f * (edgeStart + edgeEnd), walk);
+                bool hidden = false;
+                for (size_t w = 0; w < walk.size() && !hidden; w++)
+                {
+                    for (int k = grid.cellShapeStart[walk[w]]; k < grid.cellShapeStart[walk[w] + 1] && !hidden; k++)
+                    {
+                        int s = grid.cellShapes[k];
+                        if (s == own || edgeStamp[s] == stamp)
+                        {
+                            continue;
+                        }
+                        edgeStamp[s] = stamp;
+                        hidden = usable(s) && hides(s, edgeStart, edgeEnd);
+                    }
+                }
+                if (!hidden)
+                {
+                    list.push_back(i);
+                }
+            }
+        }
+    });
+
+    cellStart.assign(cellCount + 1, 0);
+    for (int c = 0; c < cellCount; c++)
+    {
+        cellStart[c + 1] = cellStart[c] + (int)cellLists[c].size();
+    }
+    cellSegments.resize(cellStart[cellCount]);
+    for (int c = 0; c < cellCount; c++)
+    {
+        std::copy(cellLists[c].begin(), cellLists[c].end(), cellSegments.begin() + cellStart[c]);
+    }
+    copyCellEdges(*this, segments);
+}
+
+int PotentiallyVisibleSet::cellOf(Vec2 point) const
+{
+    if (isEmpty())
+    {
+        return -1;
+    }
+    float fx = std::floor((point.x - originX) * inverseCellSize);
+    float fy = std::floor((point.y - originY) * inverseCellSize);
+    if (!(fx >= 0.0f && fx < columns && fy >= 0.0f && fy < rows))
+    {
+        return -1;
+    }
+    int cell = (int)fy * columns + (int)fx;
+    if (cellStart[cell] == cellStart[cell + 1])
+    {
+        return -1;
+    }
+    return cell;
+}
+
+bool PotentiallyVisibleSet::castRay(int cell, Vec2 origin, Vec2 ray, float& hitT, int& hitSegment) const
+{
+    int first = cellStart[cell];
+    int count = cellStart[cell + 1] - first;
+    LOS_PROFILE_COUNT(CounterSegmentsTested, count);
+    int local = closestHitInRange(cellX0.data() + first, cellY0.data() + first, cellDX.data() + first, cellDY.data() + first, count, origin, ray, hitT);
+    hitSegment = local >= 0 ? cellSegments[first + local] : -1;
+    return local >= 0;
+}
+
+// ===== ===== =====
+// SERIALISATION
+// ===== ===== =====
+
+template <typename T>
+static void writeValues(std::ofstream& file, const T* values, size_t count)
+{
+    file.write((const char*)values, count * sizeof(T));
+}
+
+template <typename T>
+static bool readValues(std::ifstream& file, T* values, size_t count)
+{
+    file.read((char*)values, count * sizeof(T));
+    return (size_t)file.gcount() == count * sizeof(T);
+}
+
+bool PotentiallyVisibleSet::save(const char* path) const
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+    int32_t segmentCount = (int32_t)cellSegments.size();
+    writeValues(file, pvsMagic, 4);
+    writeValues(file, &pvsFormatVersion, 1);
+    writeValues(file, &fingerprint, 1);
+    writeValues(file, &originX, 1);
+    writeValues(file, &originY, 1);
+    writeValues(file, &cellSize, 1);
+    writeValues(file, &columns, 1);
+    writeValues(file, &rows, 1);
+    writeValues(file, &segmentCount, 1);
+    writeValues(file, cellStart.data(), cellStart.size());
+    writeValues(file, cellSegments.data(), cellSegments.size());
+    return (bool)file;
+}
+
+bool PotentiallyVisibleSet::load(const char* path, const SegmentStore& segments)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+
+    char magic[4];
+    uint32_t version;
+    PotentiallyVisibleSet loaded;
+    int32_t segmentCount;
+    if (!readValues(file, magic, 4) || !std::equal(magic, magic + 4, pvsMagic) || !readValues(file, &version, 1) || version != pvsFormatVersion)
+    {
+        return false;
+    }
+    if (!readValues(file, &loaded.fingerprint, 1) || loaded.fingerprint != segments.fingerprint())
+    {
+        return false;
+    }
+    if (!readValues(file, &loaded.originX, 1) || !readValues(file, &loaded.originY, 1) || !readValues(file, &loaded.cellSize, 1) ||
+        !readValues(file, &loaded.columns, 1) || !readValues(file, &loaded.rows, 1) || !readValues(file, &segmentCount, 1))
+    {
+        return false;
+    }
+    if (!(loaded.cellSize > 0.0f) || loaded.columns <= 0 || loaded.rows <= 0 || segmentCount < 0 || (int64_t)loaded.columns * loaded.rows > (1 << 26))
+    {
+        return false;
+    }
+
+    int cellCount = loaded.columns * loaded.rows;
+    loaded.cellStart.resize(cellCount + 1);
+    loaded.cellSegments.resize(segmentCount);
+    if (!readValues(file, loaded.cellStart.data(), loaded.cellStart.size()) || !readValues(file, loaded.cellSegments.data(), loaded.cellSegments.size()))
+    {
+        return false;
+    }
+    if (loaded.cellStart[0] != 0 || loaded.cellStart[cellCount] != segmentCount)
+    {
+        return false;
+    }
+    for (int c = 0; c < cellCount; c++)
+    {
+        if (loaded.cellStart[c] > loaded.cellStart[c + 1])
+        {
+            return false;
+        }
+    }
+    for (int k = 0; k < segmentCount; k++)
+    {
+        if (loaded.cellSegments[k] < 0 || loaded.cellSegments[k] >= segments.size())
+        {
+            return false;
+        }
+    }
+
+    loaded.inverseCellSize = 1.0f / loaded.cellSize;
+    copyCellEdges(loaded, segments);
+    *this = std::move(loaded);
+    return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "segmentgrid.h"
+
+class ThreadPool;
+
+// potentially visible set: the level bounds are split into square cells and every cell lists the edges
+// that can be seen from somewhere inside it, so a ray cast from that cell only tests that short list
+// the lists are conservative: an edge is only left out when one convex shape clear of the cell hides it from every
+// point of the cell, so the nearest hit over a cell's list is the nearest hit over the whole level
+struct PotentiallyVisibleSet
+{
+    float originX = 0.0f;
+    float originY = 0.0f;
+    float cellSize = 1.0f;
+    float inverseCellSize = 1.0f;
+    int columns = 0;
+    int rows = 0;
+
+    uint64_t fingerprint = 0;       // SegmentStore::fingerprint() of the geometry it was baked for
+    unsigned geometryVersion = 0;   // Level::geometryVersion it belongs to, set by bakePVS / loadOrBakePVS
+
+    // compressed cell lists sorted by edge index, cell c owns [cellStart[c], cellStart[c + 1])
+    std::vector<int> cellStart;
+    std::vector<int> cellSegments;
+    // copies of the edges in cell order for the batched ray kernel
+    std::vector<float> cellX0, cellY0, cellDX, cellDY;
+
+    // cellSize <= 0 reuses the grid's cell size, the occluders of every cell are taken from the grid cells between it and each edge
+    // cells are baked in parallel on pool (ThreadPool::shared() when null)
+    void bake(const SegmentStore& segments, const SegmentGrid& grid, float cellSize = 0.0f, ThreadPool* pool = nullptr);
+
+    bool isEmpty() const { return columns == 0 || rows == 0; }
+
+    // baked cell containing point, -1 outside the baked area or in a cell with an empty list
+    int cellOf(Vec2 point) const;
+
+    // nearest edge of the cell's list hit by origin + t * ray, same acceptance rules as SegmentStore::intersect
+    bool castRay(int cell, Vec2 origin, Vec2 ray, float& hitT, int& hitSegment) const;
+
+    // raw dump in the machine's byte order, load rejects files baked for other geometry (fingerprint mismatch)
+    bool save(const char* path) const;
+    bool load(const char* path, const SegmentStore& segments);
+};
@@ -0,0 +1,261 @@
+#include "raykernel.h"
+
+#include <atomic>
+#include <cfloat>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define LOS_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define LOS_TARGET_AVX2
+#else
+#define LOS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#else
+#define LOS_X86 0
+#endif
+
+static const float collinearThreshold = 0.01f;
+
+static int closestHitScalar(const float* x0, const float* y0, const float* dx, const float* dy, int first, int count, Vec2 origin, Vec2 ray, float& bestT, int bestIndex)
+{
+    for (int i = first; i < count; i++)
+    {
+        float wx = x0[i] - origin.x;
+        float wy = y0[i] - origin.y;
+        float originCross = wx * dy[i] - wy * dx[i];
+        float denominator = ray.x * dy[i] - ray.y * dx[i];
+        if (std::abs(originCross) < collinearThreshold || denominator == 0.0f)
+        {
+            continue;
+        }
+        float u = (wx * ray.y - wy * ray.x) / denominator;
+        float t = originCross / denominator;
+        if (u >= 0.0f && u <= 1.0f && t >= 0.0f && t < bestT)
+        {
+            bestT = t;
+            bestIndex = i;
+        }
+    }
+    return bestIndex;
+}
+
+#if LOS_X86
+
+static int closestHitSSE(const float* x0, const float* y0, const float* dx, const float* dy, int count, Vec2 origin, Vec2 ray, float& hitT)
+{
+    const __m128 ox = _mm_set1_ps(origin.x);
+    const __m128 oy = _mm_set1_ps(origin.y);
+    const __m128 rx = _mm_set1_ps(ray.x);
+    const __m128 ry = _mm_set1_ps(ray.y);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 threshold = _mm_set1_ps(collinearThreshold);
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128 infinity = _mm_set1_ps(FLT_MAX);
+
+    __m128 bestT = infinity;
+    __m128i bestIndex = _mm_set1_epi32(-1);
+    __m128i index = _mm_setr_epi32(0, 1, 2, 3);
+    const __m128i step = _mm_set1_epi32(4);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 sdx = _mm_loadu_ps(dx + i);
+        __m128 sdy = _mm_loadu_ps(dy + i);
+        __m128 wx = _mm_sub_ps(_mm_loadu_ps(x0 + i), ox);
+        __m128 wy = _mm_sub_ps(_mm_loadu_ps(y0 + i), oy);
+
+        __m128 originCross = _mm_sub_ps(_mm_mul_ps(wx, sdy), _mm_mul_ps(wy, sdx));
+        __m128 denominator = _mm_sub_ps(_mm_mul_ps(rx, sdy), _mm_mul_ps(ry, sdx));
+        __m128 u = _mm_div_ps(_mm_sub_ps(_mm_mul_ps(wx, ry), _mm_mul_ps(wy, rx)), denominator);
+        __m128 t = _mm_div_ps(originCross, denominator);
+
+        __m128 valid = _mm_cmpge_ps(_mm_and_ps(originCross, absMask), threshold);
+        valid = _mm_and_ps(valid, _mm_cmpneq_ps(denominator, zero));
+        valid = _mm_and_ps(valid, _mm_cmpge_ps(u, zero));
+        valid = _mm_and_ps(valid, _mm_cmple_ps(u, one));
+        valid = _mm_and_ps(valid, _mm_cmpge_ps(t, zero));
+        valid = _mm_and_ps(valid, _mm_cmplt_ps(t, bestT));
+
+        // branchless select of the closer hit per lane
+        bestT = _mm_or_ps(_mm_and_ps(valid, t), _mm_andnot_ps(valid, bestT));
+        __m128i validIndex = _mm_castps_si128(valid);
+        bestIndex = _mm_or_si128(_mm_and_si128(validIndex, index), _mm_andnot_si128(validIndex, bestIndex));
+        index = _mm_add_epi32(index, step);
+    }
+
+    alignas(16) float lanesT[4];
+    alignas(16) int lanesIndex[4];
+    _mm_store_ps(lanesT, bestT);
+    _mm_store_si128((__m128i*)lanesIndex, bestIndex);
+
+    float resultT = FLT_MAX;
+    int result = -1;
+    for (int lane = 0; lane < 4; lane++)
+    {
+        if (lanesIndex[lane] >= 0 && (lanesT[lane] < resultT || (lanesT[lane] == resultT && lanesIndex[lane] < result)))
+        {
+            resultT = lanesT[lane];
+            result = lanesIndex[lane];
+        }
+    }
+
+    result = closestHitScalar(x0, y0, dx, dy, i, count, origin, ray, resultT, result);
+    hitT = resultT;
+    return result;
+}
+
+LOS_TARGET_AVX2
+static int closestHitAVX2(const float* x0, const float* y0, const float* dx, const float* dy, int count, Vec2 origin, Vec2 ray, float& hitT)
+{
+    const __m256 ox = _mm256_set1_ps(origin.x);
+    const __m256 oy = _mm256_set1_ps(origin.y);
+    const __m256 rx = _mm256_set1_ps(ray.x);
+    const __m256 ry = _mm256_set1_ps(ray.y);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 threshold = _mm256_set1_ps(collinearThreshold);
+    const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+    __m256 bestT = _mm256_set1_ps(FLT_MAX);
+    __m256i bestIndex = _mm256_set1_epi32(-1);
+    __m256i index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i step = _mm256_set1_epi32(8);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 sdx = _mm256_loadu_ps(dx + i);
+        __m256 sdy = _mm256_loadu_ps(dy + i);
+        __m256 wx = _mm256_sub_ps(_mm256_loadu_ps(x0 + i), ox);
+        __m256 wy = _mm256_sub_ps(_mm256_loadu_ps(y0 + i), oy);
+
+        // plain mul/sub rather than fma, so every lane rounds exactly like the scalar path
+        __m256 originCross = _mm256_sub_ps(_mm256_mul_ps(wx, sdy), _mm256_mul_ps(wy, sdx));
+        __m256 denominator = _mm256_sub_ps(_mm256_mul_ps(rx, sdy), _mm256_mul_ps(ry, sdx));
+        __m256 u = _mm256_div_ps(_mm256_sub_ps(_mm256_mul_ps(wx, ry), _mm256_mul_ps(wy, rx)), denominator);
+        __m256 t = _mm256_div_ps(originCross, denominator);
+
+        __m256 valid = _mm256_cmp_ps(_mm256_and_ps(originCross, absMask), threshold, _CMP_GE_OQ);
+        valid = _mm256_and_ps(valid, _mm256_cmp_ps(denominator, zero, _CMP_NEQ_OQ));
+        valid = _mm256_and_ps(valid, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+        valid = _mm256_and_ps(valid, _mm256_cmp_ps(u, one, _CMP_LE_OQ));
+        valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, zero, _CMP_GE_OQ));
+        valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, bestT, _CMP_LT_OQ));
+
+        bestT = _mm256_blendv_ps(bestT, t, valid);
+        bestIndex = _mm256_blendv_epi8(bestIndex, index, _mm256_castps_si256(valid));
+        index = _mm256_add_epi32(index, step);
+    }
+
+    alignas(32) float lanesT[8];
+    alignas(32) int lanesIndex[8];
+    _mm256_store_ps(lanesT, bestT);
+    _mm256_store_si256((__m256i*)lanesIndex, bestIndex);
+
+    float resultT = FLT_MAX;
+    int result = -1;
+    for (int lane = 0; lane < 8; lane++)
+    {
+        if (lanesIndex[lane] >= 0 && (lanesT[lane] < resultT || (lanesT[lane] == resultT && lanesIndex[lane] < result)))
+        {
+            resultT = lanesT[lane];
+            result = lanesIndex[lane];
+        }
+    }
+
+    result = closestHitScalar(x0, y0, dx, dy, i, count, origin, ray, resultT, result);
+    hitT = resultT;
+    return result;
+}
+
+static bool cpuHasAVX2()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+    {
+        return false;
+    }
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+    {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+RayKernel detectRayKernel()
+{
+#if LOS_X86
+    static const RayKernel detected = cpuHasAVX2() ? RayKernel::AVX2 : RayKernel::SSE;
+    return detected;
+#else
+    return RayKernel::Scalar;
+#endif
+}
+
+static std::atomic<int> selectedKernel{ -1 };
+
+RayKernel activeRayKernel()
+{
+    int selected = selectedKernel.load(std::memory_order_relaxed);
+    if (selected < 0)
+    {
+        return detectRayKernel();
+    }
+    return (RayKernel)selected;
+}
+
+void setRayKernel(RayKernel kernel)
+{
+    if ((int)kernel > (int)detectRayKernel())
+    {
+        kernel = detectRayKernel();
+    }
+    selectedKernel.store((int)kernel, std::memory_order_relaxed);
+}
+
+const char* rayKernelName(RayKernel kernel)
+{
+    switch (kernel)
+    {
+    case RayKernel::SSE: return "sse";
+    case RayKernel::AVX2: return "avx2";
+    default: return "scalar";
+    }
+}
+
+int closestHitInRange(RayKernel kernel, const float* x0, const float* y0, const float* dx, const float* dy, int count, Vec2 origin, Vec2 ray, float& hitT)
+{
+#if LOS_X86
+    if (kernel == RayKernel::AVX2 && count >= 8)
+    {
+        return closestHitAVX2(x0, y0, dx, dy, count, origin, ray, hitT);
+    }
+    if (kernel != RayKernel::Scalar && count >= 4)
+    {
+        return closestHitSSE(x0, y0, dx, dy, count, origin, ray, hitT);
+    }
+#endif
+    hitT = FLT_MAX;
+    return closestHitScalar(x0, y0, dx, dy, 0, count, origin, ray, hitT, -1);
+}
+
+int closestHitInRange(const float* x0, const float* y0, const float* dx, const float* dy, int count, Vec2 origin, Vec2 ray, float& hitT)
+{
+    return closestHitInRange(activeRayKernel(), x0, y0, dx, dy, count, origin, ray, hitT);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "geometry.h"
+
+// ===== ===== =====
+// BATCHED RAY / SEGMENT KERNEL
+// ===== ===== =====
+// one ray against a contiguous run of edges stored as x0/y0/dx/dy arrays, 4 (SSE) or 8 (AVX2) edges per step
+// acceptance rules match SegmentStore::intersect, the nearest hit is picked with a branchless
+// per lane minimum on the ray parameter (no sqrt) and a final horizontal reduction
+// ties go to the lowest index, like the scalar loops
+
+enum class RayKernel
+{
+    Scalar,
+    SSE,
+    AVX2
+};
+
+// best kernel the CPU supports, detected once
+RayKernel detectRayKernel();
+
+// kernel used by closestHitInRange, defaults to detectRayKernel()
+// requests for an unsupported kernel fall back to the best supported one
+RayKernel activeRayKernel();
+void setRayKernel(RayKernel kernel);
+
+const char* rayKernelName(RayKernel kernel);
+
+// index (0 based within the run) of the nearest edge hit by origin + t * ray, -1 if none
+// hitT receives the ray parameter of that hit
+int closestHitInRange(const float* x0, const float* y0, const float* dx, const float* dy, int count, Vec2 origin, Vec2 ray, float& hitT);
+int closestHitInRange(RayKernel kernel, const float* x0, const float* y0, const float* dx, const float* dy, int count, Vec2 origin, Vec2 ray, float& hitT);
@@ -0,0 +1,325 @@
+#include "replay.h"
+#include "physics.h"
+
+#include <algorithm>
+#include <fstream>
+
+static const char replayMagic[4] = { 'L', 'R', 'E', 'C' };
+static const uint32_t replayFormatVersion = 1;
+
+// ===== ===== =====
+// SIMULATION STEP
+// ===== ===== =====
+
+void ButtonInput::update(Entity& actor, float /*dt*/)
+{
+    movingLeft = (buttons & ButtonLeft) != 0;
+    movingRight = (buttons & ButtonRight) != 0;
+    movingUp = (buttons & ButtonUp) != 0;
+    movingDown = (buttons & ButtonDown) != 0;
+    if (movingLeft || movingRight || movingUp || movingDown)
+    {
+        moving = true;
+    }
+
+    float speedMultiplier = 4.0f;
+
+    if (movingLeft)
+    {
+        if (actor.velocity.x > 0.0f)
+        {
+            actor.velocity.x = 0.0f;
+        }
+        actor.acceleration = Vec2({ -speedMultiplier * actor.max_speed, actor.acceleration.y });
+    }
+    if (movingRight)
+    {
+        if (actor.velocity.x < 0.0f)
+        {
+            actor.velocity.x = 0.0f;
+        }
+        actor.acceleration = Vec2({ speedMultiplier * actor.max_speed, actor.acceleration.y });
+    }
+    if (movingUp)
+    {
+        if (actor.velocity.y > 0.0f)
+        {
+            actor.velocity.y = 0.0f;
+        }
+        actor.acceleration = Vec2({ actor.acceleration.x, -speedMultiplier * actor.max_speed });
+    }
+    if (movingDown)
+    {
+        if (actor.velocity.y < 0.0f)
+        {
+            actor.velocity.y = 0.0f;
+        }
+        actor.acceleration = Vec2({ actor.acceleration.x, speedMultiplier * actor.max_speed });
+    }
+    if (norm(actor.acceleration) > speedMultiplier * actor.max_speed)
+    {
+        actor.acceleration = normalize(actor.acceleration) * speedMultiplier * actor.max_speed;
+    }
+
+    if (!movingLeft && !movingRight)
+    {
+        actor.acceleration.x = -speedMultiplier * actor.velocity.x;
+    }
+
+    if (!movingUp && !movingDown)
+    {
+        actor.acceleration.y = -speedMultiplier * actor.velocity.y;
+    }
+}
+
+VisibilityUpdate stepPlayer(const Level& level, Entity& player, float dt, VisibilityResult& vision, VisibilityCache& cache, VisibilityQuery& query, VisibilityEngine engine, VisionCone* cone)
+{
+    if (norm(player.velocity) > player.max_speed)
+    {
+        player.velocity = normalize(player.velocity) * player.max_speed;
+    }
+    player.update(dt);
+
+    if (cone != nullptr)
+    {
+        resolveActorCollision(level, player);
+        if (player.velocity.x != 0.0f || player.velocity.y != 0.0f)
+        {
+            cone->heading = player.velocity;
+        }
+        // the cache only knows full passes
+        cache.invalidate();
+        computeVisibilityCone(level, player.position, *cone, vision);
+        query.build(player.position, vision.polygon, vision.open);
+        return VisibilityUpdate::Rebuilt;
+    }
+
+    // the edge nearest the player is the one it can run into
+    resolveActorCollision(level, player, vision.nearestSegment);
+
+    VisibilityUpdate update = updateVisibility(level, player.position, vision, cache, engine);
+    if (update != VisibilityUpdate::Reused)
+    {
+        query.build(player.position, vision.polygon);
+    }
+    return update;
+}
+
+static uint64_t hashBytes(uint64_t hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+uint64_t simulationChecksum(const Entity& player, const VisibilityResult& vision, const EntityStore& enemies)
+{
+    uint64_t hash = 14695981039346656037ull;
+    hash = hashBytes(hash, &player.position, sizeof(Vec2));
+    hash = hashBytes(hash, &player.velocity, sizeof(Vec2));
+    hash = hashBytes(hash, &player.acceleration, sizeof(Vec2));
+    hash = hashBytes(hash, vision.polygon.data(), vision.polygon.size() * sizeof(Vec2));
+    hash = hashBytes(hash, enemies.x.data(), enemies.x.size() * sizeof(float));
+    hash = hashBytes(hash, enemies.y.data(), enemies.y.size() * sizeof(float));
+    hash = hashBytes(hash, enemies.vx.data(), enemies.vx.size() * sizeof(float));
+    hash = hashBytes(hash, enemies.vy.data(), enemies.vy.size() * sizeof(float));
+    hash = hashBytes(hash, enemies.flags.data(), enemies.flags.size());
+    return hash;
+}
+
+// ===== ===== =====
+// RECORDING
+// ===== ===== =====
+
+void InputRecording::begin(const Level& level, const Entity& player, const EntityStore& enemies, float tickSeconds)
+{
+    this->tickSeconds = tickSeconds;
+    levelFingerprint = level.segments.fingerprint();
+    spatialIndex = level.spatialIndex;
+    playerStart = player.position;
+    enemyRadius = enemies.radius;
+    collideEntities = enemies.collideEntities;
+    enemyX = enemies.x;
+    enemyY = enemies.y;
+    enemyVX = enemies.vx;
+    enemyVY = enemies.vy;
+
+    tickCount = 0;
+    changeTicks.clear();
+    changeMilliseconds.clear();
+    changeButtons.clear();
+    checksums.clear();
+}
+
+void InputRecording::recordTick(uint8_t buttons, uint32_t milliseconds, const Entity& player, const VisibilityResult& vision, const EntityStore& enemies)
+{
+    if (changeButtons.empty() || changeButtons.back() != buttons)
+    {
+        changeTicks.push_back(tickCount);
+        changeMilliseconds.push_back(milliseconds);
+        changeButtons.push_back(buttons);
+    }
+    if (checksumIndexAt(tickCount) >= 0)
+    {
+        checksums.push_back(simulationChecksum(player, vision, enemies));
+    }
+    tickCount++;
+}
+
+uint8_t InputRecording::buttonsAt(uint32_t tick) const
+{
+    // the last change at or before tick
+    auto next = std::upper_bound(changeTicks.begin(), changeTicks.end(), tick);
+    if (next == changeTicks.begin())
+    {
+        return 0;
+    }
+    return changeButtons[next - changeTicks.begin() - 1];
+}
+
+int InputRecording::checksumIndexAt(uint32_t tick) const
+{
+    if ((tick + 1) % checksumInterval != 0)
+    {
+        return -1;
+    }
+    return (int)((tick + 1) / checksumInterval - 1);
+}
+
+void InputRecording::restoreEnemies(EntityStore& enemies) const
+{
+    enemies.clear();
+    enemies.radius = enemyRadius;
+    enemies.collideEntities = collideEntities;
+    for (size_t i = 0; i < enemyX.size(); i++)
+    {
+        enemies.add(Vec2(enemyX[i], enemyY[i]), Vec2(enemyVX[i], enemyVY[i]));
+    }
+}
+
+template <typename T>
+static void writeValues(std::ofstream& file, const T* values, size_t count)
+{
+    file.write((const char*)values, count * sizeof(T));
+}
+
+template <typename T>
+static bool readValues(std::ifstream& file, T* values, size_t count)
+{
+    file.read((char*)values, count * sizeof(T));
+    return (size_t)file.gcount() == count * sizeof(T);
+}
+
+bool InputRecording::save(const char* path) const
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+    int32_t index = (int32_t)spatialIndex;
+    uint8_t collide = collideEntities ? 1 : 0;
+    int32_t enemyCount = (int32_t)enemyX.size();
+    int32_t changeCount = (int32_t)changeTicks.size();
+    int32_t checksumCount = (int32_t)checksums.size();
+    writeValues(file, replayMagic, 4);
+    writeValues(file, &replayFormatVersion, 1);
+    writeValues(file, &tickSeconds, 1);
+    writeValues(file, &checksumInterval, 1);
+    writeValues(file, &levelFingerprint, 1);
+    writeValues(file, &index, 1);
+    writeValues(file, &playerStart, 1);
+    writeValues(file, &enemyRadius, 1);
+    writeValues(file, &collide, 1);
+    writeValues(file, &enemyCount, 1);
+    writeValues(file, enemyX.data(), enemyCount);
+    writeValues(file, enemyY.data(), enemyCount);
+    writeValues(file, enemyVX.data(), enemyCount);
+    writeValues(file, enemyVY.data(), enemyCount);
+    writeValues(file, &tickCount, 1);
+    writeValues(file, &changeCount, 1);
+    writeValues(file, changeTicks.data(), changeCount);
+    writeValues(file, changeMilliseconds.data(), changeCount);
+    writeValues(file, changeButtons.data(), changeCount);
+    writeValues(file, &checksumCount, 1);
+    writeValues(file, checksums.data(), checksumCount);
+    return (bool)file;
+}
+
+bool InputRecording::load(const char* path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+
+    char magic[4];
+    uint32_t version;
+    if (!readValues(file, magic, 4) || !std::equal(magic, magic + 4, replayMagic) || !readValues(file, &version, 1) || version != replayFormatVersion)
+    {
+        return false;
+    }
+
+    InputRecording loaded;
+    int32_t index, enemyCount, changeCount, checksumCount;
+    uint8_t collide;
+    if (!readValues(file, &loaded.tickSeconds, 1) || !readValues(file, &loaded.checksumInterval, 1) || !readValues(file, &loaded.levelFingerprint, 1) ||
+        !readValues(file, &index, 1) || !readValues(file, &loaded.playerStart, 1) || !readValues(file, &loaded.enemyRadius, 1) ||
+        !readValues(file, &collide, 1) || !readValues(file, &enemyCount, 1))
+    {
+        return false;
+    }
+    if (!(loaded.tickSeconds > 0.0f) || loaded.checksumInterval == 0 || index < 0 || index > (int32_t)SpatialIndex::PVS || enemyCount < 0 || enemyCount > (1 << 24))
+    {
+        return false;
+    }
+    loaded.spatialIndex = (SpatialIndex)index;
+    loaded.collideEntities = collide != 0;
+
+    loaded.enemyX.resize(enemyCount);
+    loaded.enemyY.resize(enemyCount);
+    loaded.enemyVX.resize(enemyCount);
+    loaded.enemyVY.resize(enemyCount);
+    if (!readValues(file, loaded.enemyX.data(), enemyCount) || !readValues(file, loaded.enemyY.data(), enemyCount) ||
+        !readValues(file, loaded.enemyVX.data(), enemyCount) || !readValues(file, loaded.enemyVY.data(), enemyCount))
+    {
+        return false;
+    }
+
+    if (!readValues(file, &loaded.tickCount, 1) || !readValues(file, &changeCount, 1) || changeCount < 0 || (uint32_t)changeCount > loaded.tickCount)
+    {
+        return false;
+    }
+    loaded.changeTicks.resize(changeCount);
+    loaded.changeMilliseconds.resize(changeCount);
+    loaded.changeButtons.resize(changeCount);
+    if (!readValues(file, loaded.changeTicks.data(), changeCount) || !readValues(file, loaded.changeMilliseconds.data(), changeCount) ||
+        !readValues(file, loaded.changeButtons.data(), changeCount))
+    {
+        return false;
+    }
+    for (int32_t k = 0; k < changeCount; k++)
+    {
+        if (loaded.changeTicks[k] >= loaded.tickCount || (k > 0 && loaded.changeTicks[k] <= loaded.changeTicks[k - 1]))
+        {
+            return false;
+        }
+    }
+
+    if (!readValues(file, &checksumCount, 1) || checksumCount < 0 || (uint32_t)checksumCount != loaded.tickCount / loaded.checksumInterval)
+    {
+        return false;
+    }
+    loaded.checksums.resize(checksumCount);
+    if (!readValues(file, loaded.checksums.data(), checksumCount))
+    {
+        return false;
+    }
+
+    *this = std::move(loaded);
+    return true;
+}
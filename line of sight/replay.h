@@ -0,0 +1,83 @@
+#pragma once
+
+#include "entity.h"
+#include "entitystore.h"
+#include "visibility.h"
+
+#include <cstdint>
+
+// ===== ===== =====
+// INPUT REPLAY
+// ===== ===== =====
+// the demo steps its simulation on a fixed tick and can record the buttons held on every tick, so a session plays
+// back headless at full speed and lands on the same state, bit for bit (same binary, same level)
+// every checksumInterval ticks the recording also keeps a checksum of the player, its visibility polygon and the
+// enemies, a replay compares against them to find the first tick that diverged
+
+enum InputButtons : uint8_t
+{
+    ButtonLeft = 1 << 0,
+    ButtonRight = 1 << 1,
+    ButtonUp = 1 << 2,
+    ButtonDown = 1 << 3,
+    ButtonSweep = 1 << 4,   // the player sees with VisibilityEngine::AngularSweep instead of RayCast
+    ButtonCone = 1 << 5     // the player only sees inside a default VisionCone turned along its movement
+};
+
+// drives an entity from a set of InputButtons: accelerates along the held directions, brakes on the other axes
+class ButtonInput : public IInputComponent
+{
+public:
+    uint8_t buttons = 0;
+
+    void update(Entity& actor, float dt) override;
+};
+
+// the player's part of a tick after its input: speed clamp, integration, wall contact against the edge nearest
+// last tick, then its visibility and, unless the result was reused, the query over it
+// with a cone the player only sees inside it: the cone turns to the player's velocity (keeps its heading while the
+// player stands), the wall contact looks its edge up itself and the cone pass runs every tick, engine is unused
+VisibilityUpdate stepPlayer(const Level& level, Entity& player, float dt, VisibilityResult& vision, VisibilityCache& cache, VisibilityQuery& query, VisibilityEngine engine, VisionCone* cone = nullptr);
+
+// FNV-1a over the player's motion, its visibility polygon and every enemy's position, velocity and flags
+uint64_t simulationChecksum(const Entity& player, const VisibilityResult& vision, const EntityStore& enemies);
+
+// binary session file (.rec) in the machine's byte order: the starting state, the held buttons as runs and the checksums
+struct InputRecording
+{
+    float tickSeconds = 1.0f / 120.0f;
+    uint32_t checksumInterval = 60;
+
+    // starting state
+    uint64_t levelFingerprint = 0;          // SegmentStore::fingerprint() of the level it was recorded on
+    SpatialIndex spatialIndex = SpatialIndex::Grid;
+    Vec2 playerStart;
+    float enemyRadius = 10.0f;
+    bool collideEntities = true;
+    std::vector<float> enemyX, enemyY, enemyVX, enemyVY;
+
+    uint32_t tickCount = 0;
+    // one entry per change of the held buttons, a run lasts until the next change
+    std::vector<uint32_t> changeTicks;
+    std::vector<uint32_t> changeMilliseconds;   // wall clock time since the session started, when the change was seen
+    std::vector<uint8_t> changeButtons;
+    // checksums[k] is the state after tick (k + 1) * checksumInterval - 1
+    std::vector<uint64_t> checksums;
+
+    // clears the recording and keeps the state a session is about to start from
+    void begin(const Level& level, const Entity& player, const EntityStore& enemies, float tickSeconds);
+    // after every tick, with the buttons it ran on and the state it left
+    void recordTick(uint8_t buttons, uint32_t milliseconds, const Entity& player, const VisibilityResult& vision, const EntityStore& enemies);
+
+    // the buttons held on a tick
+    uint8_t buttonsAt(uint32_t tick) const;
+    // index into checksums of the one taken after a tick, -1 if there is none on that tick
+    int checksumIndexAt(uint32_t tick) const;
+
+    // puts the enemies back where the recording started them
+    void restoreEnemies(EntityStore& enemies) const;
+
+    bool save(const char* path) const;
+    // false for a missing file, another format version or inconsistent counts, the recording is left untouched then
+    bool load(const char* path);
+};
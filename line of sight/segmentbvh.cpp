@@ -0,0 +1,475 @@
+#include "segmentbvh.h"
+#include "profiler.h"
+#include "raykernel.h"
+
+#include <algorithm>
+#include <cfloat>
+
+static const int binCount = 16;
+static const int maxLeafSize = 4;
+static const int maxTreeDepth = SegmentBVH::maxDepth;
+static const int maxStackDepth = maxTreeDepth + 4;
+
+namespace
+{
+    struct Bounds
+    {
+        float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+
+        void grow(float x, float y)
+        {
+            minX = std::fmin(minX, x);
+            minY = std::fmin(minY, y);
+            maxX = std::fmax(maxX, x);
+            maxY = std::fmax(maxY, y);
+        }
+
+        void grow(const Bounds& b)
+        {
+            minX = std::fmin(minX, b.minX);
+            minY = std::fmin(minY, b.minY);
+            maxX = std::fmax(maxX, b.maxX);
+            maxY = std::fmax(maxY, b.maxY);
+        }
+
+        // 2D surface area heuristic uses the perimeter
+        float perimeter() const
+        {
+            if (minX > maxX)
+            {
+                return 0.0f;
+            }
+            return 2.0f * ((maxX - minX) + (maxY - minY));
+        }
+    };
+
+    Bounds segmentBounds(const SegmentStore& segments, int i)
+    {
+        Bounds b;
+        b.grow(segments.x0[i], segments.y0[i]);
+        b.grow(segments.x0[i] + segments.dx[i], segments.y0[i] + segments.dy[i]);
+        return b;
+    }
+
+    // boxes are padded a little so rays grazing an edge endpoint on a box corner still enter the box
+    void setBounds(BVHNode& node, const Bounds& b)
+    {
+        float magnitude = std::fmax(std::fmax(std::abs(b.minX), std::abs(b.maxX)), std::fmax(std::abs(b.minY), std::abs(b.maxY)));
+        float padding = 1e-4f + 1e-6f * magnitude;
+        node.minX = b.minX - padding;
+        node.minY = b.minY - padding;
+        node.maxX = b.maxX + padding;
+        node.maxY = b.maxY + padding;
+    }
+
+    // entry distance of the ray into the node box, FLT_MAX when it misses or starts beyond maxT
+    float enterBox(const BVHNode& node, Vec2 origin, Vec2 inverseRay, float maxT)
+    {
+        float tx1 = (node.minX - origin.x) * inverseRay.x;
+        float tx2 = (node.maxX - origin.x) * inverseRay.x;
+        float ty1 = (node.minY - origin.y) * inverseRay.y;
+        float ty2 = (node.maxY - origin.y) * inverseRay.y;
+        // std::min / max compile to single instructions, fmin / fmax to library calls (nan handling the slabs don't need)
+        float tEnter = std::max(std::max(std::min(tx1, tx2), std::min(ty1, ty2)), 0.0f);
+        float tLeave = std::min(std::max(tx1, tx2), std::max(ty1, ty2));
+        if (tEnter > tLeave || tEnter > maxT)
+        {
+            return FLT_MAX;
+        }
+        return tEnter;
+    }
+
+    Vec2 inverseOf(Vec2 ray)
+    {
+        // infinities are fine here, the slab test treats them as "never crosses this axis"
+        return Vec2(ray.x != 0.0f ? 1.0f / ray.x : FLT_MAX, ray.y != 0.0f ? 1.0f / ray.y : FLT_MAX);
+    }
+}
+
+// the depth cap keeps traversal stacks fixed size, an oversized leaf is the worst case
+static void subdivide(SegmentBVH& bvh, const SegmentStore& segments, int nodeIndex, int depth, std::vector<float>& centroidX, std::vector<float>& centroidY, std::vector<Bounds>& bounds)
+{
+    BVHNode& node = bvh.nodes[nodeIndex];
+    int first = node.first;
+    int count = node.count;
+    if (count <= maxLeafSize || depth >= maxTreeDepth)
+    {
+        return;
+    }
+
+    Bounds centroidBounds;
+    for (int i = first; i < first + count; i++)
+    {
+        centroidBounds.grow(centroidX[bvh.indices[i]], centroidY[bvh.indices[i]]);
+    }
+
+    // binned SAH over both axes
+    float bestCost = FLT_MAX;
+    int bestAxis = -1;
+    int bestSplit = 0;
+    for (int axis = 0; axis < 2; axis++)
+    {
+        float low = axis == 0 ? centroidBounds.minX : centroidBounds.minY;
+        float high = axis == 0 ? centroidBounds.maxX : centroidBounds.maxY;
+        if (high <= low)
+        {
+            continue;
+        }
+        float scale = binCount / (high - low);
+
+        Bounds binBounds[binCount];
+        int binSizes[binCount] = {};
+        for (int i = first; i < first + count; i++)
+        {
+            int segment = bvh.indices[i];
+            float c = axis == 0 ? centroidX[segment] : centroidY[segment];
+            int bin = std::min(binCount - 1, (int)((c - low) * scale));
+            binSizes[bin]++;
+            binBounds[bin].grow(bounds[segment]);
+        }
+
+        float leftArea[binCount - 1], rightArea[binCount - 1];
+        int leftCount[binCount - 1], rightCount[binCount - 1];
+        Bounds leftBox, rightBox;
+        int leftSum = 0, rightSum = 0;
+        for (int i = 0; i < binCount - 1; i++)
+        {
+            leftSum += binSizes[i];
+            leftBox.grow(binBounds[i]);
+            leftCount[i] = leftSum;
+            leftArea[i] = leftBox.perimeter();
+
+            rightSum += binSizes[binCount - 1 - i];
+            rightBox.grow(binBounds[binCount - 1 - i]);
+            rightCount[binCount - 2 - i] = rightSum;
+            rightArea[binCount - 2 - i] = rightBox.perimeter();
+        }
+        for (int i = 0; i < binCount - 1; i++)
+        {
+            float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+            if (leftCount[i] > 0 && rightCount[i] > 0 && cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = i;
+            }
+        }
+    }
+
+    Bounds nodeBounds;
+    nodeBounds.minX = node.minX;
+    nodeBounds.minY = node.minY;
+    nodeBounds.maxX = node.maxX;
+    nodeBounds.maxY = node.maxY;
+    if (bestAxis < 0 || bestCost >= count * nodeBounds.perimeter())
+    {
+        return;
+    }
+
+    float low = bestAxis == 0 ? centroidBounds.minX : centroidBounds.minY;
+    float high = bestAxis == 0 ? centroidBounds.maxX : centroidBounds.maxY;
+    float scale = binCount / (high - low);
+    int* middle = std::partition(bvh.indices.data() + first, bvh.indices.data() + first + count, [&](int segment)
+        {
+            float c = bestAxis == 0 ? centroidX[segment] : centroidY[segment];
+            return std::min(binCount - 1, (int)((c - low) * scale)) <= bestSplit;
+        });
+    int leftSize = (int)(middle - (bvh.indices.data() + first));
+
+    int leftIndex = (int)bvh.nodes.size();
+    bvh.nodes.push_back(BVHNode());
+    bvh.nodes.push_back(BVHNode());
+    // push_back may have moved the node array
+    BVHNode& parent = bvh.nodes[nodeIndex];
+    parent.first = leftIndex;
+    parent.count = 0;
+
+    Bounds leftBounds, rightBounds;
+    for (int i = first; i < first + leftSize; i++)
+    {
+        leftBounds.grow(bounds[bvh.indices[i]]);
+    }
+    for (int i = first + leftSize; i < first + count; i++)
+    {
+        rightBounds.grow(bounds[bvh.indices[i]]);
+    }
+    setBounds(bvh.nodes[leftIndex], leftBounds);
+    bvh.nodes[leftIndex].first = first;
+    bvh.nodes[leftIndex].count = leftSize;
+    setBounds(bvh.nodes[leftIndex + 1], rightBounds);
+    bvh.nodes[leftIndex + 1].first = first + leftSize;
+    bvh.nodes[leftIndex + 1].count = count - leftSize;
+
+    subdivide(bvh, segments, leftIndex, depth + 1, centroidX, centroidY, bounds);
+    subdivide(bvh, segments, leftIndex + 1, depth + 1, centroidX, centroidY, bounds);
+}
+
+void SegmentBVH::build(const SegmentStore& segments)
+{
+    nodes.clear();
+    indices.clear();
+
+    int count = segments.screenEdgesStart;
+    if (count == 0)
+    {
+        copyLeafEdges(segments);
+        return;
+    }
+
+    std::vector<float> centroidX(count), centroidY(count);
+    std::vector<Bounds> bounds(count);
+    Bounds rootBounds;
+    indices.resize(count);
+    for (int i = 0; i < count; i++)
+    {
+        indices[i] = i;
+        bounds[i] = segmentBounds(segments, i);
+        centroidX[i] = segments.x0[i] + 0.5f * segments.dx[i];
+        centroidY[i] = segments.y0[i] + 0.5f * segments.dy[i];
+        rootBounds.grow(bounds[i]);
+    }
+
+    nodes.reserve(2 * (count / maxLeafSize + 1));
+    nodes.push_back(BVHNode());
+    setBounds(nodes[0], rootBounds);
+    nodes[0].first = 0;
+    nodes[0].count = count;
+    subdivide(*this, segments, 0, 0, centroidX, centroidY, bounds);
+    copyLeafEdges(segments);
+}
+
+void SegmentBVH::refit(const SegmentStore& segments)
+{
+    // children always follow their parent, so a reverse pass sees them first
+    for (int n = (int)nodes.size() - 1; n >= 0; n--)
+    {
+        BVHNode& node = nodes[n];
+        Bounds b;
+        if (node.count > 0)
+        {
+            for (int i = node.first; i < node.first + node.count; i++)
+            {
+                b.grow(segmentBounds(segments, indices[i]));
+            }
+        }
+        else
+        {
+            const BVHNode& left = nodes[node.first];
+            const BVHNode& right = nodes[node.first + 1];
+            b.grow(left.minX, left.minY);
+            b.grow(left.maxX, left.maxY);
+            b.grow(right.minX, right.minY);
+            b.grow(right.maxX, right.maxY);
+        }
+        setBounds(node, b);
+    }
+    copyLeafEdges(segments);
+}
+
+void SegmentBVH::copyLeafEdges(const SegmentStore& segments)
+{
+    size_t count = indices.size();
+    leafX0.resize(count);
+    leafY0.resize(count);
+    leafDX.resize(count);
+    leafDY.resize(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        int segment = indices[i];
+        leafX0[i] = segments.x0[segment];
+        leafY0[i] = segments.y0[segment];
+        leafDX[i] = segments.dx[segment];
+        leafDY[i] = segments.dy[segment];
+    }
+}
+
+// nearest hit over the leaves, leafRun(node, first, count) gives the run of a leaf in x0.. and leafSegments,
+// the tree's own copies or a selection of them; bestT and hitSegment come in as the best hit so far
+template <typename LeafRun>
+static void closestHitInTree(const SegmentBVH& bvh, LeafRun leafRun, const int* leafSegments, const float* x0, const float* y0, const float* dx, const float* dy,
+    Vec2 origin, Vec2 ray, float& bestT, int& hitSegment)
+{
+    if (bvh.isEmpty())
+    {
+        return;
+    }
+
+    const std::vector<BVHNode>& nodes = bvh.nodes;
+    Vec2 inverseRay = inverseOf(ray);
+
+    int stack[maxStackDepth];
+    float stackEnter[maxStackDepth];
+    int stackSize = 0;
+    float rootEnter = enterBox(nodes[0], origin, inverseRay, bestT);
+    if (rootEnter == FLT_MAX)
+    {
+        return;
+    }
+    stack[stackSize] = 0;
+    stackEnter[stackSize++] = rootEnter;
+
+    // counted once per ray, the profiler call costs more than a leaf
+    int tested = 0;
+    while (stackSize > 0)
+    {
+        stackSize--;
+        // a closer hit may have been found since this node was pushed
+        if (stackEnter[stackSize] > bestT)
+        {
+            continue;
+        }
+        int nodeIndex = stack[stackSize];
+        const BVHNode& node = nodes[nodeIndex];
+        if (node.count > 0)
+        {
+            int first, count;
+            leafRun(nodeIndex, first, count);
+            tested += count;
+            float t;
+            int local = closestHitInRange(x0 + first, y0 + first, dx + first, dy + first, count, origin, ray, t);
+            if (local >= 0)
+            {
+                int segment = leafSegments[first + local];
+                if (t < bestT || (t == bestT && segment < hitSegment))
+                {
+                    bestT = t;
+                    hitSegment = segment;
+                }
+            }
+            continue;
+        }
+
+        // visit the nearer child first, skip children starting beyond the best hit so far
+        int near = node.first;
+        int far = node.first + 1;
+        float tNear = enterBox(nodes[near], origin, inverseRay, bestT);
+        float tFar = enterBox(nodes[far], origin, inverseRay, bestT);
+        if (tFar < tNear)
+        {
+            std::swap(near, far);
+            std::swap(tNear, tFar);
+        }
+        if (tFar != FLT_MAX)
+        {
+            stack[stackSize] = far;
+            stackEnter[stackSize++] = tFar;
+        }
+        if (tNear != FLT_MAX)
+        {
+            stack[stackSize] = near;
+            stackEnter[stackSize++] = tNear;
+        }
+    }
+    LOS_PROFILE_COUNT(CounterSegmentsTested, tested);
+}
+
+// nearest screen edge, bestT and hitSegment are left alone when none is hit
+// a shape may reach past the screen edges (walls along the level border), so a screen hit bounds the tree walk
+// instead of only standing in for a miss; it is a handful of edges and culls every node behind it
+static bool closestScreenEdge(const SegmentStore& segments, Vec2 origin, Vec2 ray, float& bestT, int& hitSegment)
+{
+    int first = segments.screenEdgesStart;
+    int count = segments.size() - first;
+    LOS_PROFILE_COUNT(CounterSegmentsTested, count);
+    float t;
+    int local = closestHitInRange(segments.x0.data() + first, segments.y0.data() + first, segments.dx.data() + first, segments.dy.data() + first, count, origin, ray, t);
+    if (local < 0)
+    {
+        return false;
+    }
+    bestT = t;
+    hitSegment = first + local;
+    return true;
+}
+
+bool SegmentBVH::closestHit(const SegmentStore& segments, Vec2 origin, Vec2 ray, float& hitT, int& hitSegment) const
+{
+    hitSegment = -1;
+    float bestT = FLT_MAX;
+    auto leafRun = [this](int node, int& first, int& count)
+    {
+        first = nodes[node].first;
+        count = nodes[node].count;
+    };
+    closestScreenEdge(segments, origin, ray, bestT, hitSegment);
+    closestHitInTree(*this, leafRun, indices.data(), leafX0.data(), leafY0.data(), leafDX.data(), leafDY.data(), origin, ray, bestT, hitSegment);
+    hitT = bestT;
+    return hitSegment >= 0;
+}
+
+void SegmentBVH::beginSelection(const uint8_t* keep, EdgeSelection& selection) const
+{
+    selection.begin(keep, (int)nodes.size(), (int)indices.size());
+}
+
+bool SegmentBVH::closestHit(const SegmentStore& segments, EdgeSelection& selection, Vec2 origin, Vec2 ray, float& hitT, int& hitSegment) const
+{
+    hitSegment = -1;
+    float bestT = FLT_MAX;
+    auto leafRun = [this, &selection](int node, int& first, int& count)
+    {
+        int leafFirst = nodes[node].first;
+        selection.select(node, leafFirst, leafFirst + nodes[node].count, indices.data(), leafX0.data(), leafY0.data(), leafDX.data(), leafDY.data(), first, count);
+    };
+    closestScreenEdge(segments, origin, ray, bestT, hitSegment);
+    closestHitInTree(*this, leafRun, selection.segments.data(), selection.x0.data(), selection.y0.data(), selection.dx.data(), selection.dy.data(),
+        origin, ray, bestT, hitSegment);
+    hitT = bestT;
+    return hitSegment >= 0;
+}
+
+bool SegmentBVH::closestHit(const SegmentStore& segments, Vec2 origin, Vec2 ray, RayHit& hit) const
+{
+    float t;
+    int segment;
+    if (!closestHit(segments, origin, ray, t, segment))
+    {
+        return false;
+    }
+    hit.point = origin + t * ray;
+    hit.distance = t * norm(ray);
+    hit.segment = segments.getSegment(segment);
+    hit.segmentIndex = segment;
+    return true;
+}
+
+bool SegmentBVH::anyHit(const SegmentStore& segments, Vec2 origin, Vec2 ray, float maxT) const
+{
+    float t = FLT_MAX;
+    int segment;
+    if (closestScreenEdge(segments, origin, ray, t, segment) && t < maxT)
+    {
+        return true;
+    }
+    if (isEmpty())
+    {
+        return false;
+    }
+
+    Vec2 inverseRay = inverseOf(ray);
+    int stack[maxStackDepth];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0)
+    {
+        const BVHNode& node = nodes[stack[--stackSize]];
+        if (enterBox(node, origin, inverseRay, maxT) == FLT_MAX)
+        {
+            continue;
+        }
+        if (node.count > 0)
+        {
+            LOS_PROFILE_COUNT(CounterSegmentsTested, node.count);
+            int first = node.first;
+            if (closestHitInRange(leafX0.data() + first, leafY0.data() + first, leafDX.data() + first, leafDY.data() + first, node.count, origin, ray, t) >= 0 && t < maxT)
+            {
+                return true;
+            }
+            continue;
+        }
+        stack[stackSize++] = node.first + 1;
+        stack[stackSize++] = node.first;
+    }
+    return false;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "segmentstore.h"
+
+// what the RayCaster inner loop keeps for a ray
+struct RayHit
+{
+    Vec2 point;
+    float distance;
+    Segment segment;
+    int segmentIndex;
+};
+
+struct BVHNode
+{
+    float minX, minY, maxX, maxY;
+    int first;  // inner node: index of the left child (the right one follows it), leaf: first entry in indices
+    int count;  // 0 for inner nodes
+};
+
+// bounding volume hierarchy over the edges of a SegmentStore, built with a binned SAH
+// adapts to levels mixing dense interiors with large empty areas, where a uniform grid wastes cells
+struct SegmentBVH
+{
+    std::vector<BVHNode> nodes;     // nodes[0] is the root, children always come after their parent
+    std::vector<int> indices;       // segment indices, grouped per leaf
+    // copies of the edges in index order, so a leaf is one contiguous run for the batched ray kernel
+    std::vector<float> leafX0, leafY0, leafDX, leafDY;
+
+    // deepest leaf build makes, the traversal stacks are sized for it (a loaded tree must not go deeper)
+    static const int maxDepth = 60;
+
+    // only the shape edges go in the tree, the screen edges would stretch the top boxes over the whole level,
+    // the queries test them on their own first and walk the tree only up to their hit
+    void build(const SegmentStore& segments);
+
+    // recomputes every bound after the segments moved, keeps the tree topology
+    // (the store must hold the same edges in the same order)
+    void refit(const SegmentStore& segments);
+
+    // fills the leaf copies from indices, build and refit call it, a tree filled in some other way (a loaded level file) must too
+    void copyLeafEdges(const SegmentStore& segments);
+
+    bool isEmpty() const { return nodes.empty(); }
+
+    // nearest edge hit by origin + t * ray
+    bool closestHit(const SegmentStore& segments, Vec2 origin, Vec2 ray, float& hitT, int& hitSegment) const;
+    bool closestHit(const SegmentStore& segments, Vec2 origin, Vec2 ray, RayHit& hit) const;
+
+    // starts a selection of the edges with keep[edge] set, one run per node
+    void beginSelection(const uint8_t* keep, EdgeSelection& selection) const;
+    // closestHit over a selection begun on this tree, the edges left out are never tested (the screen edges always are)
+    bool closestHit(const SegmentStore& segments, EdgeSelection& selection, Vec2 origin, Vec2 ray, float& hitT, int& hitSegment) const;
+
+    // true as soon as any edge is hit with t < maxT, for occlusion tests (origin -> origin + ray with maxT = 1)
+    bool anyHit(const SegmentStore& segments, Vec2 origin, Vec2 ray, float maxT) const;
+};
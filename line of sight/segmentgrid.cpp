@@ -0,0 +1,357 @@
+#include "segmentgrid.h"
+#include "profiler.h"
+#include "raykernel.h"
+
+#include <algorithm>
+#include <cfloat>
+
+static const int maxGridSide = 2048;
+
+int SegmentGrid::cellX(float x) const
+{
+    int c = (int)std::floor((x - originX) * inverseCellSize);
+    return std::min(std::max(c, 0), columns - 1);
+}
+
+int SegmentGrid::cellY(float y) const
+{
+    int c = (int)std::floor((y - originY) * inverseCellSize);
+    return std::min(std::max(c, 0), rows - 1);
+}
+
+bool segmentOverlapsBox(float x0, float y0, float dx, float dy, float minX, float minY, float maxX, float maxY)
+{
+    if (std::fmax(x0, x0 + dx) < minX || std::fmin(x0, x0 + dx) > maxX)
+        return false;
+    if (std::fmax(y0, y0 + dy) < minY || std::fmin(y0, y0 + dy) > maxY)
+        return false;
+
+    // box corners must not all lie on the same side of the segment's line
+    float c1 = dx * (minY - y0) - dy * (minX - x0);
+    float c2 = dx * (minY - y0) - dy * (maxX - x0);
+    float c3 = dx * (maxY - y0) - dy * (minX - x0);
+    float c4 = dx * (maxY - y0) - dy * (maxX - x0);
+    if (c1 > 0 && c2 > 0 && c3 > 0 && c4 > 0)
+        return false;
+    if (c1 < 0 && c2 < 0 && c3 < 0 && c4 < 0)
+        return false;
+    return true;
+}
+
+// counting sort of (cell, item) pairs into the compressed cell lists
+static void fillCells(int cellCount, const std::vector<int>& pairCells, const std::vector<int>& pairItems, std::vector<int>& start, std::vector<int>& items)
+{
+    start.assign(cellCount + 1, 0);
+    for (size_t i = 0; i < pairCells.size(); i++)
+    {
+        start[pairCells[i] + 1]++;
+    }
+    for (int c = 0; c < cellCount; c++)
+    {
+        start[c + 1] += start[c];
+    }
+    items.resize(pairItems.size());
+    std::vector<int> cursor(start.begin(), start.end() - 1);
+    // pairs are generated in item order, so every cell list ends up sorted by index
+    for (size_t i = 0; i < pairCells.size(); i++)
+    {
+        items[cursor[pairCells[i]]++] = pairItems[i];
+    }
+}
+
+void SegmentGrid::build(const SegmentStore& segments, float requestedCellSize)
+{
+    columns = 0;
+    rows = 0;
+    cellStart.clear();
+    cellSegments.clear();
+    cellX0.clear();
+    cellY0.clear();
+    cellDX.clear();
+    cellDY.clear();
+    cellShapeStart.clear();
+    cellShapes.clear();
+
+    int count = segments.size();
+    if (count == 0)
+    {
+        return;
+    }
+
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+    for (int i = 0; i < count; i++)
+    {
+        minX = std::fmin(minX, std::fmin(segments.x0[i], segments.x0[i] + segments.dx[i]));
+        maxX = std::fmax(maxX, std::fmax(segments.x0[i], segments.x0[i] + segments.dx[i]));
+        minY = std::fmin(minY, std::fmin(segments.y0[i], segments.y0[i] + segments.dy[i]));
+        maxY = std::fmax(maxY, std::fmax(segments.y0[i], segments.y0[i] + segments.dy[i]));
+    }
+    float width = std::fmax(maxX - minX, 1.0f);
+    float height = std::fmax(maxY - minY, 1.0f);
+
+    cellSize = requestedCellSize;
+    if (cellSize <= 0.0f)
+    {
+        cellSize = std::sqrt(2.0f * width * height / count);
+    }
+    cellSize = std::fmax(cellSize, std::fmax(width, height) / maxGridSide);
+
+    originX = minX;
+    originY = minY;
+    inverseCellSize = 1.0f / cellSize;
+    columns = std::max(1, (int)std::ceil(width * inverseCellSize));
+    rows = std::max(1, (int)std::ceil(height * inverseCellSize));
+    int cellCount = columns * rows;
+
+    // edges go into every cell they cross, with a little slack so hits on cell borders are never missed
+    float slack = cellSize * 1e-3f;
+    std::vector<int> pairCells, pairItems;
+    for (int i = 0; i < count; i++)
+    {
+        float x0 = segments.x0[i], y0 = segments.y0[i], dx = segments.dx[i], dy = segments.dy[i];
+        int firstX = cellX(std::fmin(x0, x0 + dx) - slack), lastX = cellX(std::fmax(x0, x0 + dx) + slack);
+        int firstY = cellY(std::fmin(y0, y0 + dy) - slack), lastY = cellY(std::fmax(y0, y0 + dy) + slack);
+        for (int cy = firstY; cy <= lastY; cy++)
+        {
+            for (int cx = firstX; cx <= lastX; cx++)
+            {
+                float boxX = originX + cx * cellSize;
+                float boxY = originY + cy * cellSize;
+                if (segmentOverlapsBox(x0, y0, dx, dy, boxX - slack, boxY - slack, boxX + cellSize + slack, boxY + cellSize + slack))
+                {
+                    pairCells.push_back(cy * columns + cx);
+                    pairItems.push_back(i);
+                }
+            }
+        }
+    }
+    fillCells(cellCount, pairCells, pairItems, cellStart, cellSegments);
+    cellX0.resize(cellSegments.size());
+    cellY0.resize(cellSegments.size());
+    cellDX.resize(cellSegments.size());
+    cellDY.resize(cellSegments.size());
+    for (size_t k = 0; k < cellSegments.size(); k++)
+    {
+        int i = cellSegments[k];
+        cellX0[k] = segments.x0[i];
+        cellY0[k] = segments.y0[i];
+        cellDX[k] = segments.dx[i];
+        cellDY[k] = segments.dy[i];
+    }
+
+    // shapes go into every cell their bounding box touches
+    pairCells.clear();
+    pairItems.clear();
+    for (int s = 0; s < segments.shapeCount(); s++)
+    {
+        int first = segments.shapeStart[s], last = segments.shapeStart[s + 1];
+        if (first == last)
+        {
+            continue;
+        }
+        float shapeMinX = FLT_MAX, shapeMinY = FLT_MAX, shapeMaxX = -FLT_MAX, shapeMaxY = -FLT_MAX;
+        for (int i = first; i < last; i++)
+        {
+            shapeMinX = std::fmin(shapeMinX, segments.x0[i]);
+            shapeMaxX = std::fmax(shapeMaxX, segments.x0[i]);
+            shapeMinY = std::fmin(shapeMinY, segments.y0[i]);
+            shapeMaxY = std::fmax(shapeMaxY, segments.y0[i]);
+        }
+        for (int cy = cellY(shapeMinY); cy <= cellY(shapeMaxY); cy++)
+        {
+            for (int cx = cellX(shapeMinX); cx <= cellX(shapeMaxX); cx++)
+            {
+                pairCells.push_back(cy * columns + cx);
+                pairItems.push_back(s);
+            }
+        }
+    }
+    fillCells(cellCount, pairCells, pairItems, cellShapeStart, cellShapes);
+}
+
+// 2D DDA: calls visit(cell, tCellExit) for every cell origin + t * ray crosses, in order, until visit returns true,
+// the ray leaves the grid or the cell exit passes tLimit
+template <typename Visit>
+static void walkCells(const SegmentGrid& grid, Vec2 origin, Vec2 ray, float tLimit, Visit visit)
+{
+    // a zero or nan ray (observer standing on a corner) would never leave its cell
+    if (grid.isEmpty() || (ray.x == 0.0f && ray.y == 0.0f) || !std::isfinite(ray.x + ray.y) || !std::isfinite(origin.x + origin.y))
+    {
+        return;
+    }
+
+    // clip the ray against the grid bounds
+    float minX = grid.originX, minY = grid.originY, cellSize = grid.cellSize;
+    float maxX = minX + grid.columns * cellSize;
+    float maxY = minY + grid.rows * cellSize;
+    float tEnter = 0.0f, tLeave = FLT_MAX;
+    if (ray.x != 0.0f)
+    {
+        float t1 = (minX - origin.x) / ray.x, t2 = (maxX - origin.x) / ray.x;
+        tEnter = std::fmax(tEnter, std::fmin(t1, t2));
+        tLeave = std::fmin(tLeave, std::fmax(t1, t2));
+    }
+    else if (origin.x < minX || origin.x > maxX)
+    {
+        return;
+    }
+    if (ray.y != 0.0f)
+    {
+        float t1 = (minY - origin.y) / ray.y, t2 = (maxY - origin.y) / ray.y;
+        tEnter = std::fmax(tEnter, std::fmin(t1, t2));
+        tLeave = std::fmin(tLeave, std::fmax(t1, t2));
+    }
+    else if (origin.y < minY || origin.y > maxY)
+    {
+        return;
+    }
+    if (tEnter > tLeave || tEnter > tLimit)
+    {
+        return;
+    }
+
+    Vec2 entry = origin + tEnter * ray;
+    int cx = grid.cellX(entry.x);
+    int cy = grid.cellY(entry.y);
+
+    int stepX = ray.x > 0 ? 1 : (ray.x < 0 ? -1 : 0);
+    int stepY = ray.y > 0 ? 1 : (ray.y < 0 ? -1 : 0);
+    float tDeltaX = stepX != 0 ? cellSize / std::abs(ray.x) : FLT_MAX;
+    float tDeltaY = stepY != 0 ? cellSize / std::abs(ray.y) : FLT_MAX;
+    float tMaxX = stepX != 0 ? (minX + (cx + (stepX > 0 ? 1 : 0)) * cellSize - origin.x) / ray.x : FLT_MAX;
+    float tMaxY = stepY != 0 ? (minY + (cy + (stepY > 0 ? 1 : 0)) * cellSize - origin.y) / ray.y : FLT_MAX;
+
+    while (true)
+    {
+        float tCellExit = std::fmin(tMaxX, tMaxY);
+        if (visit(cy * grid.columns + cx, tCellExit) || tCellExit >= tLimit)
+        {
+            return;
+        }
+
+        if (tMaxX < tMaxY)
+        {
+            cx += stepX;
+            tMaxX += tDeltaX;
+        }
+        else
+        {
+            cy += stepY;
+            tMaxY += tDeltaY;
+        }
+        if (cx < 0 || cx >= grid.columns || cy < 0 || cy >= grid.rows)
+        {
+            return;
+        }
+    }
+}
+
+// nearest hit over runs of cell entries, cellRun(cell, first, count) gives the run of a cell in x0.. and cellSegments,
+// the grid's own lists or a selection of them
+template <typename CellRun>
+static bool castRayThroughCells(const SegmentGrid& grid, CellRun cellRun, const int* cellSegments, const float* x0, const float* y0, const float* dx, const float* dy,
+    Vec2 origin, Vec2 ray, float& hitT, int& hitSegment)
+{
+    hitSegment = -1;
+    float bestT = FLT_MAX;
+    // counted once per ray, the profiler call costs more than a cell
+    int tested = 0;
+    walkCells(grid, origin, ray, FLT_MAX, [&](int cell, float tCellExit)
+    {
+        int first, count;
+        cellRun(cell, first, count);
+        float t;
+        tested += count;
+        int local = closestHitInRange(x0 + first, y0 + first, dx + first, dy + first, count, origin, ray, t);
+        if (local >= 0)
+        {
+            int segment = cellSegments[first + local];
+            if (t < bestT || (t == bestT && segment < hitSegment))
+            {
+                bestT = t;
+                hitSegment = segment;
+            }
+        }
+        // nothing in later cells can beat a hit that lies before this cell's exit
+        return hitSegment >= 0 && bestT <= tCellExit;
+    });
+    LOS_PROFILE_COUNT(CounterSegmentsTested, tested);
+
+    hitT = bestT;
+    return hitSegment >= 0;
+}
+
+bool SegmentGrid::castRay(Vec2 origin, Vec2 ray, float& hitT, int& hitSegment) const
+{
+    auto cellRun = [this](int cell, int& first, int& count)
+    {
+        first = cellStart[cell];
+        count = cellStart[cell + 1] - first;
+    };
+    return castRayThroughCells(*this, cellRun, cellSegments.data(), cellX0.data(), cellY0.data(), cellDX.data(), cellDY.data(), origin, ray, hitT, hitSegment);
+}
+
+void SegmentGrid::cellsAlong(Vec2 from, Vec2 to, std::vector<int>& cells) const
+{
+    walkCells(*this, from, to - from, 1.0f, [&](int cell, float)
+    {
+        cells.push_back(cell);
+        return false;
+    });
+}
+
+void SegmentGrid::beginSelection(const uint8_t* keep, EdgeSelection& selection) const
+{
+    selection.begin(keep, columns * rows, (int)cellSegments.size());
+}
+
+bool SegmentGrid::castRay(EdgeSelection& selection, Vec2 origin, Vec2 ray, float& hitT, int& hitSegment) const
+{
+    auto cellRun = [this, &selection](int cell, int& first, int& count)
+    {
+        selection.select(cell, cellStart[cell], cellStart[cell + 1], cellSegments.data(), cellX0.data(), cellY0.data(), cellDX.data(), cellDY.data(), first, count);
+    };
+    return castRayThroughCells(*this, cellRun, selection.segments.data(), selection.x0.data(), selection.y0.data(), selection.dx.data(), selection.dy.data(),
+        origin, ray, hitT, hitSegment);
+}
+
+bool SegmentGrid::anyHit(Vec2 origin, Vec2 ray, float maxT) const
+{
+    bool hit = false;
+    int tested = 0;
+    walkCells(*this, origin, ray, maxT, [&](int cell, float)
+    {
+        // any edge in the way will do, no need to find the nearest one
+        int first = cellStart[cell];
+        float t;
+        tested += cellStart[cell + 1] - first;
+        hit = closestHitInRange(cellX0.data() + first, cellY0.data() + first, cellDX.data() + first, cellDY.data() + first, cellStart[cell + 1] - first, origin, ray, t) >= 0 && t < maxT;
+        return hit;
+    });
+    LOS_PROFILE_COUNT(CounterSegmentsTested, tested);
+    return hit;
+}
+
+int SegmentGrid::findShapeContaining(const SegmentStore& segments, Vec2 point) const
+{
+    if (isEmpty())
+    {
+        return segments.findShapeContaining(point);
+    }
+    float maxX = originX + columns * cellSize;
+    float maxY = originY + rows * cellSize;
+    if (point.x < originX || point.x > maxX || point.y < originY || point.y > maxY)
+    {
+        return -1;
+    }
+
+    int cell = cellY(point.y) * columns + cellX(point.x);
+    for (int k = cellShapeStart[cell]; k < cellShapeStart[cell + 1]; k++)
+    {
+        if (segments.isPointInsideShape(cellShapes[k], point))
+        {
+            return cellShapes[k];
+        }
+    }
+    return -1;
+}
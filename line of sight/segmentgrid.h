@@ -0,0 +1,52 @@
+#pragma once
+
+#include "segmentstore.h"
+
+// uniform grid over a SegmentStore, each cell lists the edges crossing it and the shapes overlapping it
+// rays walk the cells with a 2D DDA and stop at the first cell that settles the nearest hit,
+// so the cost of a ray depends on the wall density around it instead of the total wall count
+struct SegmentGrid
+{
+    float originX = 0.0f;
+    float originY = 0.0f;
+    float cellSize = 1.0f;
+    float inverseCellSize = 1.0f;
+    int columns = 0;
+    int rows = 0;
+
+    // compressed cell lists, cell c owns [cellStart[c], cellStart[c + 1])
+    std::vector<int> cellStart;
+    std::vector<int> cellSegments;
+    // copies of the edges in cell order, so a cell is one contiguous run for the batched ray kernel
+    std::vector<float> cellX0, cellY0, cellDX, cellDY;
+    std::vector<int> cellShapeStart;
+    std::vector<int> cellShapes;
+
+    // cellSize <= 0 picks one from the segment density (a couple of edges per cell on average)
+    void build(const SegmentStore& segments, float cellSize = 0.0f);
+
+    bool isEmpty() const { return columns == 0 || rows == 0; }
+
+    int cellX(float x) const;
+    int cellY(float y) const;
+
+    // nearest edge hit by origin + t * ray, same acceptance rules as SegmentStore::intersect
+    bool castRay(Vec2 origin, Vec2 ray, float& hitT, int& hitSegment) const;
+
+    // starts a selection of the edges with keep[edge] set, one run per cell
+    void beginSelection(const uint8_t* keep, EdgeSelection& selection) const;
+    // castRay over a selection begun on this grid, the edges left out are never tested
+    bool castRay(EdgeSelection& selection, Vec2 origin, Vec2 ray, float& hitT, int& hitSegment) const;
+
+    // true as soon as any edge is hit with t < maxT, stops walking at the first cell past maxT (occlusion tests)
+    bool anyHit(Vec2 origin, Vec2 ray, float maxT) const;
+
+    // appends every cell the segment from -> to passes through, in walking order
+    void cellsAlong(Vec2 from, Vec2 to, std::vector<int>& cells) const;
+
+    // first shape (lowest index) containing point, -1 if none
+    int findShapeContaining(const SegmentStore& segments, Vec2 point) const;
+};
+
+// segment vs axis aligned box, separating axis test on the box axes and the segment normal
+bool segmentOverlapsBox(float x0, float y0, float dx, float dy, float minX, float minY, float maxX, float maxY);
@@ -0,0 +1,144 @@
+#include "segmentstore.h"
+
+#include <algorithm>
+
+static void appendPolygon(SegmentStore& store, const Polygon& polygon)
+{
+    size_t count = polygon.size();
+    if (count < 2)
+    {
+        return;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        Vec2 start = polygon[i];
+        Vec2 edge = polygon[(i + 1) % count] - start;
+        float length = norm(edge);
+        store.x0.push_back(start.x);
+        store.y0.push_back(start.y);
+        store.dx.push_back(edge.x);
+        store.dy.push_back(edge.y);
+        store.nx.push_back(length > 0 ? -edge.y / length : 0.0f);
+        store.ny.push_back(length > 0 ? edge.x / length : 0.0f);
+    }
+}
+
+void SegmentStore::build(const std::vector<Polygon>& shapes, const Polygon& screenEdges)
+{
+    x0.clear();
+    y0.clear();
+    dx.clear();
+    dy.clear();
+    nx.clear();
+    ny.clear();
+    shapeStart.clear();
+
+    size_t total = screenEdges.size();
+    for (size_t i = 0; i < shapes.size(); i++)
+    {
+        total += shapes[i].size();
+    }
+    x0.reserve(total);
+    y0.reserve(total);
+    dx.reserve(total);
+    dy.reserve(total);
+    nx.reserve(total);
+    ny.reserve(total);
+    shapeStart.reserve(shapes.size() + 1);
+
+    for (size_t i = 0; i < shapes.size(); i++)
+    {
+        shapeStart.push_back(size());
+        appendPolygon(*this, shapes[i]);
+    }
+    shapeStart.push_back(size());
+
+    screenEdgesStart = size();
+    appendPolygon(*this, screenEdges);
+    computeWindings();
+}
+
+// FNV-1a over the raw bytes, stable across runs on the same platform
+static uint64_t hashBytes(uint64_t hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+void SegmentStore::loopOf(int i, int& first, int& last) const
+{
+    if (i >= screenEdgesStart)
+    {
+        first = screenEdgesStart;
+        last = size();
+        return;
+    }
+    int shape = shapeOf(i);
+    first = shapeStart[shape];
+    last = shapeStart[shape + 1];
+}
+
+int SegmentStore::shapeOf(int i) const
+{
+    if (i >= screenEdgesStart)
+    {
+        return -1;
+    }
+    // last shape starting at or before i
+    return (int)(std::upper_bound(shapeStart.begin(), shapeStart.end(), i) - shapeStart.begin()) - 1;
+}
+
+void SegmentStore::computeWindings()
+{
+    windings.resize(shapeCount());
+    for (int shape = 0; shape < shapeCount(); shape++)
+    {
+        // twice the signed area, positive when the inside is to the left of the edges, where the normals point
+        double area = 0.0;
+        for (int i = shapeStart[shape]; i < shapeStart[shape + 1]; i++)
+        {
+            area += (double)x0[i] * dy[i] - (double)y0[i] * dx[i];
+        }
+        windings[shape] = (int8_t)((area > 0.0) - (area < 0.0));
+    }
+}
+
+void EdgeSelection::begin(const uint8_t* keepEdge, int runs, int entries)
+{
+    keep = keepEdge;
+    pass++;
+    // another structure or a wrapped counter, no stamp left may match the pass
+    if ((int)runPass.size() != runs || pass == 0)
+    {
+        runPass.assign(runs, 0);
+        runFirst.resize(runs);
+        runCount.resize(runs);
+        pass = 1;
+    }
+    if ((int)segments.size() != entries)
+    {
+        segments.resize(entries);
+        x0.resize(entries);
+        y0.resize(entries);
+        dx.resize(entries);
+        dy.resize(entries);
+    }
+    used = 0;
+}
+
+uint64_t SegmentStore::fingerprint() const
+{
+    uint64_t hash = 14695981039346656037ull;
+    hash = hashBytes(hash, x0.data(), x0.size() * sizeof(float));
+    hash = hashBytes(hash, y0.data(), y0.size() * sizeof(float));
+    hash = hashBytes(hash, dx.data(), dx.size() * sizeof(float));
+    hash = hashBytes(hash, dy.data(), dy.size() * sizeof(float));
+    hash = hashBytes(hash, shapeStart.data(), shapeStart.size() * sizeof(int));
+    hash = hashBytes(hash, &screenEdgesStart, sizeof(screenEdgesStart));
+    return hash;
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include "geometry.h"
+
+#include <cstdint>
+
+// flattened structure-of-arrays copy of every level edge
+// built once when the level loads, rebuilt only when the geometry changes
+// shape edges come first (shape i owns [shapeStart[i], shapeStart[i + 1])), the screen edges follow
+struct SegmentStore
+{
+    std::vector<float> x0, y0;      // start point
+    std::vector<float> dx, dy;      // end point - start point
+    std::vector<float> nx, ny;      // unit normal, edge rotated left by 90 deg
+    std::vector<int> shapeStart;    // shapes.size() + 1 entries
+    std::vector<int8_t> windings;   // per shape, see windingOf
+    int screenEdgesStart = 0;
+
+    void build(const std::vector<Polygon>& shapes, const Polygon& screenEdges);
+    // fills windings from the edges, build calls it, stores filled in some other way (a loaded level file) must too
+    void computeWindings();
+
+    int size() const { return (int)x0.size(); }
+    int shapeCount() const { return (int)shapeStart.size() - 1; }
+
+    // the closed loop (a shape or the screen edges) edge i belongs to, [first, last)
+    void loopOf(int i, int& first, int& last) const;
+    // shape owning edge i, -1 for a screen edge
+    int shapeOf(int i) const;
+
+    // +1 when the shape's inside lies on the side its normals point to, -1 when on the other side,
+    // 0 for a shape without area (a wall drawn as a line)
+    int windingOf(int shape) const { return windings[shape]; }
+
+    // the outer side of edge i faces point, winding is the edge's shape's (see windingOf)
+    // an edge seen edge-on faces nothing, an edge of a shape without area faces everything
+    bool facesPoint(int i, int winding, Vec2 point) const
+    {
+        float side = dx[i] * (point.y - y0[i]) - dy[i] * (point.x - x0[i]);
+        return winding == 0 || winding * side < 0.0f;
+    }
+
+    // hash of every edge and the shape layout, tells whether data baked from a store still matches it
+    uint64_t fingerprint() const;
+
+    Segment getSegment(int i) const
+    {
+        return Segment{ Vec2(x0[i], y0[i]), Vec2(x0[i] + dx[i], y0[i] + dy[i]) };
+    }
+
+    // same acceptance rules as rayInstersectsSegment, t is the ray parameter of the hit
+    // (origin + t * ray), both cross products are shared between the test and the hit point
+    bool intersect(int i, Vec2 origin, Vec2 ray, float& t) const
+    {
+        float wx = x0[i] - origin.x;
+        float wy = y0[i] - origin.y;
+        float originCross = wx * dy[i] - wy * dx[i];
+        // ray origin collinear with the edge
+        if (std::abs(originCross) < 0.01f)
+        {
+            return false;
+        }
+        float denominator = ray.x * dy[i] - ray.y * dx[i];
+        if (denominator == 0.0f)
+        {
+            return false;
+        }
+        float u = (wx * ray.y - wy * ray.x) / denominator;
+        if (u < 0.0f || u > 1.0f)
+        {
+            return false;
+        }
+        t = originCross / denominator;
+        return t >= 0.0f;
+    }
+
+    bool isRightOfEdge(int i, Vec2 point) const
+    {
+        return nx[i] * (point.x - x0[i]) + ny[i] * (point.y - y0[i]) > 0;
+    }
+
+    // point strictly on the same side of every edge of the shape
+    bool isPointInsideShape(int shape, Vec2 point) const
+    {
+        int first = shapeStart[shape];
+        int last = shapeStart[shape + 1];
+        if (first == last)
+        {
+            return false;
+        }
+        bool side = isRightOfEdge(first, point);
+        for (int i = first + 1; i < last; i++)
+        {
+            if (isRightOfEdge(i, point) != side)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // index of the first shape containing point, -1 if none
+    int findShapeContaining(Vec2 point) const
+    {
+        for (int i = 0; i < shapeCount(); i++)
+        {
+            if (isPointInsideShape(i, point))
+            {
+                return i;
+            }
+        }
+        return -1;
+    }
+};
+
+// runs of edge entries (grid cells, BVH leaves) cut down to the edges with keep[edge] set, for the rays of one pass
+// a run is filtered the first time a ray of the pass asks for it, the runs no ray reaches are never copied
+struct EdgeSelection
+{
+    const uint8_t* keep = nullptr;
+    unsigned pass = 0;
+    // run r was filtered in this pass when runPass[r] == pass, it then owns [runFirst[r], runFirst[r] + runCount[r])
+    std::vector<unsigned> runPass;
+    std::vector<int> runFirst, runCount;
+    // sized for every entry of the source once, filled up to used, so the pointers hold for the whole pass
+    std::vector<int> segments;
+    std::vector<float> x0, y0, dx, dy;
+    int used = 0;
+
+    // keep must outlive the pass, a selection only stays valid with the structure it was begun on
+    void begin(const uint8_t* keepEdge, int runs, int entries);
+
+    // the kept entries of run, filtered out of the source entries [sourceFirst, sourceLast) on the first call of the pass
+    void select(int run, int sourceFirst, int sourceLast, const int* sourceSegments, const float* sourceX0, const float* sourceY0,
+        const float* sourceDX, const float* sourceDY, int& first, int& count)
+    {
+        if (runPass[run] != pass)
+        {
+            int kept = used;
+            for (int k = sourceFirst; k < sourceLast; k++)
+            {
+                if (keep[sourceSegments[k]])
+                {
+                    segments[kept] = sourceSegments[k];
+                    x0[kept] = sourceX0[k];
+                    y0[kept] = sourceY0[k];
+                    dx[kept] = sourceDX[k];
+                    dy[kept] = sourceDY[k];
+                    kept++;
+                }
+            }
+            runPass[run] = pass;
+            runFirst[run] = used;
+            runCount[run] = kept - used;
+            used = kept;
+        }
+        first = runFirst[run];
+        count = runCount[run];
+    }
+};
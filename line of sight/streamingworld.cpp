@@ -0,0 +1,582 @@
+#include "streamingworld.h"
+#include "levelfile.h"
+#include "logger.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+// ===== ===== =====
+// WRITING CHUNKS
+// ===== ===== =====
+
+// keeps the side of the line x = limit (axis 0) or y = limit (axis 1) given by keepAbove, one Sutherland-Hodgman pass
+static void clipPolygonAxis(const Polygon& input, int axis, float limit, bool keepAbove, Polygon& output)
+{
+    output.clear();
+    for (size_t i = 0; i < input.size(); i++)
+    {
+        Vec2 current = input[i];
+        Vec2 next = input[(i + 1) % input.size()];
+        float a = (axis == 0 ? current.x : current.y) - limit;
+        float b = (axis == 0 ? next.x : next.y) - limit;
+        bool currentInside = keepAbove ? a >= 0.0f : a <= 0.0f;
+        bool nextInside = keepAbove ? b >= 0.0f : b <= 0.0f;
+        if (currentInside)
+        {
+            output.push_back(current);
+        }
+        if (currentInside != nextInside)
+        {
+            Vec2 crossing = current + (a / (a - b)) * (next - current);
+            // snap onto the border exactly, so pieces of one shape in neighbouring chunks meet without gaps
+            (axis == 0 ? crossing.x : crossing.y) = limit;
+            output.push_back(crossing);
+        }
+    }
+}
+
+static float polygonArea(const Polygon& polygon)
+{
+    float area = 0.0f;
+    for (size_t i = 0; i < polygon.size(); i++)
+    {
+        area += cross2D(polygon[i], polygon[(i + 1) % polygon.size()]);
+    }
+    return 0.5f * std::fabs(area);
+}
+
+static Polygon chunkSquare(Vec2 low, Vec2 high)
+{
+    return { low, Vec2(high.x, low.y), high, Vec2(low.x, high.y) };
+}
+
+bool writeChunkedWorld(const Level& source, float chunkSize, const char* directory)
+{
+    if (!(chunkSize > 0.0f) || source.screenEdges.empty())
+    {
+        return false;
+    }
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error)
+    {
+        return false;
+    }
+
+    float originX = source.boundsMin.x;
+    float originY = source.boundsMin.y;
+    int columns = std::max(1, (int)std::ceil((source.boundsMax.x - originX) / chunkSize));
+    int rows = std::max(1, (int)std::ceil((source.boundsMax.y - originY) / chunkSize));
+
+    // clipped pieces of every shape, bucketed by chunk
+    std::vector<std::vector<Polygon>> chunkShapes(columns * rows);
+    Polygon clipped, scratch;
+    for (size_t s = 0; s < source.shapes.size(); s++)
+    {
+        const Polygon& shape = source.shapes[s];
+        if (shape.size() < 3)
+        {
+            continue;
+        }
+        Vec2 low = shape[0], high = shape[0];
+        for (size_t i = 1; i < shape.size(); i++)
+        {
+            low = Vec2(std::min(low.x, shape[i].x), std::min(low.y, shape[i].y));
+            high = Vec2(std::max(high.x, shape[i].x), std::max(high.y, shape[i].y));
+        }
+        int firstX = std::max(0, (int)std::floor((low.x - originX) / chunkSize));
+        int firstY = std::max(0, (int)std::floor((low.y - originY) / chunkSize));
+        int lastX = std::min(columns - 1, (int)std::floor((high.x - originX) / chunkSize));
+        int lastY = std::min(rows - 1, (int)std::floor((high.y - originY) / chunkSize));
+        for (int cy = firstY; cy <= lastY; cy++)
+        {
+            for (int cx = firstX; cx <= lastX; cx++)
+            {
+                float x0 = originX + cx * chunkSize;
+                float y0 = originY + cy * chunkSize;
+                clipPolygonAxis(shape, 0, x0, true, clipped);
+                clipPolygonAxis(clipped, 0, x0 + chunkSize, false, scratch);
+                clipPolygonAxis(scratch, 1, y0, true, clipped);
+                clipPolygonAxis(clipped, 1, y0 + chunkSize, false, scratch);
+                // shapes only touching the chunk border clip down to a sliver with no area
+                if (scratch.size() >= 3 && polygonArea(scratch) > 1e-4f * chunkSize)
+                {
+                    chunkShapes[cy * columns + cx].push_back(scratch);
+                }
+            }
+        }
+    }
+
+    std::string root = directory;
+    std::ofstream manifest(root + "/world.txt");
+    if (!manifest)
+    {
+        return false;
+    }
+    manifest.precision(9);
+    manifest << "world " << originX << " " << originY << " " << chunkSize << " " << columns << " " << rows << "\n";
+    for (int c = 0; c < columns * rows; c++)
+    {
+        if (chunkShapes[c].empty())
+        {
+            continue;
+        }
+        int cx = c % columns;
+        int cy = c / columns;
+        Vec2 low(originX + cx * chunkSize, originY + cy * chunkSize);
+        Level chunk;
+        chunk.shapes = std::move(chunkShapes[c]);
+        chunk.screenEdges = chunkSquare(low, low + Vec2(chunkSize, chunkSize));
+        chunk.segments.build(chunk.shapes, chunk.screenEdges);
+        // streamed chunks only ever contribute polygons, the assembled level builds its own grid and bvh
+        std::ostringstream name;
+        name << root << "/chunk_" << cx << "_" << cy << ".lvl";
+        if (!saveLevelFile(chunk, name.str().c_str(), false))
+        {
+            return false;
+        }
+        manifest << "chunk " << cx << " " << cy << "\n";
+    }
+    return (bool)manifest;
+}
+
+// ===== ===== =====
+// STREAMING
+// ===== ===== =====
+
+StreamingWorld::~StreamingWorld()
+{
+    close();
+}
+
+bool StreamingWorld::open(const char* path)
+{
+    close();
+
+    std::string root = path;
+    std::ifstream manifest(root + "/world.txt");
+    std::string line, keyword;
+    if (!std::getline(manifest, line))
+    {
+        return false;
+    }
+    std::istringstream header(line);
+    if (!(header >> keyword >> originX >> originY >> chunkSize >> columns >> rows) || keyword != "world" ||
+        !(chunkSize > 0.0f) || columns <= 0 || rows <= 0 || (int64_t)columns * rows > (1 << 28))
+    {
+        columns = rows = 0;
+        return false;
+    }
+    chunkHasFile.assign(columns * rows, 0);
+    while (std::getline(manifest, line))
+    {
+        std::istringstream words(line);
+        int cx, cy;
+        if (words >> keyword >> cx >> cy && keyword == "chunk" && cx >= 0 && cx < columns && cy >= 0 && cy < rows)
+        {
+            chunkHasFile[cy * columns + cx] = 1;
+        }
+    }
+
+    directory = root;
+    stopping = false;
+    loader = std::thread(&StreamingWorld::loaderLoop, this);
+    return true;
+}
+
+void StreamingWorld::close()
+{
+    if (loader.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        loader.join();
+    }
+    jobs.clear();
+    loaded.clear();
+    assembled.reset();
+    chunks.clear();
+    cachedBytes = 0;
+    assembledChunks.clear();
+    levelChunks.clear();
+    requestedAssembly = appliedAssembly = assembledId = 0;
+    settled = false;
+    frontierShapeStart = 0;
+    level = Level();
+}
+
+std::string StreamingWorld::chunkPath(int chunk) const
+{
+    std::ostringstream name;
+    name << directory << "/chunk_" << chunk % columns << "_" << chunk / columns << ".lvl";
+    return name.str();
+}
+
+void StreamingWorld::post(Job job)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    wake.notify_one();
+}
+
+void StreamingWorld::loaderLoop()
+{
+    while (true)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || !jobs.empty(); });
+            if (stopping)
+            {
+                return;
+            }
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        if (job.retired)
+        {
+            // old levels are freed here, a large level takes a while to give back
+            continue;
+        }
+
+        if (job.chunk >= 0)
+        {
+            LOS_PROFILE_ZONE("load chunk");
+            std::shared_ptr<std::vector<Polygon>> shapes = std::make_shared<std::vector<Polygon>>();
+            Polygon chunkEdges;
+            if (!loadLevelShapes(chunkPath(job.chunk).c_str(), *shapes, chunkEdges))
+            {
+                LOS_LOG(LogWarning, "chunk {} failed to load, it stays behind the frontier", job.chunk);
+                shapes.reset();
+            }
+            else
+            {
+                LOS_LOG(LogDebug, "chunk {} loaded, {} shapes", job.chunk, shapes->size());
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                loaded.push_back({ job.chunk, std::move(shapes) });
+            }
+            progress.notify_all();
+            continue;
+        }
+
+        LOS_PROFILE_ZONE("assemble level");
+        std::unique_ptr<Level> level(new Level());
+        size_t shapeCount = job.frontier.size();
+        for (size_t i = 0; i < job.shapes.size(); i++)
+        {
+            shapeCount += job.shapes[i]->size();
+        }
+        level->shapes.reserve(shapeCount);
+        for (size_t i = 0; i < job.shapes.size(); i++)
+        {
+            level->shapes.insert(level->shapes.end(), job.shapes[i]->begin(), job.shapes[i]->end());
+        }
+        int frontierStart = (int)level->shapes.size();
+        for (size_t i = 0; i < job.frontier.size(); i++)
+        {
+            int chunk = job.frontier[i];
+            Vec2 low(originX + (chunk % columns) * chunkSize, originY + (chunk / columns) * chunkSize);
+            level->shapes.push_back(chunkSquare(low, low + Vec2(chunkSize, chunkSize)));
+        }
+        level->screenEdges = chunkSquare(job.boundsMin, job.boundsMax);
+        rebuildSegments(*level);
+
+        std::unique_ptr<Level> superseded;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            superseded = std::move(assembled);
+            assembled = std::move(level);
+            assembledId = job.assembly;
+            assembledFrontierStart = frontierStart;
+        }
+        progress.notify_all();
+    }
+}
+
+void StreamingWorld::wantedChunks(const std::vector<Vec2>& observers, std::vector<int>& wanted) const
+{
+    wanted.clear();
+    for (size_t i = 0; i < observers.size(); i++)
+    {
+        Vec2 p = observers[i];
+        int firstX = std::max(0, (int)std::floor((p.x - streamRadius - originX) / chunkSize));
+        int firstY = std::max(0, (int)std::floor((p.y - streamRadius - originY) / chunkSize));
+        int lastX = std::min(columns - 1, (int)std::floor((p.x + streamRadius - originX) / chunkSize));
+        int lastY = std::min(rows - 1, (int)std::floor((p.y + streamRadius - originY) / chunkSize));
+        for (int cy = firstY; cy <= lastY; cy++)
+        {
+            for (int cx = firstX; cx <= lastX; cx++)
+            {
+                // distance from the observer to the chunk rectangle
+                float x0 = originX + cx * chunkSize;
+                float y0 = originY + cy * chunkSize;
+                float dx = std::max(0.0f, std::max(x0 - p.x, p.x - x0 - chunkSize));
+                float dy = std::max(0.0f, std::max(y0 - p.y, p.y - y0 - chunkSize));
+                if (dx * dx + dy * dy <= streamRadius * streamRadius)
+                {
+                    wanted.push_back(cy * columns + cx);
+                }
+            }
+        }
+    }
+    std::sort(wanted.begin(), wanted.end());
+    wanted.erase(std::unique(wanted.begin(), wanted.end()), wanted.end());
+}
+
+void StreamingWorld::collectResults()
+{
+    std::vector<LoadedChunk> results;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        results.swap(loaded);
+    }
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        Chunk& chunk = chunks[results[i].chunk];
+        chunk.loading = false;
+        chunk.failed = results[i].shapes == nullptr;
+        chunk.shapes = std::move(results[i].shapes);
+        if (chunk.shapes != nullptr)
+        {
+            // the polygons themselves plus the level arrays (segment table, grid and bvh entries) they expand to
+            size_t points = 0;
+            for (size_t s = 0; s < chunk.shapes->size(); s++)
+            {
+                points += (*chunk.shapes)[s].size();
+            }
+            chunk.bytes = chunk.shapes->size() * sizeof(Polygon) + points * (sizeof(Vec2) + 16 * sizeof(float));
+            cachedBytes += chunk.bytes;
+        }
+    }
+}
+
+void StreamingWorld::requestLoads(const std::vector<Vec2>& observers, const std::vector<int>& wanted)
+{
+    // nearest chunks first, so the ground under the observers arrives before the horizon
+    std::vector<std::pair<float, int>> missing;
+    for (size_t i = 0; i < wanted.size(); i++)
+    {
+        int index = wanted[i];
+        if (!chunkHasFile[index])
+        {
+            continue;
+        }
+        Chunk& chunk = chunks[index];
+        chunk.lastWanted = frame;
+        if (chunk.shapes != nullptr || chunk.loading || chunk.failed)
+        {
+            continue;
+        }
+        Vec2 center(originX + (index % columns + 0.5f) * chunkSize, originY + (index / columns + 0.5f) * chunkSize);
+        float nearest = FLT_MAX;
+        for (size_t k = 0; k < observers.size(); k++)
+        {
+            nearest = std::min(nearest, distanceBetweenPoints(center, observers[k]));
+        }
+        missing.push_back(std::make_pair(nearest, index));
+    }
+    std::sort(missing.begin(), missing.end());
+    for (size_t i = 0; i < missing.size(); i++)
+    {
+        chunks[missing[i].second].loading = true;
+        Job job;
+        job.chunk = missing[i].second;
+        post(std::move(job));
+    }
+}
+
+void StreamingWorld::evict()
+{
+    while (cachedBytes > memoryBudget)
+    {
+        // least recently wanted loaded chunk that nothing wants this frame
+        auto victim = chunks.end();
+        for (auto it = chunks.begin(); it != chunks.end(); ++it)
+        {
+            if (it->second.shapes != nullptr && it->second.lastWanted != frame && (victim == chunks.end() || it->second.lastWanted < victim->second.lastWanted))
+            {
+                victim = it;
+            }
+        }
+        if (victim == chunks.end())
+        {
+            // everything cached is wanted, the budget is smaller than the stream radius needs
+            return;
+        }
+        cachedBytes -= victim->second.bytes;
+        chunks.erase(victim);
+    }
+}
+
+void StreamingWorld::requestAssembly(const std::vector<int>& wanted)
+{
+    // chunks without a file are known to be empty, failed loads stay behind the frontier
+    std::vector<int> included;
+    std::vector<std::shared_ptr<const std::vector<Polygon>>> shapes;
+    for (size_t i = 0; i < wanted.size(); i++)
+    {
+        int index = wanted[i];
+        if (!chunkHasFile[index])
+        {
+            included.push_back(index);
+            continue;
+        }
+        auto it = chunks.find(index);
+        if (it != chunks.end() && it->second.shapes != nullptr)
+        {
+            included.push_back(index);
+            shapes.push_back(it->second.shapes);
+        }
+    }
+    if (included.empty() || included == assembledChunks)
+    {
+        return;
+    }
+
+    // one assembly in flight at a time, the next update asks again with whatever arrived meanwhile
+    Job job;
+    job.boundsMin = Vec2(FLT_MAX, FLT_MAX);
+    job.boundsMax = Vec2(-FLT_MAX, -FLT_MAX);
+    std::vector<int> frontier;
+    for (size_t i = 0; i < included.size(); i++)
+    {
+        int cx = included[i] % columns;
+        int cy = included[i] / columns;
+        for (int ny = std::max(0, cy - 1); ny <= std::min(rows - 1, cy + 1); ny++)
+        {
+            for (int nx = std::max(0, cx - 1); nx <= std::min(columns - 1, cx + 1); nx++)
+            {
+                int neighbour = ny * columns + nx;
+                if (!std::binary_search(included.begin(), included.end(), neighbour))
+                {
+                    frontier.push_back(neighbour);
+                }
+            }
+        }
+    }
+    std::sort(frontier.begin(), frontier.end());
+    frontier.erase(std::unique(frontier.begin(), frontier.end()), frontier.end());
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        const std::vector<int>& list = pass == 0 ? included : frontier;
+        for (size_t i = 0; i < list.size(); i++)
+        {
+            Vec2 low(originX + (list[i] % columns) * chunkSize, originY + (list[i] / columns) * chunkSize);
+            job.boundsMin = Vec2(std::min(job.boundsMin.x, low.x), std::min(job.boundsMin.y, low.y));
+            job.boundsMax = Vec2(std::max(job.boundsMax.x, low.x + chunkSize), std::max(job.boundsMax.y, low.y + chunkSize));
+        }
+    }
+
+    job.shapes = std::move(shapes);
+    job.frontier = std::move(frontier);
+    job.assembly = ++requestedAssembly;
+    assembledChunks = std::move(included);
+    post(std::move(job));
+}
+
+bool StreamingWorld::swapInAssembled()
+{
+    std::unique_ptr<Level> ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (assembled == nullptr)
+        {
+            return false;
+        }
+        ready = std::move(assembled);
+        appliedAssembly = assembledId;
+        frontierShapeStart = assembledFrontierStart;
+    }
+
+    // caches keyed on the level's address see a new version, the old arrays are freed by the loader
+    unsigned version = level.geometryVersion + 1;
+    Job job;
+    job.retired.reset(new Level(std::move(level)));
+    level = std::move(*ready);
+    level.geometryVersion = version;
+    levelChunks = assembledChunks;
+    post(std::move(job));
+    return true;
+}
+
+bool StreamingWorld::update(const std::vector<Vec2>& observers)
+{
+    if (!isOpen())
+    {
+        return false;
+    }
+    frame++;
+
+    std::vector<int> wanted;
+    wantedChunks(observers, wanted);
+    collectResults();
+    requestLoads(observers, wanted);
+    evict();
+    bool changed = swapInAssembled();
+    if (appliedAssembly == requestedAssembly)
+    {
+        requestAssembly(wanted);
+    }
+
+    settled = appliedAssembly == requestedAssembly;
+    for (size_t i = 0; settled && i < wanted.size(); i++)
+    {
+        auto it = chunks.find(wanted[i]);
+        settled = it == chunks.end() || !it->second.loading;
+    }
+    return changed;
+}
+
+void StreamingWorld::waitUntilReady(const std::vector<Vec2>& observers)
+{
+    while (isOpen())
+    {
+        update(observers);
+        if (settled)
+        {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        progress.wait(lock, [&] { return !loaded.empty() || assembled != nullptr; });
+    }
+}
+
+bool StreamingWorld::isFrontierSegment(int segment) const
+{
+    const SegmentStore& segments = level.segments;
+    if (segment < 0 || segment >= segments.size())
+    {
+        return false;
+    }
+    if (segment >= segments.screenEdgesStart)
+    {
+        // the level's own bounds only count where they are not the world's
+        Vec2 middle(segments.x0[segment] + 0.5f * segments.dx[segment], segments.y0[segment] + 0.5f * segments.dy[segment]);
+        Vec2 low = worldMin(), high = worldMax();
+        return middle.x != low.x && middle.x != high.x && middle.y != low.y && middle.y != high.y;
+    }
+    return frontierShapeStart < segments.shapeCount() && segment >= segments.shapeStart[frontierShapeStart];
+}
+
+bool StreamingWorld::isChunkResident(int chunkX, int chunkY) const
+{
+    if (chunkX < 0 || chunkX >= columns || chunkY < 0 || chunkY >= rows)
+    {
+        return false;
+    }
+    return std::binary_search(levelChunks.begin(), levelChunks.end(), chunkY * columns + chunkX);
+}
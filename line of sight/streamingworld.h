@@ -0,0 +1,133 @@
+#pragma once
+
+#include "level.h"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+// ===== ===== =====
+// CHUNKED WORLDS
+// ===== ===== =====
+// a world directory holds a world.txt manifest and one chunk_<x>_<y>.lvl per chunk that has any geometry
+// manifest lines: "world originX originY chunkSize columns rows", then "chunk x y" for every chunk file
+// shapes crossing chunk borders are clipped, so every chunk owns its pieces and chunks never overlap
+
+// splits source into square chunks of chunkSize over its bounds and writes them to directory (created if missing)
+bool writeChunkedWorld(const Level& source, float chunkSize, const char* directory);
+
+// level made of the chunks around a set of observers, streamed from a chunked world directory
+// chunks within streamRadius of any observer are loaded on a background thread and the level is reassembled
+// there too, update only swaps the finished level in, so the frame never waits on the disk or on a rebuild
+// loaded chunks stay cached after they are left behind and the least recently wanted ones are dropped once
+// residentBytes goes over memoryBudget
+// every chunk next to the assembled ones that is not in the level is closed off by a "frontier" square, so
+// rays and movers stop where the known world ends instead of passing through geometry that isn't loaded
+class StreamingWorld
+{
+public:
+    float streamRadius = 1200.0f;
+    size_t memoryBudget = (size_t)64 << 20;
+
+    // assembled geometry, replaced (with a higher geometryVersion) by the update that swaps a new one in
+    Level level;
+
+    StreamingWorld() = default;
+    ~StreamingWorld();
+
+    StreamingWorld(const StreamingWorld&) = delete;
+    StreamingWorld& operator=(const StreamingWorld&) = delete;
+
+    // reads the manifest and starts the loader thread, false if there is no valid world.txt
+    bool open(const char* directory);
+    // stops the loader and drops every chunk and the level
+    void close();
+    bool isOpen() const { return loader.joinable(); }
+
+    // once per frame: queues the missing chunks nearest first, evicts over budget and swaps in the newest
+    // assembled level, returns true when level changed
+    bool update(const std::vector<Vec2>& observers);
+
+    // blocks until every chunk the observers want is loaded and in level (loading screens, teleports)
+    void waitUntilReady(const std::vector<Vec2>& observers);
+
+    // edges of the frontier squares and level bounds inside the world, a ray that hits one ran into world that isn't loaded
+    bool isFrontierSegment(int segment) const;
+    bool isChunkResident(int chunkX, int chunkY) const;
+    size_t residentBytes() const { return cachedBytes; }
+
+    Vec2 worldMin() const { return Vec2(originX, originY); }
+    Vec2 worldMax() const { return Vec2(originX + columns * chunkSize, originY + rows * chunkSize); }
+
+private:
+    struct Chunk
+    {
+        std::shared_ptr<const std::vector<Polygon>> shapes;   // null while loading
+        size_t bytes = 0;
+        unsigned lastWanted = 0;
+        bool loading = false;
+        bool failed = false;
+    };
+
+    // what the loader thread works on, in order
+    struct Job
+    {
+        int chunk = -1;                                                     // load this chunk
+        std::vector<std::shared_ptr<const std::vector<Polygon>>> shapes;    // or assemble a level from these
+        std::vector<int> frontier;                                          // and these frontier chunks
+        Vec2 boundsMin, boundsMax;
+        unsigned assembly = 0;
+        std::unique_ptr<Level> retired;                                     // or just free an old level
+    };
+
+    struct LoadedChunk
+    {
+        int chunk;
+        std::shared_ptr<const std::vector<Polygon>> shapes;
+    };
+
+    void loaderLoop();
+    void post(Job job);
+    void wantedChunks(const std::vector<Vec2>& observers, std::vector<int>& wanted) const;
+    void collectResults();
+    void requestLoads(const std::vector<Vec2>& observers, const std::vector<int>& wanted);
+    void evict();
+    void requestAssembly(const std::vector<int>& wanted);
+    bool swapInAssembled();
+    std::string chunkPath(int chunk) const;
+
+    std::string directory;
+    float originX = 0.0f;
+    float originY = 0.0f;
+    float chunkSize = 1.0f;
+    int columns = 0;
+    int rows = 0;
+    std::vector<uint8_t> chunkHasFile;
+
+    // main thread state
+    std::unordered_map<int, Chunk> chunks;
+    size_t cachedBytes = 0;
+    unsigned frame = 0;
+    std::vector<int> assembledChunks;      // sorted chunk indices of the last requested assembly
+    std::vector<int> levelChunks;          // sorted chunk indices that make up level
+    unsigned requestedAssembly = 0;
+    unsigned appliedAssembly = 0;
+    bool settled = false;                  // last update found nothing loading and level up to date
+    int frontierShapeStart = 0;            // shapes at and after this index in level are frontier squares
+
+    // shared with the loader thread
+    std::thread loader;
+    std::mutex mutex;
+    std::condition_variable wake;          // new job or stopping
+    std::condition_variable progress;      // new result
+    std::deque<Job> jobs;
+    std::vector<LoadedChunk> loaded;
+    std::unique_ptr<Level> assembled;
+    unsigned assembledId = 0;
+    int assembledFrontierStart = 0;
+    bool stopping = false;
+};
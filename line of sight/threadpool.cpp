@@ -0,0 +1,150 @@
+#include "threadpool.h"
+#include "profiler.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(int threadCount)
+{
+    if (threadCount <= 0)
+    {
+        threadCount = std::max(1, (int)std::thread::hardware_concurrency());
+    }
+    for (int i = 0; i < threadCount; i++)
+    {
+        queues.push_back(std::unique_ptr<WorkQueue>(new WorkQueue()));
+    }
+    // the calling thread acts as the last worker
+    for (int i = 0; i < threadCount - 1; i++)
+    {
+        threads.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (size_t i = 0; i < threads.size(); i++)
+    {
+        threads[i].join();
+    }
+}
+
+ThreadPool& ThreadPool::shared()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+bool ThreadPool::popOrSteal(int worker, Range& range)
+{
+    {
+        WorkQueue& own = *queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.empty())
+        {
+            range = own.ranges.back();
+            own.ranges.pop_back();
+            return true;
+        }
+    }
+    for (int i = 1; i < size(); i++)
+    {
+        WorkQueue& victim = *queues[(worker + i) % size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.empty())
+        {
+            range = victim.ranges[victim.front++];
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::runChunks(int worker)
+{
+    Range range;
+    while (remainingChunks.load(std::memory_order_acquire) > 0 && popOrSteal(worker, range))
+    {
+        LOS_PROFILE_ZONE("parallelFor chunk");
+        job.invoke(job.context, range.begin, range.end, worker);
+        remainingChunks.fetch_sub(1, std::memory_order_acq_rel);
+    }
+}
+
+void ThreadPool::workerLoop(int worker)
+{
+    unsigned seenGeneration = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            wake.wait(lock, [&] { return stopping || generation != seenGeneration; });
+            if (stopping)
+            {
+                return;
+            }
+            seenGeneration = generation;
+            busyWorkers++;
+        }
+
+        runChunks(worker);
+
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            busyWorkers--;
+        }
+        finished.notify_all();
+    }
+}
+
+void ThreadPool::run(int count, int grain, Job body)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+    grain = std::max(1, grain);
+
+    int self = size() - 1;
+    if (size() == 1 || count <= grain)
+    {
+        body.invoke(body.context, 0, count, self);
+        return;
+    }
+
+    std::lock_guard<std::mutex> jobLock(jobMutex);
+
+    // deal the chunks round robin, stealing evens out whatever imbalance is left
+    int chunks = 0;
+    for (int begin = 0; begin < count; begin += grain)
+    {
+        WorkQueue& queue = *queues[chunks % size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.empty())
+        {
+            queue.ranges.clear();
+            queue.front = 0;
+        }
+        queue.ranges.push_back({ begin, std::min(count, begin + grain) });
+        chunks++;
+    }
+
+    job = body;
+    remainingChunks.store(chunks, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        generation++;
+    }
+    wake.notify_all();
+
+    runChunks(self);
+
+    // wait for the last chunks and for every worker to leave the job before body goes out of scope
+    std::unique_lock<std::mutex> lock(wakeMutex);
+    finished.wait(lock, [&] { return remainingChunks.load(std::memory_order_acquire) == 0 && busyWorkers == 0; });
+    job = { nullptr, nullptr };
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fixed set of worker threads sharing range jobs through work stealing
+// every worker owns a deque of chunks, pops from its back and steals from the front of the others when empty
+// the thread calling parallelFor works as the last worker, so a pool of size 1 runs everything inline
+class ThreadPool
+{
+public:
+    // threadCount <= 0 uses every hardware thread
+    explicit ThreadPool(int threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // workers including the calling thread, worker indices passed to jobs are in [0, size())
+    int size() const { return (int)queues.size(); }
+
+    // runs body(begin, end, worker) over [0, count) in chunks of at most grain items, returns when all chunks ran
+    // calls from several threads at once are serialized
+    // body is called through a plain pointer, never copied into a std::function, so a call allocates nothing
+    template <typename Body>
+    void parallelFor(int count, int grain, const Body& body)
+    {
+        run(count, grain, { &body, [](const void* context, int begin, int end, int worker) { (*(const Body*)context)(begin, end, worker); } });
+    }
+
+    // process wide pool sized to the machine
+    static ThreadPool& shared();
+
+private:
+    struct Job
+    {
+        const void* context;
+        void (*invoke)(const void* context, int begin, int end, int worker);
+    };
+
+    struct Range
+    {
+        int begin;
+        int end;
+    };
+
+    // chunks are only pushed before a job starts, so a vector with a moving front does, and keeps its capacity
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::vector<Range> ranges;
+        size_t front = 0;
+
+        bool empty() const { return front == ranges.size(); }
+    };
+
+    void run(int count, int grain, Job body);
+    bool popOrSteal(int worker, Range& range);
+    void runChunks(int worker);
+    void workerLoop(int worker);
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread> threads;
+
+    std::mutex jobMutex;            // one parallelFor at a time
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    unsigned generation = 0;
+    bool stopping = false;
+
+    Job job = { nullptr, nullptr };
+    std::atomic<int> remainingChunks{ 0 };
+    int busyWorkers = 0;
+};
@@ -0,0 +1,498 @@
+#include "visibility.h"
+#include "profiler.h"
+#include "raykernel.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <cfloat>
+
+void generateRadialRays(int amount, std::vector<Vec2>& rays)
+{
+    rays.clear();
+    Vec2 v{ 1, 0 };
+    float offset = 2 * pi / amount;
+    for (int i = 0; i < amount; i++)
+    {
+        rays.push_back(rotateVector(v, i * offset));
+    }
+}
+
+int classifyCorner(const SegmentStore& segments, int i, Vec2 position)
+{
+    int first, last;
+    segments.loopOf(i, first, last);
+    int previousEdge = i == first ? last - 1 : i - 1;
+    int nextEdge = i + 1 == last ? first : i + 1;
+    Vec2 corner(segments.x0[i], segments.y0[i]);
+    int previousSide = orientation(position, corner, Vec2(segments.x0[previousEdge], segments.y0[previousEdge]));
+    int nextSide = orientation(position, corner, Vec2(segments.x0[nextEdge], segments.y0[nextEdge]));
+    // a neighbour on the ray itself (an edge running along the ray) sides with the other one
+    if (previousSide == 0)
+    {
+        return nextSide;
+    }
+    if (nextSide == 0)
+    {
+        return previousSide;
+    }
+    return previousSide == nextSide ? previousSide : 0;
+}
+
+bool isCornerSealed(const Level& level, Vec2 corner, Vec2 ray)
+{
+    Vec2 probe = corner + 0.01f * ray;
+    if (level.grid.isEmpty())
+    {
+        return level.segments.findShapeContaining(probe) >= 0;
+    }
+    return level.grid.findShapeContaining(level.segments, probe) >= 0;
+}
+
+static void castRayAgainst(const SegmentStore& segments, int first, int last, Vec2 origin, Vec2 ray, float rayLength, Vec2& nearestCollisionPoint, float& nearestCollisionDistance, int& nearestSegment)
+{
+    LOS_PROFILE_COUNT(CounterSegmentsTested, last - first);
+    float nearestT;
+    int nearestIndex = closestHitInRange(segments.x0.data() + first, segments.y0.data() + first, segments.dx.data() + first, segments.dy.data() + first, last - first, origin, ray, nearestT);
+
+    if (nearestIndex >= 0 && nearestT * rayLength < nearestCollisionDistance)
+    {
+        nearestCollisionDistance = nearestT * rayLength;
+        nearestCollisionPoint = origin + nearestT * ray;
+        nearestSegment = first + nearestIndex;
+    }
+}
+
+bool castRay(const Level& level, Vec2 origin, Vec2 ray, Vec2& collisionPoint, float& collisionDistance, Segment& collisionSegment)
+{
+    int collisionSegmentIndex;
+    bool hit = castRay(level, origin, ray, collisionPoint, collisionDistance, collisionSegmentIndex);
+    if (hit)
+    {
+        collisionSegment = level.segments.getSegment(collisionSegmentIndex);
+    }
+    return hit;
+}
+
+bool castRay(const Level& level, Vec2 origin, Vec2 ray, Vec2& collisionPoint, float& collisionDistance, int& collisionSegmentIndex)
+{
+    const SegmentStore& segments = level.segments;
+    collisionDistance = FLT_MAX;
+    collisionSegmentIndex = -1;
+
+    // the screen edges enclose every shape, so for an observer inside the screen the nearest hit
+    // over all edges is the shape hit whenever there is one
+    float t;
+    int segment;
+    bool indexed = false;
+    bool hit = false;
+    SpatialIndex spatialIndex = level.spatialIndex;
+    if (spatialIndex == SpatialIndex::PVS)
+    {
+        // the cell's list holds every edge that can be hit first from inside the cell
+        int cell = level.pvs.geometryVersion == level.geometryVersion ? level.pvs.cellOf(origin) : -1;
+        if (cell >= 0)
+        {
+            indexed = true;
+            hit = level.pvs.castRay(cell, origin, ray, t, segment);
+        }
+        else
+        {
+            spatialIndex = SpatialIndex::Grid;
+        }
+    }
+
+    if (!indexed && spatialIndex == SpatialIndex::Grid && !level.grid.isEmpty())
+    {
+        indexed = true;
+        hit = level.grid.castRay(origin, ray, t, segment);
+    }
+    else if (!indexed && spatialIndex == SpatialIndex::BVH && !level.bvh.isEmpty())
+    {
+        indexed = true;
+        hit = level.bvh.closestHit(segments, origin, ray, t, segment);
+    }
+    if (indexed)
+    {
+        if (hit)
+        {
+            collisionDistance = t * norm(ray);
+            collisionPoint = origin + t * ray;
+            collisionSegmentIndex = segment;
+        }
+        return hit;
+    }
+
+    float rayLength = norm(ray);
+    castRayAgainst(segments, 0, segments.screenEdgesStart, origin, ray, rayLength, collisionPoint, collisionDistance, collisionSegmentIndex);
+
+    if (collisionDistance == FLT_MAX)
+    {
+        castRayAgainst(segments, segments.screenEdgesStart, segments.size(), origin, ray, rayLength, collisionPoint, collisionDistance, collisionSegmentIndex);
+    }
+
+    return collisionDistance != FLT_MAX;
+}
+
+void buildVisionFan(Vec2 origin, const std::vector<Vec2>& polygon, std::vector<Vec2>& fan, bool open)
+{
+    // every visibility polygon, swept, cast or patched, ends here
+    LOS_PROFILE_COUNT(CounterPolygonsBuilt, 1);
+    fan.clear();
+    if (polygon.empty())
+    {
+        return;
+    }
+
+    for (size_t i = 1; i < polygon.size(); i++)
+    {
+        fan.push_back(origin);
+        fan.push_back(polygon[i - 1]);
+        fan.push_back(polygon[i]);
+    }
+    if (open)
+    {
+        return;
+    }
+    fan.push_back(origin);
+    fan.push_back(polygon.back());
+    fan.push_back(polygon.front());
+}
+
+void computeVisibility(const Level& level, Vec2 position, VisibilityResult& result, VisibilityEngine engine)
+{
+    LOS_PROFILE_ZONE("computeVisibility");
+    if (engine == VisibilityEngine::AngularSweep)
+    {
+        computeVisibilitySweep(level, position, result);
+    }
+    else
+    {
+        computeVisibilityRayCast(level, position, result);
+    }
+}
+
+static void appendRayHit(const Level& level, VisibilityResult& result, Vec2 ray, int corner, Vec2 anchor, Vec2 point, float distance, int segmentIndex)
+{
+    Segment segment = segmentIndex >= 0 ? level.segments.getSegment(segmentIndex) : Segment();
+    result.rays.push_back(ray);
+    result.rayCorners.push_back(corner);
+    result.rayAnchors.push_back(anchor);
+    result.collisionPoints.push_back(point);
+    result.collisionDistances.push_back(distance);
+    result.collisionSegments.push_back(segment);
+    result.collisionSegmentIndices.push_back(segmentIndex);
+
+    if (distance < result.nearestDistance)
+    {
+        result.nearestDistance = distance;
+        result.nearestPoint = point;
+        result.nearestSegment = segment;
+    }
+}
+
+namespace
+{
+    // how one pass reaches the edges facing its observer
+    enum class FacingCast
+    {
+        Grid,       // the grid's cells cut down to the facing edges
+        BVH,        // the tree's leaves cut down to the facing edges
+        Packed      // the facing edges copied out in the store's layout, for SpatialIndex::None
+    };
+
+    // what the rays of one observer can hit, found by a pass over the shapes before any ray is cast
+    // a ray from the observer enters a shape through an edge whose outer side faces the observer, so an edge facing away
+    // is never the first hit and is left out of the intersection tests; a corner between two such edges lies behind its
+    // own shape and gets no ray; only a silhouette corner (one edge facing each way) can be grazed by a ray
+    struct FrontFaces
+    {
+        // per edge: 0 faces away, 1 faces the observer, 2 kept without knowing (a shape without area or one the
+        // observer stands in), the screen edges always face it
+        std::vector<uint8_t> facing;
+        FacingCast cast = FacingCast::Packed;
+        EdgeSelection selection;
+        std::vector<float> x0, y0, dx, dy;
+        std::vector<int> edges;
+    };
+}
+
+void computeShapeFacing(const SegmentStore& segments, int shape, Vec2 position, uint8_t* facing)
+{
+    int first = segments.shapeStart[shape];
+    int last = segments.shapeStart[shape + 1];
+    int winding = segments.windingOf(shape);
+    bool anyFacing = false;
+    for (int i = first; i < last; i++)
+    {
+        facing[i] = winding != 0 && segments.facesPoint(i, winding, position);
+        anyFacing = anyFacing || facing[i];
+    }
+    // a wall drawn as a line faces every way, and every edge faces away from an observer inside the shape
+    if (winding == 0 || !anyFacing)
+    {
+        std::fill(facing + first, facing + last, (uint8_t)2);
+    }
+}
+
+// sets up faces.cast for the edges faces.facing keeps
+static void selectFrontFaces(const Level& level, FrontFaces& faces)
+{
+    const SegmentStore& segments = level.segments;
+    bool gridIndex = level.spatialIndex == SpatialIndex::Grid || level.spatialIndex == SpatialIndex::PVS;
+    if (gridIndex && !level.grid.isEmpty())
+    {
+        faces.cast = FacingCast::Grid;
+        level.grid.beginSelection(faces.facing.data(), faces.selection);
+    }
+    else if (level.spatialIndex == SpatialIndex::BVH && !level.bvh.isEmpty())
+    {
+        faces.cast = FacingCast::BVH;
+        level.bvh.beginSelection(faces.facing.data(), faces.selection);
+    }
+    else
+    {
+        faces.cast = FacingCast::Packed;
+        faces.x0.clear();
+        faces.y0.clear();
+        faces.dx.clear();
+        faces.dy.clear();
+        faces.edges.clear();
+        for (int i = 0; i < segments.size(); i++)
+        {
+            if (faces.facing[i])
+            {
+                faces.x0.push_back(segments.x0[i]);
+                faces.y0.push_back(segments.y0[i]);
+                faces.dx.push_back(segments.dx[i]);
+                faces.dy.push_back(segments.dy[i]);
+                faces.edges.push_back(i);
+            }
+        }
+    }
+}
+
+static void cullBackFaces(const Level& level, Vec2 position, FrontFaces& faces)
+{
+    const SegmentStore& segments = level.segments;
+    faces.facing.resize(segments.size());
+    for (int shape = 0; shape < segments.shapeCount(); shape++)
+    {
+        computeShapeFacing(segments, shape, position, faces.facing.data());
+    }
+    std::fill(faces.facing.begin() + segments.screenEdgesStart, faces.facing.end(), (uint8_t)1);
+    selectFrontFaces(level, faces);
+}
+
+// nearest facing edge along origin + t * ray, origin is the observer or a corner on a ray from it (an edge facing away
+// from the observer faces away from the ray as well), a corner's own edges run through the origin and never count
+static bool castRayFacing(const Level& level, FrontFaces& faces, Vec2 origin, Vec2 ray, bool fromObserver, Vec2& point, float& distance, int& segment)
+{
+    // only the observer's rays take the PVS lists, the facing selection already keeps the corner rays short
+    if (fromObserver && level.spatialIndex == SpatialIndex::PVS)
+    {
+        return castRay(level, origin, ray, point, distance, segment);
+    }
+
+    float t;
+    bool hit;
+    if (faces.cast == FacingCast::Grid)
+    {
+        hit = level.grid.castRay(faces.selection, origin, ray, t, segment);
+    }
+    else if (faces.cast == FacingCast::BVH)
+    {
+        hit = level.bvh.closestHit(level.segments, faces.selection, origin, ray, t, segment);
+    }
+    else
+    {
+        int count = (int)faces.edges.size();
+        LOS_PROFILE_COUNT(CounterSegmentsTested, count);
+        int local = count > 0 ? closestHitInRange(faces.x0.data(), faces.y0.data(), faces.dx.data(), faces.dy.data(), count, origin, ray, t) : -1;
+        hit = local >= 0;
+        segment = hit ? faces.edges[local] : -1;
+    }
+    if (hit)
+    {
+        distance = t * norm(ray);
+        point = origin + t * ray;
+    }
+    else
+    {
+        distance = FLT_MAX;
+    }
+    return hit;
+}
+
+// the hits of corner i, whose edges before and after it have the given facing (see FrontFaces), at least one of them not 0
+// cast(origin, ray, fromObserver, point, distance, segment) finds the nearest hit along a ray
+template <typename Cast>
+static void appendCornerHits(const Level& level, Vec2 position, int i, int before, int after, Cast cast, VisibilityResult& result)
+{
+    const SegmentStore& segments = level.segments;
+    Vec2 corner(segments.x0[i], segments.y0[i]);
+    Vec2 toCorner = corner - position;
+    float cornerDistance = norm(toCorner);
+    if (cornerDistance == 0.0f)
+    {
+        return;
+    }
+    Vec2 ray = toCorner / cornerDistance;
+
+    Vec2 point;
+    float distance;
+    int segment;
+    cast(position, ray, true, point, distance, segment);
+
+    // a closer hit hides the corner and everything past it, otherwise the ray ends on the corner itself
+    // (in float it may just as well slip past it or stop a rounding step short)
+    bool reached = distance >= cornerDistance - 0.01f;
+    if (!reached)
+    {
+        appendRayHit(level, result, ray, i, corner, point, distance, segment);
+        return;
+    }
+
+    // between two edges facing the observer the ray enters the shape, only the silhouette needs the neighbours
+    int side = before == 1 && after == 1 ? 0 : classifyCorner(segments, i, position);
+    Vec2 behindPoint;
+    float behindDistance;
+    int behind;
+    if (side != 0 && !isCornerSealed(level, corner, ray) && cast(corner, ray, false, behindPoint, behindDistance, behind))
+    {
+        // the shape lies towards larger angles, so a walk coming from smaller ones sees the far hit first
+        if (side > 0)
+        {
+            appendRayHit(level, result, ray, i, corner, behindPoint, cornerDistance + behindDistance, behind);
+            appendRayHit(level, result, ray, i, corner, corner, cornerDistance, i);
+        }
+        else
+        {
+            appendRayHit(level, result, ray, i, corner, corner, cornerDistance, i);
+            appendRayHit(level, result, ray, i, corner, behindPoint, cornerDistance + behindDistance, behind);
+        }
+    }
+    else
+    {
+        appendRayHit(level, result, ray, i, corner, corner, cornerDistance, i);
+    }
+}
+
+void castCornerRays(const Level& level, Vec2 position, const std::vector<uint8_t>& facing, const std::vector<int>& corners, VisibilityResult& result)
+{
+    const SegmentStore& segments = level.segments;
+    thread_local FrontFaces faces;
+    faces.facing.assign(facing.begin(), facing.end());
+    selectFrontFaces(level, faces);
+
+    auto castFacing = [&](Vec2 origin, Vec2 ray, bool fromObserver, Vec2& point, float& distance, int& segment)
+    {
+        return castRayFacing(level, faces, origin, ray, fromObserver, point, distance, segment);
+    };
+    for (int i : corners)
+    {
+        int first, last;
+        segments.loopOf(i, first, last);
+        int before = faces.facing[i == first ? last - 1 : i - 1];
+        int after = faces.facing[i];
+        if (before != 0 || after != 0)
+        {
+            appendCornerHits(level, position, i, before, after, castFacing, result);
+        }
+    }
+}
+
+void computeVisibilityRayCast(const Level& level, Vec2 position, VisibilityResult& result)
+{
+    const SegmentStore& segments = level.segments;
+    result.rays.clear();
+    result.rayCorners.clear();
+    result.rayAnchors.clear();
+    result.collisionPoints.clear();
+    result.collisionDistances.clear();
+    result.collisionSegments.clear();
+    result.collisionSegmentIndices.clear();
+    result.polygon.clear();
+    result.open = false;
+    result.nearestDistance = FLT_MAX;
+
+    // a corner gives at most two hits, reserving for that keeps the buffers from regrowing whenever a moving observer
+    // sees more than ever before (no-ops once they have it)
+    size_t most = 2 * (size_t)segments.size();
+    result.rays.reserve(most);
+    result.rayCorners.reserve(most);
+    result.rayAnchors.reserve(most);
+    result.collisionPoints.reserve(most);
+    result.collisionDistances.reserve(most);
+    result.collisionSegments.reserve(most);
+    result.collisionSegmentIndices.reserve(most);
+    result.polygon.reserve(most);
+    result.fan.reserve(3 * most);
+
+    thread_local FrontFaces faces;
+    {
+        LOS_PROFILE_ZONE("cullBackFaces");
+        cullBackFaces(level, position, faces);
+    }
+
+    auto castFacing = [&](Vec2 origin, Vec2 ray, bool fromObserver, Vec2& point, float& distance, int& segment)
+    {
+        return castRayFacing(level, faces, origin, ray, fromObserver, point, distance, segment);
+    };
+
+    // one ray per corner that isn't behind its own shape, plus a second one from the corner on where the first only
+    // grazes the corner's shape, the two hits go in the order a walk towards larger angles meets them
+    for (int shape = 0; shape <= segments.shapeCount(); shape++)
+    {
+        // the screen edges are the last loop
+        int first = shape < segments.shapeCount() ? segments.shapeStart[shape] : segments.screenEdgesStart;
+        int last = shape < segments.shapeCount() ? segments.shapeStart[shape + 1] : segments.size();
+        for (int i = first; i < last; i++)
+        {
+            int before = faces.facing[i == first ? last - 1 : i - 1];
+            int after = faces.facing[i];
+            if (before == 0 && after == 0)
+            {
+                continue;
+            }
+
+            appendCornerHits(level, position, i, before, after, castFacing, result);
+        }
+    }
+    LOS_PROFILE_COUNT(CounterRaysCast, result.rays.size());
+
+    // sorted on the ray directions, so the two hits of a corner keep the order they were appended in
+    thread_local std::vector<int> polygonOrder;
+    sortIndicesByAngle(result.rays, Vec2(), polygonOrder);
+    for (size_t k = 0; k < polygonOrder.size(); k++)
+    {
+        result.polygon.push_back(result.collisionPoints[polygonOrder[k]]);
+    }
+
+    buildVisionFan(position, result.polygon, result.fan);
+}
+
+void computeVisibilityBatch(const Level& level, const std::vector<Vec2>& observers, std::vector<VisibilityResult>& results, VisibilityEngine engine, ThreadPool* pool)
+{
+    LOS_PROFILE_ZONE("computeVisibilityBatch");
+    // shrinking would free the buffers of the dropped entries, only grow
+    if (results.size() < observers.size())
+    {
+        results.resize(observers.size());
+    }
+
+    if (pool == nullptr)
+    {
+        pool = &ThreadPool::shared();
+    }
+
+    // a single observer costs far more than the scheduling, small chunks let idle workers steal the uneven ones
+    int observerCount = (int)observers.size();
+    int grain = std::max(1, observerCount / (8 * pool->size()));
+    pool->parallelFor(observerCount, grain, [&](int begin, int end, int)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            computeVisibility(level, observers[i], results[i], engine);
+        }
+    });
+}
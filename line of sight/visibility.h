@@ -0,0 +1,191 @@
+#pragma once
+
+#include "level.h"
+
+class ThreadPool;
+
+// everything one visibility pass produces for an observer
+struct VisibilityResult
+{
+    std::vector<Vec2> rays;                 // normalized ray directions
+    std::vector<Vec2> rayAnchors;           // geometry corner each ray was aimed at (a ray past a corner shares its anchor)
+    std::vector<int> rayCorners;            // ray caster only: the corner (start point of that edge) each ray was aimed at
+    std::vector<Vec2> collisionPoints;      // nearest hit per ray, in ray order
+    std::vector<float> collisionDistances;  // distance to the nearest hit per ray
+    std::vector<Segment> collisionSegments; // segment hit by each ray
+    std::vector<int> collisionSegmentIndices; // index into level.segments of the segment hit by each ray, -1 if none
+    std::vector<Vec2> polygon;              // collision points sorted by angle around the observer
+    std::vector<Vec2> fan;                  // triangles (observer, polygon[i], polygon[i + 1]), closed back on polygon[0]
+    bool open = false;                      // cone pass: the polygon runs from one side of the cone to the other, the fan isn't closed
+    Vec2 nearestPoint;
+    Segment nearestSegment;
+    float nearestDistance;
+};
+
+void generateRadialRays(int amount, std::vector<Vec2>& rays);
+
+// how the ray from position through corner i (the start point of edge i) meets the corner's shape, decided with
+// orientation() on the corner's two neighbours in its loop
+// 1 or -1: both neighbours lie on that side of the ray, the ray only grazes the shape and the view goes on past the
+// corner on the other side (a shadow starts there); 0: the ray enters the shape at the corner, nothing past it is seen
+int classifyCorner(const SegmentStore& segments, int i, Vec2 position);
+// a ray grazing a corner still runs into a shape right behind it when another shape touches the corner (walls made of
+// several shapes), probed a hundredth of a unit past the corner
+bool isCornerSealed(const Level& level, Vec2 corner, Vec2 ray);
+// which way each edge of shape faces position, written to facing[edge]: 0 away, 1 towards it, 2 unknown (a wall drawn as
+// a line, or a shape position stands in), the ray caster tests only the edges not facing away
+void computeShapeFacing(const SegmentStore& segments, int shape, Vec2 position, uint8_t* facing);
+
+// nearest hit against the shapes, falling back to the screen edges if nothing was hit
+bool castRay(const Level& level, Vec2 origin, Vec2 ray, Vec2& collisionPoint, float& collisionDistance, Segment& collisionSegment);
+bool castRay(const Level& level, Vec2 origin, Vec2 ray, Vec2& collisionPoint, float& collisionDistance, int& collisionSegmentIndex);
+
+enum class VisibilityEngine
+{
+    RayCast,        // a ray per corner not behind its own shape plus one past each silhouette corner, every ray tested against the edges facing the observer, O(V * E)
+    AngularSweep    // endpoints sorted by angle once, swept with a distance ordered active edge set, O(E log E)
+};
+
+// builds the visibility polygon (and its triangle fan) seen from position
+void computeVisibility(const Level& level, Vec2 position, VisibilityResult& result, VisibilityEngine engine = VisibilityEngine::RayCast);
+void computeVisibilityRayCast(const Level& level, Vec2 position, VisibilityResult& result);
+// appends the hits computeVisibilityRayCast gives each of corners, facing is its per edge facing from position
+// (computeShapeFacing over the shapes, 1 for the screen edges); polygon and fan are left alone
+void castCornerRays(const Level& level, Vec2 position, const std::vector<uint8_t>& facing, const std::vector<int>& corners, VisibilityResult& result);
+void computeVisibilitySweep(const Level& level, Vec2 position, VisibilityResult& result);
+// the sweep only needs the edges, so it also runs on a bare store (level baking)
+void computeVisibilitySweep(const SegmentStore& segments, Vec2 position, VisibilityResult& result);
+
+// ===== ===== =====
+// VISION CONE
+// ===== ===== =====
+
+// field of view of a guard, everything outside the angle or past the range is unseen
+struct VisionCone
+{
+    Vec2 heading{ 1.0f, 0.0f };     // center of the cone, any length
+    float halfAngle = pi / 4;       // radians on either side of the heading, pi or more sees all around
+    float range = 300.0f;
+};
+
+// the part of the level seen inside the cone: the edges out of the cone or out of range are dropped before any ray is cast,
+// rays go to the corners inside it, to where edges cross the range circle, along both sides of the cone and at a
+// few steps along its arc; the polygon runs from the right side (heading turned by -halfAngle) to the left one
+// and is left open (result.open) unless the cone sees all around, hits are capped at the range
+void computeVisibilityCone(const Level& level, Vec2 position, const VisionCone& cone, VisibilityResult& result);
+
+// one visibility pass per observer, spread over the pool's workers (ThreadPool::shared() when pool is null)
+// the level is only read, so every worker shares it; results[i] receives observer i, results never shrinks and each entry
+// keeps its buffers between calls, so a steady batch (same observer count every frame) doesn't reallocate
+void computeVisibilityBatch(const Level& level, const std::vector<Vec2>& observers, std::vector<VisibilityResult>& results, VisibilityEngine engine = VisibilityEngine::RayCast, ThreadPool* pool = nullptr);
+
+// ===== ===== =====
+// INCREMENTAL VISIBILITY
+// ===== ===== =====
+
+enum class VisibilityUpdate
+{
+    Reused,     // same position and geometry, result left untouched
+    Patched,    // most hits slid along the edges they were already on, the rest recast
+    Rebuilt     // full pass
+};
+
+// what updateVisibility remembers about the last pass, pair one cache with one VisibilityResult
+struct VisibilityCache
+{
+    bool valid = false;
+    bool patchable = false;
+    const Level* level = nullptr;
+    unsigned geometryVersion = 0;
+    VisibilityEngine engine = VisibilityEngine::RayCast;
+    Vec2 position;
+
+    // per edge, kept until the geometry changes
+    std::vector<int> edgeShapes;        // shape of each edge, -1 for the screen edges
+    std::vector<int> previousEdges;     // edge before each one in its loop, the other edge at its start corner
+    std::vector<int> nextEdges;         // edge after each one in its loop, which starts at its end corner
+    std::vector<int> crossingStart;     // edge e is crossed at crossings[crossingStart[e], crossingStart[e + 1])
+    std::vector<float> crossings;       // where edges of other shapes cross an edge, as fractions along it, ascending
+    std::vector<uint8_t> crowded;       // 1 at the corners another shape's edge passes close enough to to matter
+    // per edge, for the cached position
+    std::vector<uint8_t> facing;        // see computeShapeFacing, the screen edges 1
+    std::vector<int> watchedEdges;      // both edges at each silhouette corner, the first whose facing changes
+    std::vector<int> cornerRays;        // first ray of each corner, -1 for a corner behind its own shape
+    std::vector<int> tiedCorners;       // pairs of corners on each other's rays, recast on the next move whichever way they part
+
+    // per ray
+    struct RayState
+    {
+        float key;          // pseudoAngle of the ray
+        float low, high;    // stretch of the hit edge the hit can slide over before another edge crosses it
+        uint8_t kind;       // ends on its corner, stops short of it, or goes on past it
+        int8_t side;        // classifyCorner of a corner the ray ends on, 2 where the full pass didn't classify it
+        uint8_t along;      // ends on its corner running almost along one of the corner's edges
+    };
+    std::vector<RayState> rays;
+    std::vector<int> polygonOrder;      // index into collisionPoints of each polygon point
+
+    // scratch of a patch
+    std::vector<uint8_t> dirty;         // per corner
+    std::vector<int> dirtyCorners;
+    std::vector<int> turnedEdges;       // edges whose facing changed
+    std::vector<uint8_t> lostEdges;     // per edge, 1 where it turned away from the observer
+    struct TurnedArc
+    {
+        int edge;           // turned towards the observer
+        float from, width;  // the pseudo angles it spans
+    };
+    std::vector<TurnedArc> turnedArcs;
+    std::vector<uint8_t> shapeFacing;
+    std::vector<int> cells;
+    std::vector<float> sortKeys;
+    std::vector<float> previousDistances;
+    VisibilityResult recast;
+    VisibilityResult merged;
+    std::vector<RayState> mergedRays;
+    std::vector<int> mergedIndices;     // per ray, where the merge put it, -1 for one that was recast
+    std::vector<int> recastOrder;
+    std::vector<int> keptOrder;
+
+    void invalidate() { valid = false; }
+};
+
+// computeVisibility with dirty tracking: reuses the result if nothing moved, otherwise (ray caster only) turns every ray
+// back towards its corner and slides its hit along the edge it is on, and recasts just the corners whose hits may have
+// changed: those next to an edge that turned, those whose hit slid off its edge or past another edge crossing it, and
+// those passed by a corner nearer than their hit; rebuilds when the observer walks through an edge or too much changed
+// the level must bump geometryVersion whenever its segments change (rebuildSegments / refitSegments do)
+VisibilityUpdate updateVisibility(const Level& level, Vec2 position, VisibilityResult& result, VisibilityCache& cache, VisibilityEngine engine = VisibilityEngine::RayCast);
+
+// ===== ===== =====
+// POLYGON QUERIES
+// ===== ===== =====
+
+// angular index over a visibility polygon, built once per pass and shared by any number of point / disc queries
+// the polygon is star shaped around its observer, so the sector holding a point is found by binary search on the
+// pseudo angles and a single edge test decides the rest, O(log n) per query and no allocation
+struct VisibilityQuery
+{
+    Vec2 origin;
+    std::vector<Vec2> points;   // polygon rotated so the keys ascend
+    std::vector<float> keys;    // pseudoAngle of each point around origin, forced non decreasing
+
+    int gapSector = -1;         // open polygon: the sector from its last point back to its first, outside the cone
+
+    // call again whenever the polygon changes (anything but VisibilityUpdate::Reused)
+    // open for a cone polygon (VisibilityResult::open), nothing between its last and first point is visible then
+    void build(Vec2 origin, const std::vector<Vec2>& polygon, bool open = false);
+
+    bool isEmpty() const { return points.size() < 3; }
+
+    bool containsPoint(Vec2 point) const;
+    // true if any part of the disc is visible, walks only the sectors the disc spans
+    bool overlapsCircle(Vec2 center, float radius) const;
+
+private:
+    int sectorOf(float key) const;
+    bool insideSector(int sector, Vec2 point) const;
+};
+
+// builds the triangle fan around origin from points already sorted by angle, open leaves out the last triangle back to polygon[0]
+void buildVisionFan(Vec2 origin, const std::vector<Vec2>& polygon, std::vector<Vec2>& fan, bool open = false);
@@ -0,0 +1,377 @@
+#include "visibility.h"
+#include "framearena.h"
+#include "profiler.h"
+#include "raykernel.h"
+
+#include <algorithm>
+#include <cfloat>
+
+// ===== ===== =====
+// VISION CONE
+// ===== ===== =====
+// a guard only needs what lies inside its cone, so the edges are culled first (the grid cells under the cone's
+// bounding box, then range and angle per edge) and every ray runs against that short list with the batched kernel
+// the arc at the range is approximated by rays at most arcStep apart, a ray that hits nothing closer ends on the arc
+
+namespace
+{
+    const float arcStep = pi / 32;
+
+    typedef std::vector<int, ArenaAllocator<int>> ArenaInts;
+    typedef std::vector<float, ArenaAllocator<float>> ArenaFloats;
+
+    // the cone around the observer, directions are tested with dot products, no trig per point
+    struct ConeFrame
+    {
+        Vec2 heading;       // unit
+        Vec2 startSide;     // unit, heading turned by -halfAngle, the polygon starts on it
+        Vec2 endSide;       // unit, heading turned by +halfAngle
+        float cosine;       // of the half angle
+        float halfAngle;
+        float range;
+        bool full;          // sees all around
+
+        // v relative to the observer
+        bool contains(Vec2 v) const
+        {
+            return full || dot(v, heading) >= norm(v) * cosine;
+        }
+
+        // pseudo angle of a direction measured from startSide, so the cone maps onto one increasing run of keys
+        float keyOf(Vec2 direction) const
+        {
+            return pseudoAngle(Vec2(dot(direction, startSide), cross2D(startSide, direction)));
+        }
+    };
+
+    ConeFrame makeConeFrame(const VisionCone& cone)
+    {
+        ConeFrame frame;
+        frame.heading = cone.heading.x == 0.0f && cone.heading.y == 0.0f ? Vec2(1.0f, 0.0f) : normalize(cone.heading);
+        frame.halfAngle = std::min(std::max(cone.halfAngle, 0.0f), pi);
+        frame.full = cone.halfAngle >= pi;
+        frame.cosine = std::cos(frame.halfAngle);
+        frame.range = cone.range;
+        Vec2 h = frame.heading;
+        float sine = std::sin(frame.halfAngle);
+        frame.startSide = Vec2(h.x * frame.cosine + h.y * sine, h.y * frame.cosine - h.x * sine);
+        frame.endSide = Vec2(h.x * frame.cosine - h.y * sine, h.y * frame.cosine + h.x * sine);
+        return frame;
+    }
+
+    float distanceToEdge(Vec2 point, Vec2 start, Vec2 edge)
+    {
+        float length2 = dot(edge, edge);
+        float t = length2 > 0.0f ? std::clamp(dot(point - start, edge) / length2, 0.0f, 1.0f) : 0.0f;
+        return norm(point - (start + t * edge));
+    }
+
+    // the edge (relative to the observer) crosses the ray from the observer along direction
+    bool edgeCrossesSide(Vec2 start, Vec2 edge, Vec2 direction)
+    {
+        float denominator = cross2D(direction, edge);
+        if (denominator == 0.0f)
+        {
+            return false;
+        }
+        float t = cross2D(start, edge) / denominator;
+        float u = cross2D(start, direction) / denominator;
+        return t >= 0.0f && u >= 0.0f && u <= 1.0f;
+    }
+
+    // some part of the edge lies inside the cone and within the range
+    bool edgeInCone(const ConeFrame& frame, Vec2 start, Vec2 edge)
+    {
+        if (distanceToEdge(Vec2(), start, edge) > frame.range)
+        {
+            return false;
+        }
+        return frame.contains(start) || frame.contains(start + edge) ||
+            edgeCrossesSide(start, edge, frame.startSide) || edgeCrossesSide(start, edge, frame.endSide);
+    }
+
+    // every edge listed in a grid cell under the cone's bounding box, each once
+    void gatherCandidates(const Level& level, Vec2 position, const ConeFrame& frame, ArenaInts& candidates)
+    {
+        const SegmentGrid& grid = level.grid;
+        if (grid.isEmpty())
+        {
+            for (int i = 0; i < level.segments.size(); i++)
+            {
+                candidates.push_back(i);
+            }
+            return;
+        }
+
+        // the sector's box: the observer, both ends of the arc and the points of the arc that stick out along an axis
+        Vec2 low = position, high = position;
+        Vec2 extremes[6] = { frame.startSide, frame.endSide, Vec2(1.0f, 0.0f), Vec2(-1.0f, 0.0f), Vec2(0.0f, 1.0f), Vec2(0.0f, -1.0f) };
+        for (int k = 0; k < 6; k++)
+        {
+            if (k >= 2 && !frame.contains(extremes[k]))
+            {
+                continue;
+            }
+            Vec2 point = position + frame.range * extremes[k];
+            low = Vec2(std::fmin(low.x, point.x), std::fmin(low.y, point.y));
+            high = Vec2(std::fmax(high.x, point.x), std::fmax(high.y, point.y));
+        }
+
+        for (int cy = grid.cellY(low.y); cy <= grid.cellY(high.y); cy++)
+        {
+            for (int cx = grid.cellX(low.x); cx <= grid.cellX(high.x); cx++)
+            {
+                int cell = cy * grid.columns + cx;
+                candidates.insert(candidates.end(), grid.cellSegments.begin() + grid.cellStart[cell], grid.cellSegments.begin() + grid.cellStart[cell + 1]);
+            }
+        }
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+    }
+}
+
+void computeVisibilityCone(const Level& level, Vec2 position, const VisionCone& cone, VisibilityResult& result)
+{
+    LOS_PROFILE_ZONE("computeVisibilityCone");
+    const SegmentStore& segments = level.segments;
+    ConeFrame frame = makeConeFrame(cone);
+
+    result.rays.clear();
+    result.rayAnchors.clear();
+    result.rayCorners.clear();
+    result.collisionPoints.clear();
+    result.collisionDistances.clear();
+    result.collisionSegments.clear();
+    result.collisionSegmentIndices.clear();
+    result.polygon.clear();
+    result.open = !frame.full;
+    result.nearestDistance = FLT_MAX;
+    result.nearestPoint = Vec2();
+    result.nearestSegment = Segment();
+
+    FrameArena& arena = threadFrameArena();
+    FrameArenaScope arenaScope(arena);
+
+    // culling, the surviving edges are copied out in the store's layout for the ray kernel
+    // edges facing away from the observer go first, they are never the first hit (see computeVisibilityRayCast), and
+    // a corner between two of them gets no ray as the corners come from the kept edges
+    ArenaInts candidates{ ArenaAllocator<int>(arena) };
+    gatherCandidates(level, position, frame, candidates);
+    ArenaInts kept{ ArenaAllocator<int>(arena) };
+    ArenaFloats x0{ ArenaAllocator<float>(arena) }, y0{ ArenaAllocator<float>(arena) };
+    ArenaFloats dx{ ArenaAllocator<float>(arena) }, dy{ ArenaAllocator<float>(arena) };
+    int shape = -1;
+    int winding = 0;
+    for (size_t k = 0; k < candidates.size(); k++)
+    {
+        int i = candidates[k];
+        // candidates are sorted, so the edges of a shape come one after another
+        if (i < segments.screenEdgesStart)
+        {
+            if (shape < 0 || i >= segments.shapeStart[shape + 1])
+            {
+                shape = segments.shapeOf(i);
+                winding = segments.windingOf(shape);
+            }
+            if (!segments.facesPoint(i, winding, position))
+            {
+                continue;
+            }
+        }
+        Vec2 start = Vec2(segments.x0[i], segments.y0[i]) - position;
+        if (edgeInCone(frame, start, Vec2(segments.dx[i], segments.dy[i])))
+        {
+            kept.push_back(i);
+            x0.push_back(segments.x0[i]);
+            y0.push_back(segments.y0[i]);
+            dx.push_back(segments.dx[i]);
+            dy.push_back(segments.dy[i]);
+        }
+    }
+    int keptCount = (int)kept.size();
+
+    // at most: both sides, two hits at each corner (two per kept edge), two range crossings per kept edge and the arc
+    // steps; twice that when the buffers grow, so a guard walking into busier views doesn't regrow them every frame
+    size_t most = 2 + 6 * (size_t)keptCount + (size_t)std::ceil(2.0f * pi / arcStep);
+    if (result.rays.capacity() < most)
+    {
+        most *= 2;
+        result.rays.reserve(most);
+        result.rayAnchors.reserve(most);
+        result.collisionPoints.reserve(most);
+        result.collisionDistances.reserve(most);
+        result.collisionSegments.reserve(most);
+        result.collisionSegmentIndices.reserve(most);
+        result.polygon.reserve(most);
+        result.fan.reserve(3 * most);
+    }
+
+    // nearest kept edge along origin + t * ray, rays are unit length so t is the distance from origin
+    int casts = 0;
+    auto nearestKept = [&](Vec2 origin, Vec2 ray, float& t)
+    {
+        casts++;
+        return keptCount > 0 ? closestHitInRange(x0.data(), y0.data(), dx.data(), dy.data(), keptCount, origin, ray, t) : -1;
+    };
+    // a hit at distance from the observer on kept edge hit, a ray that gets past the range ends on the arc
+    auto addHit = [&](Vec2 ray, Vec2 anchor, float distance, int hit)
+    {
+        result.rays.push_back(ray);
+        result.rayAnchors.push_back(anchor);
+        if (hit >= 0 && distance <= frame.range)
+        {
+            Vec2 point = position + distance * ray;
+            Segment segment = segments.getSegment(kept[hit]);
+            result.collisionPoints.push_back(point);
+            result.collisionDistances.push_back(distance);
+            result.collisionSegments.push_back(segment);
+            result.collisionSegmentIndices.push_back(kept[hit]);
+            if (distance < result.nearestDistance)
+            {
+                result.nearestDistance = distance;
+                result.nearestPoint = point;
+                result.nearestSegment = segment;
+            }
+        }
+        else
+        {
+            result.collisionPoints.push_back(position + frame.range * ray);
+            result.collisionDistances.push_back(frame.range);
+            result.collisionSegments.push_back(Segment());
+            result.collisionSegmentIndices.push_back(-1);
+        }
+    };
+    auto castFromObserver = [&](Vec2 ray, Vec2 anchor)
+    {
+        float t = FLT_MAX;
+        int hit = nearestKept(position, ray, t);
+        addHit(ray, anchor, t, hit);
+    };
+
+    // both sides of the cone first, the polygon starts and ends on them
+    castFromObserver(frame.startSide, position + frame.range * frame.startSide);
+    castFromObserver(frame.endSide, position + frame.range * frame.endSide);
+
+    // the corners of the kept edges, as (edge starting at the corner, kept edge through it), neighbouring edges share theirs
+    typedef std::pair<int, int> KeptCorner;
+    std::vector<KeptCorner, ArenaAllocator<KeptCorner>> corners{ ArenaAllocator<KeptCorner>(arena) };
+    for (int k = 0; k < keptCount; k++)
+    {
+        int first, last;
+        segments.loopOf(kept[k], first, last);
+        corners.push_back({ kept[k], k });
+        corners.push_back({ kept[k] + 1 == last ? first : kept[k] + 1, k });
+    }
+    std::sort(corners.begin(), corners.end());
+    corners.erase(std::unique(corners.begin(), corners.end(), [](const KeptCorner& a, const KeptCorner& b) { return a.first == b.first; }), corners.end());
+    for (size_t k = 0; k < corners.size(); k++)
+    {
+        int i = corners[k].first;
+        Vec2 corner(segments.x0[i], segments.y0[i]);
+        Vec2 v = corner - position;
+        float cornerDistance = norm(v);
+        if (cornerDistance == 0.0f || cornerDistance > frame.range || !frame.contains(v))
+        {
+            continue;
+        }
+        Vec2 ray = v / cornerDistance;
+        float t = FLT_MAX;
+        int hit = nearestKept(position, ray, t);
+
+        // a closer hit hides the corner, otherwise the ray ends on the corner itself (in float it may slip past it)
+        if (hit >= 0 && t < cornerDistance - 0.01f)
+        {
+            addHit(ray, corner, t, hit);
+            continue;
+        }
+        hit = corners[k].second;
+        t = cornerDistance;
+
+        // where the ray only grazes the corner's shape, a second ray from the corner on finds what lies behind it
+        int side = classifyCorner(segments, i, position);
+        if (side == 0 || isCornerSealed(level, corner, ray))
+        {
+            addHit(ray, corner, t, hit);
+            continue;
+        }
+        float behindT = FLT_MAX;
+        int behind = nearestKept(corner, ray, behindT);
+        float behindDistance = behind >= 0 ? cornerDistance + behindT : FLT_MAX;
+        // the shape lies towards larger angles, so a walk coming from smaller ones sees the far hit first
+        if (side > 0)
+        {
+            addHit(ray, corner, behindDistance, behind);
+            addHit(ray, corner, t, hit);
+        }
+        else
+        {
+            addHit(ray, corner, t, hit);
+            addHit(ray, corner, behindDistance, behind);
+        }
+    }
+
+    // an edge leaving the range, the boundary turns from the edge onto the arc there
+    float range2 = frame.range * frame.range;
+    for (int k = 0; k < keptCount; k++)
+    {
+        Vec2 start = Vec2(x0[k], y0[k]) - position;
+        Vec2 edge(dx[k], dy[k]);
+        float a = dot(edge, edge);
+        float b = dot(start, edge);
+        float c = dot(start, start) - range2;
+        float discriminant = b * b - a * c;
+        if (a == 0.0f || discriminant < 0.0f)
+        {
+            continue;
+        }
+        float root = std::sqrt(discriminant);
+        for (float u : { (-b - root) / a, (-b + root) / a })
+        {
+            Vec2 v = start + u * edge;
+            if (u >= 0.0f && u <= 1.0f && frame.contains(v))
+            {
+                castFromObserver(normalize(v), position + v);
+            }
+        }
+    }
+
+    // the arc between the sides, turned one step at a time
+    int steps = std::max(1, (int)std::ceil(2.0f * frame.halfAngle / arcStep));
+    float stepAngle = 2.0f * frame.halfAngle / steps;
+    float stepCosine = std::cos(stepAngle);
+    float stepSine = std::sin(stepAngle);
+    Vec2 direction = frame.startSide;
+    for (int s = 1; s < steps; s++)
+    {
+        direction = Vec2(direction.x * stepCosine - direction.y * stepSine, direction.y * stepCosine + direction.x * stepSine);
+        castFromObserver(direction, position + frame.range * direction);
+    }
+
+    LOS_PROFILE_COUNT(CounterRaysCast, casts);
+    LOS_PROFILE_COUNT(CounterSegmentsTested, (uint64_t)casts * keptCount);
+
+    // polygon from the start side to the end side, keys measured from the start side
+    // directions a rounding step outside the cone are pulled back onto the nearer side
+    float endKey = frame.full ? 4.0f : frame.keyOf(frame.endSide);
+    typedef std::pair<float, int> KeyedRay;
+    std::vector<KeyedRay, ArenaAllocator<KeyedRay>> order{ ArenaAllocator<KeyedRay>(arena) };
+    order.reserve(result.rays.size());
+    for (int r = 2; r < (int)result.rays.size(); r++)
+    {
+        float key = frame.keyOf(result.rays[r]);
+        if (key > endKey)
+        {
+            key = key - endKey < 4.0f - key ? endKey : 0.0f;
+        }
+        order.push_back({ key, r });
+    }
+    std::sort(order.begin(), order.end());
+    result.polygon.push_back(result.collisionPoints[0]);
+    for (size_t k = 0; k < order.size(); k++)
+    {
+        result.polygon.push_back(result.collisionPoints[order[k].second]);
+    }
+    result.polygon.push_back(result.collisionPoints[1]);
+
+    buildVisionFan(position, result.polygon, result.fan, result.open);
+}
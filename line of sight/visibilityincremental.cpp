@@ -0,0 +1,889 @@
+#include "visibility.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+// ===== ===== =====
+// INCREMENTAL VISIBILITY
+// ===== ===== =====
+// the ray caster's hits for a corner only change when something enters or leaves the stretch of ray in front of them:
+// another corner crossing the ray (the two rays swap in angle order), a hit sliding off its edge or past another edge
+// crossing it, an edge turning towards or away from the observer, or the observer walking through an edge
+// a patch turns every ray back towards its corner, keeps the rays in angle order with an insertion sort (a small move
+// swaps few neighbours) and recasts only the corners one of those events touched
+
+namespace
+{
+    enum RayKind : uint8_t
+    {
+        RayOnCorner,    // ends on its corner
+        RayBlocked,     // stops short of its corner, the corner is hidden
+        RayPastCorner   // goes on past a grazed corner
+    };
+}
+
+// the full pass counts a hit this close in front of a corner as reaching it, and probes this far past it for a seal,
+// so another edge that close can change a corner's hits on a turn of the ray alone
+static const float cornerReach = 0.02f;
+
+// the key sortIndicesByAngle sorts a ray on
+static float rayKey(Vec2 ray)
+{
+    float key = pseudoAngle(ray) + 0.0f;
+    return key >= 4.0f ? std::nextafter(4.0f, 0.0f) : key;
+}
+
+// fractions along a0 + s * da and b0 + t * db where the two segments cross, false if they don't or run parallel
+static bool crossSegments(Vec2 a0, Vec2 da, Vec2 b0, Vec2 db, float& s, float& t)
+{
+    float denominator = cross2D(da, db);
+    if (denominator == 0.0f)
+    {
+        return false;
+    }
+    Vec2 w = b0 - a0;
+    s = cross2D(w, db) / denominator;
+    t = cross2D(w, da) / denominator;
+    return s >= 0.0f && s <= 1.0f && t >= 0.0f && t <= 1.0f;
+}
+
+static float distanceToSegment(Vec2 point, Vec2 start, Vec2 direction)
+{
+    float length2 = dot(direction, direction);
+    float u = length2 > 0.0f ? std::min(std::max(dot(point - start, direction) / length2, 0.0f), 1.0f) : 0.0f;
+    return norm(point - (start + u * direction));
+}
+
+// a ray this close to running along one of its corner's edges can meet the edge short of the corner or round the seal
+// probe past the corner onto either side of it
+static bool alongEdge(const SegmentStore& segments, int edge, Vec2 ray)
+{
+    Vec2 direction(segments.dx[edge], segments.dy[edge]);
+    float across = cross2D(ray, direction);
+    return across * across < 0.0001f * dot(direction, direction);
+}
+
+// the per edge tables a patch reads, they only depend on the geometry
+static void prepareGeometry(const Level& level, VisibilityCache& cache)
+{
+    const SegmentStore& segments = level.segments;
+    const SegmentGrid& grid = level.grid;
+    int edgeCount = segments.size();
+
+    cache.edgeShapes.resize(edgeCount);
+    cache.previousEdges.resize(edgeCount);
+    cache.nextEdges.resize(edgeCount);
+    for (int shape = 0; shape <= segments.shapeCount(); shape++)
+    {
+        // the screen edges are the last loop
+        int first = shape < segments.shapeCount() ? segments.shapeStart[shape] : segments.screenEdgesStart;
+        int last = shape < segments.shapeCount() ? segments.shapeStart[shape + 1] : edgeCount;
+        for (int i = first; i < last; i++)
+        {
+            cache.edgeShapes[i] = shape < segments.shapeCount() ? shape : -1;
+            cache.previousEdges[i] = i == first ? last - 1 : i - 1;
+            cache.nextEdges[i] = i + 1 == last ? first : i + 1;
+        }
+    }
+
+    // edges of different shapes crossing each other share a cell, a pair sharing several cells is found in each
+    std::vector<std::pair<int, float>> found;
+    for (int cell = 0; cell < grid.columns * grid.rows; cell++)
+    {
+        for (int a = grid.cellStart[cell]; a < grid.cellStart[cell + 1]; a++)
+        {
+            for (int b = a + 1; b < grid.cellStart[cell + 1]; b++)
+            {
+                int edgeA = grid.cellSegments[a];
+                int edgeB = grid.cellSegments[b];
+                float s, t;
+                if (cache.edgeShapes[edgeA] != cache.edgeShapes[edgeB] &&
+                    crossSegments(Vec2(grid.cellX0[a], grid.cellY0[a]), Vec2(grid.cellDX[a], grid.cellDY[a]), Vec2(grid.cellX0[b], grid.cellY0[b]), Vec2(grid.cellDX[b], grid.cellDY[b]), s, t))
+                {
+                    found.emplace_back(edgeA, s);
+                    found.emplace_back(edgeB, t);
+                }
+            }
+        }
+    }
+    std::sort(found.begin(), found.end());
+    found.erase(std::unique(found.begin(), found.end()), found.end());
+    cache.crossingStart.assign(edgeCount + 1, 0);
+    for (const std::pair<int, float>& crossing : found)
+    {
+        cache.crossingStart[crossing.first + 1]++;
+    }
+    for (int i = 0; i < edgeCount; i++)
+    {
+        cache.crossingStart[i + 1] += cache.crossingStart[i];
+    }
+    cache.crossings.resize(found.size());
+    for (size_t k = 0; k < found.size(); k++)
+    {
+        cache.crossings[k] = found[k].second;
+    }
+
+    cache.crowded.assign(edgeCount, 0);
+    for (int i = 0; i < edgeCount; i++)
+    {
+        Vec2 corner(segments.x0[i], segments.y0[i]);
+        int minX = grid.cellX(corner.x - cornerReach);
+        int maxX = grid.cellX(corner.x + cornerReach);
+        int minY = grid.cellY(corner.y - cornerReach);
+        int maxY = grid.cellY(corner.y + cornerReach);
+        for (int y = minY; y <= maxY && !cache.crowded[i]; y++)
+        {
+            for (int x = minX; x <= maxX && !cache.crowded[i]; x++)
+            {
+                int cell = y * grid.columns + x;
+                for (int k = grid.cellStart[cell]; k < grid.cellStart[cell + 1]; k++)
+                {
+                    int edge = grid.cellSegments[k];
+                    if (cache.edgeShapes[edge] != cache.edgeShapes[i] &&
+                        distanceToSegment(corner, Vec2(grid.cellX0[k], grid.cellY0[k]), Vec2(grid.cellDX[k], grid.cellDY[k])) <= cornerReach)
+                    {
+                        cache.crowded[i] = 1;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// both edges at every corner between an edge facing the observer and one facing away: the edges of a convex shape facing
+// an observer outside it form one run, which only grows or shrinks at its ends
+static void collectWatchedEdges(const SegmentStore& segments, VisibilityCache& cache)
+{
+    cache.watchedEdges.clear();
+    for (int i = 0; i < segments.screenEdgesStart; i++)
+    {
+        int previous = cache.previousEdges[i];
+        if (cache.facing[i] != cache.facing[previous])
+        {
+            cache.watchedEdges.push_back(previous);
+            cache.watchedEdges.push_back(i);
+        }
+    }
+}
+
+// the hit at u along edge may slide as far as the nearest crossings on either side of it, a hit right on a crossing
+// may have been given either edge there and can't slide at all
+static void slideBounds(const SegmentStore& segments, const VisibilityCache& cache, int edge, float u, VisibilityCache::RayState& state)
+{
+    state.low = 0.0f;
+    state.high = 1.0f;
+    float reach = cornerReach / std::sqrt(segments.dx[edge] * segments.dx[edge] + segments.dy[edge] * segments.dy[edge]);
+    for (int c = cache.crossingStart[edge]; c < cache.crossingStart[edge + 1]; c++)
+    {
+        if (std::abs(cache.crossings[c] - u) <= reach)
+        {
+            state.low = u;
+            state.high = u;
+            break;
+        }
+        if (cache.crossings[c] <= u)
+        {
+            state.low = cache.crossings[c];
+        }
+        else
+        {
+            state.high = cache.crossings[c];
+            break;
+        }
+    }
+}
+
+// what a patch needs to know about ray k, read back from the hits the full pass gave it
+static void describeRay(const Level& level, Vec2 position, const VisibilityResult& result, VisibilityCache& cache, int k)
+{
+    const SegmentStore& segments = level.segments;
+    int corner = result.rayCorners[k];
+    int edge = result.collisionSegmentIndices[k];
+    VisibilityCache::RayState& state = cache.rays[k];
+    state.key = rayKey(result.rays[k]);
+    state.low = 0.0f;
+    state.high = 1.0f;
+    state.side = 2;
+    state.along = 0;
+
+    if (edge == corner && result.collisionPoints[k] == result.rayAnchors[k])
+    {
+        state.kind = RayOnCorner;
+        state.along = alongEdge(segments, cache.previousEdges[corner], result.rays[k]) || alongEdge(segments, corner, result.rays[k]);
+        // between two edges facing the observer the full pass doesn't look at the neighbours
+        if (cache.facing[cache.previousEdges[corner]] != 1 || cache.facing[corner] != 1)
+        {
+            state.side = (int8_t)classifyCorner(segments, corner, position);
+        }
+        return;
+    }
+
+    // a corner's second ray is the one past it
+    int rayCount = (int)result.rays.size();
+    bool paired = (k > 0 && result.rayCorners[k - 1] == corner) || (k + 1 < rayCount && result.rayCorners[k + 1] == corner);
+    state.kind = paired ? RayPastCorner : RayBlocked;
+    if (edge < 0)
+    {
+        return;
+    }
+
+    Vec2 start(segments.x0[edge], segments.y0[edge]);
+    Vec2 direction(segments.dx[edge], segments.dy[edge]);
+    slideBounds(segments, cache, edge, dot(result.collisionPoints[k] - start, direction) / dot(direction, direction), state);
+}
+
+static void indexCornerRays(const VisibilityResult& result, VisibilityCache& cache)
+{
+    std::fill(cache.cornerRays.begin(), cache.cornerRays.end(), -1);
+    for (int k = (int)result.rays.size() - 1; k >= 0; k--)
+    {
+        cache.cornerRays[result.rayCorners[k]] = k;
+    }
+}
+
+// true if the corner other was aimed at lies in front of ray's hit, within reach of the observer: crossing the ray
+// there puts its shape in the way (a hit edge's own ends are left to the slide onto the next edge)
+static bool cornerInFront(const VisibilityResult& result, const VisibilityCache& cache, Vec2 position, int ray, int other, float reach)
+{
+    int corner = result.rayCorners[ray];
+    int otherCorner = result.rayCorners[other];
+    int edge = result.collisionSegmentIndices[ray];
+    if (corner == otherCorner)
+    {
+        return false;
+    }
+    if (cache.rays[ray].kind != RayOnCorner && edge >= 0 && !cache.crowded[otherCorner] && (otherCorner == edge || otherCorner == cache.nextEdges[edge]))
+    {
+        return false;
+    }
+    return norm(result.rayAnchors[other] - position) < reach;
+}
+
+// rays in order within rounding of the same angle: either corner may be taken for lying on the other's ray, and
+// the two can part again without swapping (corners in the same place, where shapes overlap, never part and are skipped)
+template <typename Tied>
+static void forEachTie(const std::vector<int>& order, const VisibilityResult& result, const VisibilityCache& cache, Tied tied)
+{
+    const float tieKeys = 1e-5f;
+    for (size_t k = 1; k < order.size(); k++)
+    {
+        int a = order[k];
+        for (size_t j = k; j > 0 && cache.rays[a].key - cache.rays[order[j - 1]].key <= tieKeys; j--)
+        {
+            int b = order[j - 1];
+            if (result.rayAnchors[a] != result.rayAnchors[b])
+            {
+                tied(a, b);
+            }
+        }
+    }
+}
+
+static void clearRays(VisibilityResult& result)
+{
+    result.rays.clear();
+    result.rayCorners.clear();
+    result.rayAnchors.clear();
+    result.collisionPoints.clear();
+    result.collisionDistances.clear();
+    result.collisionSegments.clear();
+    result.collisionSegmentIndices.clear();
+    result.nearestDistance = FLT_MAX;
+}
+
+static void reserveRays(VisibilityResult& result, size_t count)
+{
+    result.rays.reserve(count);
+    result.rayCorners.reserve(count);
+    result.rayAnchors.reserve(count);
+    result.collisionPoints.reserve(count);
+    result.collisionDistances.reserve(count);
+    result.collisionSegments.reserve(count);
+    result.collisionSegmentIndices.reserve(count);
+}
+
+static void appendRay(const VisibilityResult& from, int k, VisibilityResult& to)
+{
+    to.rays.push_back(from.rays[k]);
+    to.rayCorners.push_back(from.rayCorners[k]);
+    to.rayAnchors.push_back(from.rayAnchors[k]);
+    to.collisionPoints.push_back(from.collisionPoints[k]);
+    to.collisionDistances.push_back(from.collisionDistances[k]);
+    to.collisionSegments.push_back(from.collisionSegments[k]);
+    to.collisionSegmentIndices.push_back(from.collisionSegmentIndices[k]);
+}
+
+static void copyRay(const VisibilityResult& from, int k, VisibilityResult& to, int slot)
+{
+    to.rays[slot] = from.rays[k];
+    to.collisionPoints[slot] = from.collisionPoints[k];
+    to.collisionDistances[slot] = from.collisionDistances[k];
+    to.collisionSegments[slot] = from.collisionSegments[k];
+    to.collisionSegmentIndices[slot] = from.collisionSegmentIndices[k];
+}
+
+static void rebuildVisibility(const Level& level, Vec2 position, VisibilityResult& result, VisibilityCache& cache, VisibilityEngine engine)
+{
+    computeVisibility(level, position, result, engine);
+
+    const SegmentStore& segments = level.segments;
+    bool sameGeometry = cache.valid && cache.level == &level && cache.geometryVersion == level.geometryVersion && !cache.crossingStart.empty();
+    cache.valid = true;
+    cache.level = &level;
+    cache.geometryVersion = level.geometryVersion;
+    cache.engine = engine;
+    cache.position = position;
+
+    // the sweep's hits aren't tied to corners, it always runs in full
+    cache.patchable = engine == VisibilityEngine::RayCast && !level.grid.isEmpty();
+    if (!cache.patchable)
+    {
+        return;
+    }
+    if (!sameGeometry)
+    {
+        prepareGeometry(level, cache);
+    }
+
+    int edgeCount = segments.size();
+    cache.facing.resize(edgeCount);
+    for (int shape = 0; shape < segments.shapeCount(); shape++)
+    {
+        computeShapeFacing(segments, shape, position, cache.facing.data());
+        // an observer inside a shape sees through it, no edge of it can be watched
+        int first = segments.shapeStart[shape];
+        if (segments.windingOf(shape) != 0 && first < segments.shapeStart[shape + 1] && cache.facing[first] == 2)
+        {
+            cache.patchable = false;
+        }
+    }
+    std::fill(cache.facing.begin() + segments.screenEdgesStart, cache.facing.end(), (uint8_t)1);
+    collectWatchedEdges(segments, cache);
+
+    // sized for the most rays the caster can give, so patches never reallocate
+    size_t most = 2 * (size_t)edgeCount;
+    int rayCount = (int)result.rays.size();
+    cache.rays.reserve(most);
+    cache.rays.resize(rayCount);
+    for (int k = 0; k < rayCount; k++)
+    {
+        describeRay(level, position, result, cache, k);
+    }
+    cache.cornerRays.resize(edgeCount);
+    indexCornerRays(result, cache);
+    sortIndicesByAngle(result.rays, Vec2(), cache.polygonOrder);
+    // ties seen by the full pass are recast on the first patch
+    cache.tiedCorners.clear();
+    forEachTie(cache.polygonOrder, result, cache, [&](int a, int b)
+    {
+        if (cornerInFront(result, cache, position, a, b, result.collisionDistances[a]))
+        {
+            cache.tiedCorners.push_back(result.rayCorners[a]);
+        }
+        if (cornerInFront(result, cache, position, b, a, result.collisionDistances[b]))
+        {
+            cache.tiedCorners.push_back(result.rayCorners[b]);
+        }
+    });
+
+    cache.dirty.assign(edgeCount, 0);
+    cache.lostEdges.assign(edgeCount, 0);
+    cache.dirtyCorners.reserve(edgeCount);
+    cache.turnedEdges.reserve(edgeCount);
+    cache.turnedArcs.reserve(edgeCount);
+    cache.shapeFacing.resize(edgeCount);
+    cache.sortKeys.reserve(most);
+    cache.previousDistances.reserve(most);
+    cache.mergedRays.reserve(most);
+    cache.mergedIndices.reserve(most);
+    cache.recastOrder.reserve(most);
+    cache.keptOrder.reserve(most);
+    cache.tiedCorners.reserve(edgeCount);
+    cache.polygonOrder.reserve(most);
+    reserveRays(cache.recast, most);
+    reserveRays(cache.merged, most);
+    // the merge swaps the result's arrays with the scratch ones, they take turns
+    reserveRays(result, most);
+    result.polygon.reserve(most);
+    result.fan.reserve(3 * most);
+}
+
+// true if walking from -> to passes through an edge
+static bool crossesAnyEdge(const SegmentGrid& grid, Vec2 from, Vec2 to, std::vector<int>& cells)
+{
+    cells.clear();
+    grid.cellsAlong(from, to, cells);
+    for (int cell : cells)
+    {
+        for (int k = grid.cellStart[cell]; k < grid.cellStart[cell + 1]; k++)
+        {
+            float s, t;
+            if (crossSegments(from, to - from, Vec2(grid.cellX0[k], grid.cellY0[k]), Vec2(grid.cellDX[k], grid.cellDY[k]), s, t))
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// where origin + t * ray meets the line of edge, u along the edge; t < 0 for a ray running along it
+static void intersectEdge(const SegmentStore& segments, int edge, Vec2 origin, Vec2 ray, float& t, float& u)
+{
+    Vec2 direction(segments.dx[edge], segments.dy[edge]);
+    Vec2 w = Vec2(segments.x0[edge], segments.y0[edge]) - origin;
+    float denominator = cross2D(ray, direction);
+    t = denominator != 0.0f ? cross2D(w, direction) / denominator : -1.0f;
+    u = denominator != 0.0f ? cross2D(w, ray) / denominator : -1.0f;
+}
+
+// insertion sort of order on (keys, index), crossed(a, b) for every pair it swaps, a being the one moved back
+template <typename Crossed>
+static void insertionSortRays(std::vector<int>& order, const std::vector<float>& keys, Crossed crossed)
+{
+    for (size_t k = 1; k < order.size(); k++)
+    {
+        int ray = order[k];
+        size_t j = k;
+        while (j > 0 && (keys[ray] < keys[order[j - 1]] || (keys[ray] == keys[order[j - 1]] && ray < order[j - 1])))
+        {
+            crossed(ray, order[j - 1]);
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = ray;
+    }
+}
+
+// moves the hits to the new position, recasting the corners whose hits may have changed; false if too much changed
+static bool patchVisibility(const Level& level, Vec2 position, VisibilityResult& result, VisibilityCache& cache)
+{
+    const SegmentStore& segments = level.segments;
+    int rayCount = (int)result.rays.size();
+    float moveLength = norm(position - cache.position);
+
+    // walking through an edge puts it in front of rays all around
+    if (crossesAnyEdge(level.grid, cache.position, position, cache.cells))
+    {
+        return false;
+    }
+
+    auto markDirty = [&cache](int corner)
+    {
+        if (!cache.dirty[corner])
+        {
+            cache.dirty[corner] = 1;
+            cache.dirtyCorners.push_back(corner);
+        }
+    };
+    for (int corner : cache.tiedCorners)
+    {
+        markDirty(corner);
+    }
+
+    // an edge turns as the observer crosses its line; the corners at its ends gain or lose rays, the rays hitting an edge
+    // that turned away go on past it, and an edge that turned towards the observer may now stop rays
+    size_t watchedCount = cache.watchedEdges.size();
+    for (size_t w = 0; w < watchedCount; w++)
+    {
+        int edge = cache.watchedEdges[w];
+        int shape = cache.edgeShapes[edge];
+        if (segments.facesPoint(edge, segments.windingOf(shape), position) == (cache.facing[edge] == 1))
+        {
+            continue;
+        }
+        int first = segments.shapeStart[shape];
+        int last = segments.shapeStart[shape + 1];
+        computeShapeFacing(segments, shape, position, cache.shapeFacing.data());
+        if (cache.shapeFacing[first] == 2)
+        {
+            return false;
+        }
+        for (int i = first; i < last; i++)
+        {
+            if (cache.shapeFacing[i] != cache.facing[i])
+            {
+                cache.facing[i] = cache.shapeFacing[i];
+                cache.lostEdges[i] = cache.facing[i] == 0;
+                cache.turnedEdges.push_back(i);
+                markDirty(i);
+                markDirty(cache.nextEdges[i]);
+            }
+        }
+    }
+    if (!cache.turnedEdges.empty())
+    {
+        collectWatchedEdges(segments, cache);
+    }
+    // the only rays an edge that turned towards the observer can stop are the few in the sliver of angle it spans
+    cache.turnedArcs.clear();
+    for (int edge : cache.turnedEdges)
+    {
+        if (cache.facing[edge] == 0)
+        {
+            continue;
+        }
+        Vec2 start = Vec2(segments.x0[edge], segments.y0[edge]) - position;
+        float from = rayKey(start);
+        float width = rayKey(start + Vec2(segments.dx[edge], segments.dy[edge])) - from;
+        if (width > 2.0f)
+        {
+            width -= 4.0f;
+        }
+        else if (width < -2.0f)
+        {
+            width += 4.0f;
+        }
+        if (width < 0.0f)
+        {
+            from += width;
+            width = -width;
+        }
+        // with some slack for the rounding of the keys, the segment test below is the exact one
+        cache.turnedArcs.push_back({ edge, from - 1e-4f, width + 2e-4f });
+    }
+
+    // every ray turned back towards its corner, its hit moved along the edge it was on
+    cache.sortKeys.resize(rayCount);
+    cache.previousDistances.resize(rayCount);
+    for (int k = 0; k < rayCount; k++)
+    {
+        int corner = result.rayCorners[k];
+        Vec2 anchor = result.rayAnchors[k];
+        Vec2 toCorner = anchor - position;
+        float cornerDistance = norm(toCorner);
+        if (cornerDistance == 0.0f)
+        {
+            return false;
+        }
+        Vec2 ray = toCorner / cornerDistance;
+        result.rays[k] = ray;
+        cache.previousDistances[k] = result.collisionDistances[k];
+
+        // the key unwrapped around the old one, a ray can only wrap through OX, and a quarter turn is no small move
+        VisibilityCache::RayState& state = cache.rays[k];
+        float key = rayKey(ray);
+        float turn = key - state.key;
+        cache.sortKeys[k] = key;
+        if (turn > 2.0f)
+        {
+            turn -= 4.0f;
+            cache.sortKeys[k] -= 4.0f;
+        }
+        else if (turn < -2.0f)
+        {
+            turn += 4.0f;
+            cache.sortKeys[k] += 4.0f;
+        }
+        if (std::abs(turn) > 1.0f)
+        {
+            return false;
+        }
+        state.key = key;
+
+        if (cache.dirty[corner])
+        {
+            continue;
+        }
+
+        Vec2 origin = state.kind == RayPastCorner ? anchor : position;
+        Vec2 point = anchor;
+        float distance = cornerDistance;
+        bool stale;
+        if (state.kind == RayOnCorner)
+        {
+            // also right after leaving an edge's direction, the last pass may have rounded either way
+            bool along = alongEdge(segments, cache.previousEdges[corner], ray) || alongEdge(segments, corner, ray);
+            stale = cache.crowded[corner] || along || state.along || (state.side != 2 && classifyCorner(segments, corner, position) != state.side);
+        }
+        else
+        {
+            int edge = result.collisionSegmentIndices[k];
+            stale = edge < 0 || cache.lostEdges[edge];
+            if (!stale)
+            {
+                float t, u;
+                intersectEdge(segments, edge, origin, ray, t, u);
+                // run off the end of its edge the hit goes on along the shape's next edge, if that one faces the observer,
+                // no other shape reaches the corner between them and no crossing lies between that corner and the new hit
+                int slidTo = -1;
+                bool forward = u > state.high;
+                if (forward && state.high == 1.0f && !cache.crowded[cache.nextEdges[edge]])
+                {
+                    slidTo = cache.nextEdges[edge];
+                }
+                else if (u < state.low && state.low == 0.0f && !cache.crowded[edge])
+                {
+                    slidTo = cache.previousEdges[edge];
+                }
+                bool slidPast = false;
+                if (slidTo >= 0 && cache.facing[slidTo] != 0 && !cache.lostEdges[slidTo])
+                {
+                    intersectEdge(segments, slidTo, origin, ray, t, u);
+                    slideBounds(segments, cache, slidTo, u, state);
+                    slidPast = forward ? state.low != 0.0f : state.high != 1.0f;
+                    edge = slidTo;
+                    result.collisionSegmentIndices[k] = edge;
+                    result.collisionSegments[k] = segments.getSegment(edge);
+                }
+                point = origin + t * ray;
+                distance = state.kind == RayBlocked ? t : cornerDistance + t;
+                // a hit reaching the corner's neighbourhood stops hiding it
+                stale = t < 0.0f || u < state.low || u > state.high || slidPast || (state.kind == RayBlocked && t >= cornerDistance - cornerReach);
+            }
+        }
+        for (size_t e = 0; e < cache.turnedArcs.size() && !stale; e++)
+        {
+            const VisibilityCache::TurnedArc& arc = cache.turnedArcs[e];
+            float into = key - arc.from;
+            if (into < 0.0f)
+            {
+                into += 4.0f;
+            }
+            else if (into >= 4.0f)
+            {
+                into -= 4.0f;
+            }
+            float s, t;
+            stale = into <= arc.width &&
+                crossSegments(origin, point - origin, Vec2(segments.x0[arc.edge], segments.y0[arc.edge]), Vec2(segments.dx[arc.edge], segments.dy[arc.edge]), s, t);
+        }
+        if (stale)
+        {
+            markDirty(corner);
+            continue;
+        }
+        result.collisionPoints[k] = point;
+        result.collisionDistances[k] = distance;
+    }
+
+    // rays swapping places in angle order are corners crossing each other's rays, which changes a ray's hit when the
+    // other corner passed in front of it (somewhere along the move, hence the slack)
+    auto passedInFront = [&](int ray, int other)
+    {
+        int corner = result.rayCorners[ray];
+        float reach = std::max(cache.previousDistances[ray], result.collisionDistances[ray]) + 2.0f * moveLength;
+        if (!cache.dirty[corner] && cornerInFront(result, cache, position, ray, other, reach))
+        {
+            markDirty(corner);
+        }
+    };
+    auto crossed = [&](int a, int b)
+    {
+        passedInFront(a, b);
+        passedInFront(b, a);
+    };
+    std::vector<int>& order = cache.polygonOrder;
+    insertionSortRays(order, cache.sortKeys, crossed);
+
+    // rays that turned through OX now sort before (or after) the others, bring them round and pass the rays they crossed
+    int wrappedForward = 0;
+    int wrappedBack = 0;
+    while (wrappedBack < rayCount && cache.sortKeys[order[wrappedBack]] < 0.0f)
+    {
+        wrappedBack++;
+    }
+    while (wrappedForward < rayCount - wrappedBack && cache.sortKeys[order[rayCount - 1 - wrappedForward]] >= 4.0f)
+    {
+        wrappedForward++;
+    }
+    if (wrappedBack > 0 || wrappedForward > 0)
+    {
+        std::rotate(order.begin(), order.begin() + wrappedBack, order.end());
+        std::rotate(order.begin(), order.end() - wrappedBack - wrappedForward, order.end() - wrappedBack);
+        for (int k = 0; k < rayCount; k++)
+        {
+            cache.sortKeys[k] = cache.rays[k].key;
+        }
+        insertionSortRays(order, cache.sortKeys, crossed);
+    }
+    // a corner right on another's ray counts as crossing it, now and on the next move whichever way they part
+    cache.tiedCorners.clear();
+    forEachTie(order, result, cache, [&](int a, int b)
+    {
+        crossed(a, b);
+        for (int ray : { a, b })
+        {
+            if (cache.dirty[result.rayCorners[ray]])
+            {
+                cache.tiedCorners.push_back(result.rayCorners[ray]);
+            }
+        }
+    });
+
+    // past this a full pass is cheaper than the recasts and the merge
+    if (4 * cache.dirtyCorners.size() > (size_t)rayCount)
+    {
+        return false;
+    }
+
+    if (!cache.dirtyCorners.empty())
+    {
+        std::sort(cache.dirtyCorners.begin(), cache.dirtyCorners.end());
+        VisibilityResult& recast = cache.recast;
+        clearRays(recast);
+        castCornerRays(level, position, cache.facing, cache.dirtyCorners, recast);
+        LOS_PROFILE_COUNT(CounterRaysCast, recast.rays.size());
+
+        // while every recast corner keeps its ray count, its rays keep their slots, their directions and so their order
+        bool sameCounts = true;
+        int next = 0;
+        int recastCount = (int)recast.rays.size();
+        for (int corner : cache.dirtyCorners)
+        {
+            int count = 0;
+            for (int k = cache.cornerRays[corner]; k >= 0 && k < rayCount && result.rayCorners[k] == corner; k++)
+            {
+                count++;
+            }
+            int recastCorner = 0;
+            while (next + recastCorner < recastCount && recast.rayCorners[next + recastCorner] == corner)
+            {
+                recastCorner++;
+            }
+            if (count != recastCorner)
+            {
+                sameCounts = false;
+                break;
+            }
+            next += recastCorner;
+        }
+
+        if (sameCounts)
+        {
+            for (int k = 0; k < recastCount; k++)
+            {
+                int slot = cache.cornerRays[recast.rayCorners[k]] + (k > 0 && recast.rayCorners[k - 1] == recast.rayCorners[k]);
+                copyRay(recast, k, result, slot);
+                describeRay(level, position, result, cache, slot);
+            }
+        }
+        else
+        {
+            // merged in corner order, the order the full pass appends in
+            VisibilityResult& merged = cache.merged;
+            std::vector<VisibilityCache::RayState>& mergedRays = cache.mergedRays;
+            std::vector<int>& mergedIndices = cache.mergedIndices;
+            std::vector<int>& recastOrder = cache.recastOrder;
+            clearRays(merged);
+            mergedRays.clear();
+            mergedIndices.resize(rayCount);
+            recastOrder.clear();
+            int r = 0;
+            for (int k = 0; k <= rayCount; k++)
+            {
+                int corner = k < rayCount ? result.rayCorners[k] : segments.size();
+                while (r < recastCount && recast.rayCorners[r] <= corner)
+                {
+                    recastOrder.push_back((int)merged.rays.size());
+                    appendRay(recast, r++, merged);
+                    mergedRays.emplace_back();
+                }
+                if (k < rayCount && cache.dirty[corner])
+                {
+                    mergedIndices[k] = -1;
+                }
+                else if (k < rayCount)
+                {
+                    mergedIndices[k] = (int)merged.rays.size();
+                    appendRay(result, k, merged);
+                    mergedRays.push_back(cache.rays[k]);
+                }
+            }
+            result.rays.swap(merged.rays);
+            result.rayCorners.swap(merged.rayCorners);
+            result.rayAnchors.swap(merged.rayAnchors);
+            result.collisionPoints.swap(merged.collisionPoints);
+            result.collisionDistances.swap(merged.collisionDistances);
+            result.collisionSegments.swap(merged.collisionSegments);
+            result.collisionSegmentIndices.swap(merged.collisionSegmentIndices);
+            cache.rays.swap(mergedRays);
+
+            for (int k : recastOrder)
+            {
+                describeRay(level, position, result, cache, k);
+            }
+            indexCornerRays(result, cache);
+
+            // the kept rays are still in order, the few recast ones are sorted and merged in, on the same (key, index)
+            // order as the full pass's stable sort
+            auto before = [&cache](int a, int b)
+            {
+                return cache.rays[a].key < cache.rays[b].key || (cache.rays[a].key == cache.rays[b].key && a < b);
+            };
+            std::sort(recastOrder.begin(), recastOrder.end(), before);
+            std::vector<int>& keptOrder = cache.keptOrder;
+            keptOrder.clear();
+            for (int k : order)
+            {
+                if (mergedIndices[k] >= 0)
+                {
+                    keptOrder.push_back(mergedIndices[k]);
+                }
+            }
+            rayCount = (int)result.rays.size();
+            order.resize(rayCount);
+            std::merge(keptOrder.begin(), keptOrder.end(), recastOrder.begin(), recastOrder.end(), order.begin(), before);
+        }
+    }
+
+    result.nearestDistance = FLT_MAX;
+    for (int k = 0; k < rayCount; k++)
+    {
+        if (result.collisionDistances[k] < result.nearestDistance)
+        {
+            result.nearestDistance = result.collisionDistances[k];
+            result.nearestPoint = result.collisionPoints[k];
+            result.nearestSegment = result.collisionSegments[k];
+        }
+    }
+    result.polygon.resize(order.size());
+    for (size_t k = 0; k < order.size(); k++)
+    {
+        result.polygon[k] = result.collisionPoints[order[k]];
+    }
+    buildVisionFan(position, result.polygon, result.fan);
+    cache.position = position;
+    return true;
+}
+
+// drops the marks a patch left, whether it went through or not
+static void clearPatchMarks(VisibilityCache& cache)
+{
+    for (int corner : cache.dirtyCorners)
+    {
+        cache.dirty[corner] = 0;
+    }
+    for (int edge : cache.turnedEdges)
+    {
+        cache.lostEdges[edge] = 0;
+    }
+    cache.dirtyCorners.clear();
+    cache.turnedEdges.clear();
+}
+
+VisibilityUpdate updateVisibility(const Level& level, Vec2 position, VisibilityResult& result, VisibilityCache& cache, VisibilityEngine engine)
+{
+    LOS_PROFILE_ZONE("updateVisibility");
+    bool sameGeometry = cache.valid && cache.level == &level && cache.geometryVersion == level.geometryVersion && cache.engine == engine;
+    if (sameGeometry && cache.position == position)
+    {
+        return VisibilityUpdate::Reused;
+    }
+
+    if (sameGeometry && cache.patchable)
+    {
+        bool patched = patchVisibility(level, position, result, cache);
+        clearPatchMarks(cache);
+        if (patched)
+        {
+            return VisibilityUpdate::Patched;
+        }
+    }
+
+    rebuildVisibility(level, position, result, cache, engine);
+    return VisibilityUpdate::Rebuilt;
+}
@@ -0,0 +1,154 @@
+#include "visibility.h"
+#include "profiler.h"
+
+#include <algorithm>
+
+// ===== ===== =====
+// POLYGON QUERIES
+// ===== ===== =====
+// sector i is the wedge between points[i] and points[i + 1] (the last one closes back on points[0]),
+// inside that wedge the polygon is the triangle (origin, points[i], points[i + 1])
+// an open (cone) polygon has one wedge that isn't part of it, gapSector, its sides are the two radial edges to the origin
+
+void VisibilityQuery::build(Vec2 origin, const std::vector<Vec2>& polygon, bool open)
+{
+    LOS_PROFILE_ZONE("VisibilityQuery::build");
+    this->origin = origin;
+    points.clear();
+    keys.clear();
+    gapSector = -1;
+    if (polygon.size() < 3)
+    {
+        return;
+    }
+
+    // as much room as the polygon's own buffer, a polygon that changes size below that never regrows these
+    points.reserve(polygon.capacity());
+    keys.reserve(polygon.capacity());
+
+    // every engine keeps the polygon in circular angle order but not all of them start at OX,
+    // start after the wrap, the one big drop in the keys (hits sharing a ray may differ by a rounding step either way)
+    size_t first = 0;
+    float largestDrop = 0.0f;
+    float previous = pseudoAngle(polygon.back() - origin);
+    for (size_t i = 0; i < polygon.size(); i++)
+    {
+        float key = pseudoAngle(polygon[i] - origin);
+        if (previous - key > largestDrop)
+        {
+            largestDrop = previous - key;
+            first = i;
+        }
+        previous = key;
+    }
+
+    for (size_t k = 0; k < polygon.size(); k++)
+    {
+        Vec2 point = polygon[(first + k) % polygon.size()];
+        // hits sharing a ray can land a rounding step below the one before, the binary search needs them tied
+        float key = pseudoAngle(point - origin);
+        if (!keys.empty())
+        {
+            key = std::max(key, keys.back());
+        }
+        points.push_back(point);
+        keys.push_back(key);
+    }
+    if (open)
+    {
+        // the wedge starting at the polygon's last point
+        gapSector = (int)((polygon.size() - 1 - first + polygon.size()) % polygon.size());
+    }
+}
+
+int VisibilityQuery::sectorOf(float key) const
+{
+    // last point at or before key, so runs of points on the same ray resolve to their outer edge
+    int upper = (int)(std::upper_bound(keys.begin(), keys.end(), key) - keys.begin());
+    return upper == 0 ? (int)points.size() - 1 : upper - 1;
+}
+
+bool VisibilityQuery::insideSector(int sector, Vec2 point) const
+{
+    if (sector == gapSector)
+    {
+        return false;
+    }
+    Vec2 a = points[sector];
+    Vec2 b = points[(sector + 1) % points.size()];
+    Vec2 edge = b - a;
+    // same side of the far edge as the observer
+    float pointSide = cross2D(edge, point - a);
+    float originSide = cross2D(edge, origin - a);
+    return pointSide * originSide >= 0.0f;
+}
+
+bool VisibilityQuery::containsPoint(Vec2 point) const
+{
+    if (isEmpty())
+    {
+        return false;
+    }
+    if (point == origin)
+    {
+        return true;
+    }
+    return insideSector(sectorOf(pseudoAngle(point - origin)), point);
+}
+
+static float distanceToSegment(Vec2 point, Vec2 a, Vec2 b)
+{
+    Vec2 edge = b - a;
+    float length2 = dot(edge, edge);
+    float t = length2 > 0.0f ? std::clamp(dot(point - a, edge) / length2, 0.0f, 1.0f) : 0.0f;
+    return norm(point - (a + t * edge));
+}
+
+bool VisibilityQuery::overlapsCircle(Vec2 center, float radius) const
+{
+    if (isEmpty())
+    {
+        return false;
+    }
+    Vec2 toCenter = center - origin;
+    float distance = norm(toCenter);
+    if (distance <= radius)
+    {
+        return true;
+    }
+    if (containsPoint(center))
+    {
+        return true;
+    }
+
+    // otherwise the disc has to cross the boundary, and every point of the disc lies within the
+    // angles of its two tangents from the observer, so only the edges of those sectors can reach it
+    float sine = radius / distance;
+    float cosine = std::sqrt(1.0f - sine * sine);
+    Vec2 low(toCenter.x * cosine + toCenter.y * sine, toCenter.y * cosine - toCenter.x * sine);
+    Vec2 high(toCenter.x * cosine - toCenter.y * sine, toCenter.y * cosine + toCenter.x * sine);
+    int sector = sectorOf(pseudoAngle(low));
+    int last = sectorOf(pseudoAngle(high));
+    int count = (int)points.size();
+    for (int walked = 0; walked < count; walked++)
+    {
+        Vec2 a = points[sector];
+        Vec2 b = points[(sector + 1) % count];
+        if (sector != gapSector && distanceToSegment(center, a, b) <= radius)
+        {
+            return true;
+        }
+        if (sector == last)
+        {
+            break;
+        }
+        sector = (sector + 1) % count;
+    }
+    // an open polygon is also bounded by the sides of its cone
+    if (gapSector >= 0)
+    {
+        return distanceToSegment(center, origin, points[gapSector]) <= radius ||
+            distanceToSegment(center, origin, points[(gapSector + 1) % count]) <= radius;
+    }
+    return false;
+}
@@ -0,0 +1,242 @@
+#include "visibility.h"
+#include "framearena.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <set>
+
+// ===== ===== =====
+// ANGULAR SWEEP
+// ===== ===== =====
+// every edge becomes a begin and an end event at the angles of its endpoints (seen from the observer),
+// the events are sorted once and swept around the full circle while an ordered set keeps the
+// active edges sorted by distance along the current sweep direction
+// edges don't cross each other, so the order of the active edges only has to be decided on insertion
+
+namespace
+{
+    struct SweepEvent
+    {
+        float angle;
+        int segment;
+        bool begin;
+        Vec2 point;     // endpoint, relative to the observer
+    };
+
+    bool isEarlierEvent(const SweepEvent& e1, const SweepEvent& e2)
+    {
+        if (e1.angle != e2.angle)
+        {
+            return e1.angle < e2.angle;
+        }
+        // close edges before opening new ones at the same angle
+        return !e1.begin && e2.begin;
+    }
+
+    // ray parameter where direction (from origin) meets the edge's supporting line
+    // edges parallel to the direction report their nearest endpoint
+    float distanceAlong(const SegmentStore& segments, int i, Vec2 origin, Vec2 direction)
+    {
+        float wx = segments.x0[i] - origin.x;
+        float wy = segments.y0[i] - origin.y;
+        float denominator = direction.x * segments.dy[i] - direction.y * segments.dx[i];
+        if (denominator == 0.0f)
+        {
+            float d0 = wx * wx + wy * wy;
+            float ex = wx + segments.dx[i];
+            float ey = wy + segments.dy[i];
+            return std::sqrt(std::fmin(d0, ex * ex + ey * ey));
+        }
+        return (wx * segments.dy[i] - wy * segments.dx[i]) / denominator;
+    }
+
+    struct SweepState
+    {
+        const SegmentStore* segments;
+        Vec2 origin;
+        Vec2 direction;
+    };
+
+    struct CloserEdge
+    {
+        const SweepState* state;
+
+        bool operator()(int a, int b) const
+        {
+            if (a == b)
+            {
+                return false;
+            }
+            float da = distanceAlong(*state->segments, a, state->origin, state->direction);
+            float db = distanceAlong(*state->segments, b, state->origin, state->direction);
+            if (da != db)
+            {
+                return da < db;
+            }
+            return a < b;
+        }
+    };
+
+    Vec2 directionOf(float angle)
+    {
+        return Vec2(std::cos(angle), std::sin(angle));
+    }
+
+    // the active edges only live for one sweep, their tree nodes come from the thread's frame arena
+    typedef std::set<int, CloserEdge, ArenaAllocator<int>> ActiveEdges;
+
+    // per thread buffers kept across calls, so repeated sweeps (and batches of observers) don't reallocate them
+    struct SweepScratch
+    {
+        std::vector<ActiveEdges::iterator> handles;
+        std::vector<SweepEvent> events;
+        std::vector<int> wrapping;
+    };
+
+    thread_local SweepScratch scratch;
+}
+
+static void appendHit(VisibilityResult& result, Vec2 position, Vec2 direction, Vec2 anchor, float distance, const Segment& segment, int segmentIndex)
+{
+    Vec2 point = position + distance * direction;
+    result.rays.push_back(direction);
+    result.rayAnchors.push_back(anchor);
+    result.collisionPoints.push_back(point);
+    result.collisionDistances.push_back(distance);
+    result.collisionSegments.push_back(segment);
+    result.collisionSegmentIndices.push_back(segmentIndex);
+    result.polygon.push_back(point);
+
+    if (distance < result.nearestDistance)
+    {
+        result.nearestDistance = distance;
+        result.nearestPoint = point;
+        result.nearestSegment = segment;
+    }
+}
+
+void computeVisibilitySweep(const Level& level, Vec2 position, VisibilityResult& result)
+{
+    computeVisibilitySweep(level.segments, position, result);
+}
+
+void computeVisibilitySweep(const SegmentStore& segments, Vec2 position, VisibilityResult& result)
+{
+    LOS_PROFILE_COUNT(CounterSegmentsTested, segments.size());
+    result.rays.clear();
+    result.rayAnchors.clear();
+    result.rayCorners.clear();
+    result.collisionPoints.clear();
+    result.collisionDistances.clear();
+    result.collisionSegments.clear();
+    result.collisionSegmentIndices.clear();
+    result.polygon.clear();
+    result.open = false;
+    result.nearestDistance = FLT_MAX;
+
+    SweepState state{ &segments, position, Vec2(-1.0f, 0.0f) };
+    FrameArenaScope arenaScope(threadFrameArena());
+    ActiveEdges active(CloserEdge{ &state }, ArenaAllocator<int>(threadFrameArena()));
+    std::vector<ActiveEdges::iterator>& handles = scratch.handles;
+    std::vector<SweepEvent>& events = scratch.events;
+    std::vector<int>& wrapping = scratch.wrapping;
+    handles.assign(segments.size(), active.end());
+    events.clear();
+    events.reserve(2 * segments.size());
+    wrapping.clear();
+
+    for (int i = 0; i < segments.size(); i++)
+    {
+        Vec2 start = Vec2(segments.x0[i], segments.y0[i]) - position;
+        Vec2 end = start + Vec2(segments.dx[i], segments.dy[i]);
+        float turn = cross2D(start, end);
+        // edges pointing at the observer hide nothing
+        if (std::abs(turn) < 0.01f)
+        {
+            continue;
+        }
+        if (turn < 0)
+        {
+            std::swap(start, end);
+        }
+        float startAngle = std::atan2(start.y, start.x);
+        float endAngle = std::atan2(end.y, end.x);
+        events.push_back({ startAngle, i, true, start });
+        events.push_back({ endAngle, i, false, end });
+        // edge spans the -pi / pi cut, already active when the sweep starts
+        if (startAngle > endAngle)
+        {
+            wrapping.push_back(i);
+        }
+    }
+    std::sort(events.begin(), events.end(), isEarlierEvent);
+
+    if (events.empty())
+    {
+        buildVisionFan(position, result.polygon, result.fan);
+        return;
+    }
+
+    // insertion order is decided halfway to the next distinct event angle, where every active edge is defined
+    float firstAngle = events.front().angle;
+    state.direction = directionOf((-pi + firstAngle) / 2);
+    for (size_t i = 0; i < wrapping.size(); i++)
+    {
+        handles[wrapping[i]] = active.insert(wrapping[i]).first;
+    }
+
+    size_t e = 0;
+    while (e < events.size())
+    {
+        float angle = events[e].angle;
+        size_t groupEnd = e;
+        while (groupEnd < events.size() && events[groupEnd].angle == angle)
+        {
+            groupEnd++;
+        }
+        float nextAngle = groupEnd < events.size() ? events[groupEnd].angle : pi + (firstAngle + pi);
+        Vec2 direction = directionOf(angle);
+        Vec2 anchor = position + events[e].point;
+
+        // visible edge right before this angle
+        int before = active.empty() ? -1 : *active.begin();
+        float beforeDistance = before >= 0 ? distanceAlong(segments, before, position, direction) : FLT_MAX;
+
+        for (size_t k = e; k < groupEnd; k++)
+        {
+            int segment = events[k].segment;
+            if (!events[k].begin && handles[segment] != active.end())
+            {
+                active.erase(handles[segment]);
+                handles[segment] = active.end();
+            }
+        }
+        state.direction = directionOf((angle + nextAngle) / 2);
+        for (size_t k = e; k < groupEnd; k++)
+        {
+            int segment = events[k].segment;
+            if (events[k].begin && handles[segment] == active.end())
+            {
+                handles[segment] = active.insert(segment).first;
+            }
+        }
+
+        // visible edge right after this angle
+        int after = active.empty() ? -1 : *active.begin();
+        float afterDistance = after >= 0 ? distanceAlong(segments, after, position, direction) : FLT_MAX;
+
+        if (before >= 0)
+        {
+            appendHit(result, position, direction, anchor, beforeDistance, segments.getSegment(before), before);
+        }
+        if (after >= 0 && (before < 0 || std::abs(afterDistance - beforeDistance) > 0.01f))
+        {
+            appendHit(result, position, direction, anchor, afterDistance, segments.getSegment(after), after);
+        }
+
+        e = groupEnd;
+    }
+
+    buildVisionFan(position, result.polygon, result.fan);
+}
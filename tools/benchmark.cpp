@@ -0,0 +1,510 @@
+#include "entitystore.h"
+#include "levelgen.h"
+#include "physics.h"
+#include "threadpool.h"
+#include "visibility.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+
+// times the headless parts of a frame on generated levels and prints one JSON document to stdout
+// usage: benchmark [--scene maze|field|city|all] [--segments n,n,...] [--observers n] [--enemies n]
+//                  [--frames n] [--engine raycast|sweep] [--index grid|bvh|none|pvs] [--threads n] [--seed n]
+//                  [--cone degrees,range] [--cache on|off]
+// --cone gives every observer a vision cone (full field of view in degrees) turned along its movement instead of a full pass
+// --cache off recomputes every observer's visibility each frame instead of going through updateVisibility
+
+// ===== ===== =====
+// ALLOCATION COUNTING
+// ===== ===== =====
+// every global new in the process goes through here, the sections read the counter before and after
+
+static std::atomic<uint64_t> allocationCount(0);
+
+void* operator new(size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size > 0 ? size : 1))
+    {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept
+{
+    std::free(memory);
+}
+
+// ===== ===== =====
+// SETTINGS
+// ===== ===== =====
+
+struct BenchmarkSettings
+{
+    std::vector<LevelLayout> layouts = { LevelLayout::Maze, LevelLayout::ObstacleField, LevelLayout::CityBlocks };
+    std::vector<int> segmentCounts = { 1000, 10000, 100000 };
+    int observers = 1;
+    int enemies = 1000;
+    int frames = 100;
+    int warmupFrames = 10;
+    VisibilityEngine engine = VisibilityEngine::RayCast;
+    int coneDegrees = 0;    // 0 sees all around
+    int coneRange = 300;
+    bool incremental = true;
+    SpatialIndex spatialIndex = SpatialIndex::Grid;
+    int threads = 0;
+    unsigned seed = 1;
+};
+
+static const char* engineName(VisibilityEngine engine)
+{
+    return engine == VisibilityEngine::RayCast ? "raycast" : "sweep";
+}
+
+static const char* spatialIndexName(SpatialIndex index)
+{
+    switch (index)
+    {
+    case SpatialIndex::Grid:
+        return "grid";
+    case SpatialIndex::BVH:
+        return "bvh";
+    case SpatialIndex::None:
+        return "none";
+    case SpatialIndex::PVS:
+        return "pvs";
+    }
+    return "";
+}
+
+static bool parseCount(const char* text, int minimum, int& value)
+{
+    char* end = nullptr;
+    long parsed = std::strtol(text, &end, 10);
+    if (end == text || *end != '\0' || parsed < minimum || parsed > (1L << 30))
+    {
+        return false;
+    }
+    value = (int)parsed;
+    return true;
+}
+
+static bool parseSettings(int argc, char** argv, BenchmarkSettings& settings)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string option = argv[i];
+        if (i + 1 >= argc)
+        {
+            return false;
+        }
+        const char* value = argv[++i];
+        bool valid = true;
+        if (option == "--scene")
+        {
+            LevelLayout layout;
+            if (std::strcmp(value, "all") != 0)
+            {
+                valid = parseLevelLayout(value, layout);
+                settings.layouts.assign(1, layout);
+            }
+        }
+        else if (option == "--segments")
+        {
+            settings.segmentCounts.clear();
+            std::istringstream list(value);
+            std::string item;
+            while (valid && std::getline(list, item, ','))
+            {
+                int count;
+                valid = parseCount(item.c_str(), 1, count);
+                settings.segmentCounts.push_back(count);
+            }
+            valid = valid && !settings.segmentCounts.empty();
+        }
+        else if (option == "--observers")
+        {
+            valid = parseCount(value, 1, settings.observers);
+        }
+        else if (option == "--enemies")
+        {
+            valid = parseCount(value, 0, settings.enemies);
+        }
+        else if (option == "--frames")
+        {
+            valid = parseCount(value, 1, settings.frames);
+        }
+        else if (option == "--engine")
+        {
+            valid = std::strcmp(value, "raycast") == 0 || std::strcmp(value, "sweep") == 0;
+            settings.engine = std::strcmp(value, "sweep") == 0 ? VisibilityEngine::AngularSweep : VisibilityEngine::RayCast;
+        }
+        else if (option == "--cone")
+        {
+            std::istringstream list(value);
+            std::string degrees, range;
+            valid = std::getline(list, degrees, ',') && std::getline(list, range) &&
+                parseCount(degrees.c_str(), 1, settings.coneDegrees) && parseCount(range.c_str(), 1, settings.coneRange);
+        }
+        else if (option == "--cache")
+        {
+            valid = std::strcmp(value, "on") == 0 || std::strcmp(value, "off") == 0;
+            settings.incremental = std::strcmp(value, "on") == 0;
+        }
+        else if (option == "--index")
+        {
+            valid = false;
+            for (SpatialIndex index : { SpatialIndex::Grid, SpatialIndex::BVH, SpatialIndex::None, SpatialIndex::PVS })
+            {
+                if (std::strcmp(value, spatialIndexName(index)) == 0)
+                {
+                    settings.spatialIndex = index;
+                    valid = true;
+                }
+            }
+        }
+        else if (option == "--threads")
+        {
+            valid = parseCount(value, 1, settings.threads);
+        }
+        else if (option == "--seed")
+        {
+            int seed;
+            valid = parseCount(value, 1, seed);
+            settings.seed = (unsigned)seed;
+        }
+        else
+        {
+            valid = false;
+        }
+        if (!valid)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// ===== ===== =====
+// MEASUREMENT
+// ===== ===== =====
+
+// accumulated time and allocations of one part of the frame
+struct Section
+{
+    double nanoseconds = 0.0;
+    uint64_t allocations = 0;
+
+    std::chrono::steady_clock::time_point start;
+    uint64_t startAllocations = 0;
+
+    void begin()
+    {
+        startAllocations = allocationCount.load(std::memory_order_relaxed);
+        start = std::chrono::steady_clock::now();
+    }
+
+    void end()
+    {
+        nanoseconds += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        allocations += allocationCount.load(std::memory_order_relaxed) - startAllocations;
+    }
+};
+
+struct RunResult
+{
+    int segments = 0;
+    int shapes = 0;
+    int observers = 0;
+    int enemies = 0;
+    double setupMilliseconds = 0.0;
+
+    Section visibility;
+    Section seenTest;
+    Section physics;
+    uint64_t rays = 0;
+    uint64_t rebuilt = 0;
+    uint64_t patched = 0;
+    uint64_t seen = 0;
+};
+
+// observers walk straight lines and turn somewhere random when a wall stops them, like a player on the arrow keys
+struct Observer
+{
+    Entity body;
+    VisibilityResult vision;
+    VisibilityCache cache;
+    VisibilityQuery query;
+
+    explicit Observer(Vec2 position) : body(position) {}
+};
+
+static Vec2 randomHeading(std::mt19937& generator, float speed)
+{
+    float angle = std::uniform_real_distribution<float>(0.0f, 2 * pi)(generator);
+    return speed * Vec2(std::cos(angle), std::sin(angle));
+}
+
+static RunResult runScene(LevelLayout layout, int segmentCount, const BenchmarkSettings& settings, ThreadPool& pool)
+{
+    const float dt = 1.0f / 60.0f;
+    const float actorRadius = 10.0f;
+    RunResult result;
+
+    auto setupStart = std::chrono::steady_clock::now();
+    Level level;
+    generateLevel(level, layout, segmentCount, settings.seed);
+    level.spatialIndex = settings.spatialIndex;
+    if (settings.spatialIndex == SpatialIndex::PVS)
+    {
+        bakePVS(level, 0.0f, &pool);
+    }
+    result.setupMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - setupStart).count();
+    result.segments = level.segments.size();
+    result.shapes = (int)level.shapes.size();
+
+    std::vector<Vec2> points;
+    std::mt19937 generator(settings.seed);
+    randomFreePoints(level, settings.observers, actorRadius + 1.0f, settings.seed, points);
+    std::vector<Observer> observers;
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        observers.emplace_back(points[i]);
+        observers.back().body.velocity = randomHeading(generator, observers.back().body.max_speed);
+    }
+    result.observers = (int)observers.size();
+
+    EntityStore enemies;
+    randomFreePoints(level, settings.enemies, enemies.radius + 1.0f, settings.seed + 1, points);
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        enemies.add(points[i], randomHeading(generator, 150.0f));
+    }
+    result.enemies = enemies.size();
+
+    for (int frame = 0; frame < settings.warmupFrames + settings.frames; frame++)
+    {
+        // the first frames size every buffer, only the steady state is measured
+        bool measured = frame >= settings.warmupFrames;
+
+        if (measured)
+        {
+            result.physics.begin();
+        }
+        for (size_t i = 0; i < observers.size(); i++)
+        {
+            Entity& body = observers[i].body;
+            body.update(dt);
+            if (settings.coneDegrees > 0)
+            {
+                resolveActorCollision(level, body, actorRadius);
+            }
+            else
+            {
+                resolveActorCollision(level, body, observers[i].vision.nearestSegment, actorRadius);
+            }
+        }
+        enemies.update(level, nullptr, dt, &pool);
+        if (measured)
+        {
+            result.physics.end();
+        }
+
+        // steering is the benchmark's business, not part of any measured path
+        for (size_t i = 0; i < observers.size(); i++)
+        {
+            Entity& body = observers[i].body;
+            bool outside = body.position.x < level.boundsMin.x + actorRadius || body.position.x > level.boundsMax.x - actorRadius ||
+                body.position.y < level.boundsMin.y + actorRadius || body.position.y > level.boundsMax.y - actorRadius;
+            if (outside || level.grid.findShapeContaining(level.segments, body.position) >= 0)
+            {
+                body.position = body.lastPosition;
+            }
+            if (outside || body.velocity.x == 0.0f || body.velocity.y == 0.0f)
+            {
+                body.velocity = randomHeading(generator, body.max_speed);
+            }
+        }
+
+        if (measured)
+        {
+            result.visibility.begin();
+        }
+        for (size_t i = 0; i < observers.size(); i++)
+        {
+            Observer& observer = observers[i];
+            VisibilityUpdate update = VisibilityUpdate::Rebuilt;
+            if (settings.coneDegrees > 0)
+            {
+                VisionCone cone;
+                cone.heading = observer.body.velocity;
+                cone.halfAngle = settings.coneDegrees * pi / 360.0f;
+                cone.range = (float)settings.coneRange;
+                computeVisibilityCone(level, observer.body.position, cone, observer.vision);
+            }
+            else if (settings.incremental)
+            {
+                update = updateVisibility(level, observer.body.position, observer.vision, observer.cache, settings.engine);
+            }
+            else
+            {
+                computeVisibility(level, observer.body.position, observer.vision, settings.engine);
+            }
+            if (update != VisibilityUpdate::Reused)
+            {
+                observer.query.build(observer.body.position, observer.vision.polygon, observer.vision.open);
+            }
+            if (measured)
+            {
+                result.rays += observer.vision.rays.size();
+                result.rebuilt += update == VisibilityUpdate::Rebuilt;
+                result.patched += update == VisibilityUpdate::Patched;
+            }
+        }
+        if (measured)
+        {
+            result.visibility.end();
+        }
+
+        if (measured)
+        {
+            result.seenTest.begin();
+        }
+        uint64_t seenThisFrame = 0;
+        for (int e = 0; e < enemies.size(); e++)
+        {
+            Vec2 position = enemies.position(e);
+            for (size_t i = 0; i < observers.size(); i++)
+            {
+                if (observers[i].query.overlapsCircle(position, enemies.radius))
+                {
+                    seenThisFrame++;
+                    break;
+                }
+            }
+        }
+        if (measured)
+        {
+            result.seenTest.end();
+            result.seen += seenThisFrame;
+        }
+    }
+    return result;
+}
+
+// ===== ===== =====
+// REPORT
+// ===== ===== =====
+
+static std::string compilerName()
+{
+    std::ostringstream name;
+#if defined(__clang__)
+    name << "clang " << __clang_major__ << "." << __clang_minor__ << "." << __clang_patchlevel__;
+#elif defined(__GNUC__)
+    name << "gcc " << __GNUC__ << "." << __GNUC_MINOR__ << "." << __GNUC_PATCHLEVEL__;
+#elif defined(_MSC_VER)
+    name << "msvc " << _MSC_VER;
+#else
+    name << "unknown";
+#endif
+    return name.str();
+}
+
+static void writeSection(std::ostream& out, const char* name, const Section& section, int frames, double items, const char* itemName)
+{
+    out << "        \"" << name << "\": { \"ns_per_frame\": " << section.nanoseconds / frames
+        << ", \"ns_per_" << itemName << "\": " << (items > 0 ? section.nanoseconds / items : 0.0)
+        << ", \"allocations_per_frame\": " << (double)section.allocations / frames;
+}
+
+int main(int argc, char** argv)
+{
+    BenchmarkSettings settings;
+    if (!parseSettings(argc, argv, settings))
+    {
+        std::cerr << "usage: benchmark [--scene maze|field|city|all] [--segments n,n,...] [--observers n] [--enemies n]" << std::endl;
+        std::cerr << "                 [--frames n] [--engine raycast|sweep] [--index grid|bvh|none|pvs] [--threads n] [--seed n]" << std::endl;
+        std::cerr << "                 [--cone degrees,range] [--cache on|off]" << std::endl;
+        return 2;
+    }
+    ThreadPool pool(settings.threads);
+
+    std::ostream& out = std::cout;
+    out.precision(6);
+    out << "{\n";
+    out << "  \"format\": 1,\n";
+#ifdef NDEBUG
+    out << "  \"build\": { \"compiler\": \"" << compilerName() << "\", \"optimized\": true },\n";
+#else
+    out << "  \"build\": { \"compiler\": \"" << compilerName() << "\", \"optimized\": false },\n";
+#endif
+    out << "  \"settings\": { \"frames\": " << settings.frames << ", \"warmup_frames\": " << settings.warmupFrames
+        << ", \"engine\": \"" << engineName(settings.engine) << "\", \"index\": \"" << spatialIndexName(settings.spatialIndex)
+        << "\", \"cache\": " << (settings.incremental ? "true" : "false") << ", \"threads\": " << pool.size() << ", \"seed\": " << settings.seed;
+    if (settings.coneDegrees > 0)
+    {
+        out << ", \"cone_degrees\": " << settings.coneDegrees << ", \"cone_range\": " << settings.coneRange;
+    }
+    out << " },\n";
+    out << "  \"results\": [\n";
+
+    bool first = true;
+    for (size_t l = 0; l < settings.layouts.size(); l++)
+    {
+        for (size_t s = 0; s < settings.segmentCounts.size(); s++)
+        {
+            RunResult result = runScene(settings.layouts[l], settings.segmentCounts[s], settings, pool);
+            int frames = settings.frames;
+            double raysPerSecond = result.visibility.nanoseconds > 0.0 ? result.rays * 1e9 / result.visibility.nanoseconds : 0.0;
+
+            out << (first ? "" : ",\n");
+            first = false;
+            out << "    {\n";
+            out << "      \"scene\": \"" << levelLayoutName(settings.layouts[l]) << "\", \"requested_segments\": " << settings.segmentCounts[s]
+                << ", \"segments\": " << result.segments << ", \"shapes\": " << result.shapes << ", \"observers\": " << result.observers
+                << ", \"enemies\": " << result.enemies << ", \"setup_ms\": " << result.setupMilliseconds << ",\n";
+            out << "      \"sections\": {\n";
+            writeSection(out, "visibility", result.visibility, frames, (double)result.rays, "ray");
+            out << ", \"rays_per_second\": " << raysPerSecond << ", \"rays_per_frame\": " << (double)result.rays / frames
+                << ", \"rebuilt_per_frame\": " << (double)result.rebuilt / frames << ", \"patched_per_frame\": " << (double)result.patched / frames << " },\n";
+            writeSection(out, "seen_test", result.seenTest, frames, (double)result.enemies * frames, "enemy");
+            out << ", \"seen_per_frame\": " << (double)result.seen / frames << " },\n";
+            writeSection(out, "physics", result.physics, frames, (double)(result.enemies + result.observers) * frames, "entity");
+            out << " }\n";
+            out << "      }\n";
+            out << "    }";
+            out.flush();
+        }
+    }
+    out << "\n  ]\n}\n";
+    return 0;
+}
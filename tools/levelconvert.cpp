@@ -0,0 +1,69 @@
+#include "levelfile.h"
+#include "streamingworld.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+// text level description -> binary .lvl, see levelfile.h for both formats
+// or a directory of chunks for StreamingWorld
+// usage: levelconvert input.txt output.lvl [--no-acceleration]
+//        levelconvert input.txt outputdir --chunks chunkSize
+int main(int argc, char** argv)
+{
+    bool chunked = argc == 5 && std::strcmp(argv[3], "--chunks") == 0;
+    if (!chunked && (argc < 3 || argc > 4 || (argc == 4 && std::strcmp(argv[3], "--no-acceleration") != 0)))
+    {
+        std::cerr << "usage: levelconvert input.txt output.lvl [--no-acceleration]" << std::endl;
+        std::cerr << "       levelconvert input.txt outputdir --chunks chunkSize" << std::endl;
+        return 2;
+    }
+    bool withAccelerationStructures = argc == 3;
+
+    Level level;
+    int errorLine = 0;
+    if (!loadLevelText(level, argv[1], &errorLine))
+    {
+        if (errorLine > 0)
+        {
+            std::cerr << argv[1] << ":" << errorLine << ": can't parse this line" << std::endl;
+        }
+        else
+        {
+            std::cerr << argv[1] << ": missing file or no bounds line" << std::endl;
+        }
+        return 1;
+    }
+    if (chunked)
+    {
+        float chunkSize = (float)std::atof(argv[4]);
+        if (!writeChunkedWorld(level, chunkSize, argv[2]))
+        {
+            std::cerr << argv[2] << ": can't write chunks of size " << argv[4] << std::endl;
+            return 1;
+        }
+        std::cout << argv[2] << ": " << level.shapes.size() << " shapes in chunks of " << chunkSize << std::endl;
+        return 0;
+    }
+
+    if (!saveLevelFile(level, argv[2], withAccelerationStructures))
+    {
+        std::cerr << argv[2] << ": can't write" << std::endl;
+        return 1;
+    }
+
+    // read it back, so a file that was written is also one that loads
+    Level check;
+    auto start = std::chrono::steady_clock::now();
+    if (!loadLevelFile(check, argv[2]) || check.segments.fingerprint() != level.segments.fingerprint())
+    {
+        std::cerr << argv[2] << ": written file doesn't load back" << std::endl;
+        return 1;
+    }
+    double loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << argv[2] << ": " << level.shapes.size() << " shapes, " << level.segments.size() << " edges, "
+        << (withAccelerationStructures ? "with" : "without") << " grid / bvh, loads in " << loadMs << " ms" << std::endl;
+    return 0;
+}
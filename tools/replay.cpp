@@ -0,0 +1,98 @@
+#include "levelfile.h"
+#include "replay.h"
+
+#include <chrono>
+#include <iostream>
+
+// plays a session recorded by the demo (line_of_sight --record session.rec) back without a window, one fixed
+// tick after the other as fast as they run, and compares the state against the recorded checksums
+// usage: replay session.rec [level.lvl]
+// the level defaults to what the demo loads: default.lvl in the working directory, the built-in layout without it
+int main(int argc, char** argv)
+{
+    if (argc < 2 || argc > 3)
+    {
+        std::cerr << "usage: replay session.rec [level.lvl]" << std::endl;
+        return 2;
+    }
+
+    InputRecording recording;
+    if (!recording.load(argv[1]))
+    {
+        std::cerr << argv[1] << ": missing file or not a recording of this version" << std::endl;
+        return 1;
+    }
+
+    Level level;
+    if (argc == 3)
+    {
+        if (!loadLevelFile(level, argv[2]))
+        {
+            std::cerr << argv[2] << ": can't load the level" << std::endl;
+            return 1;
+        }
+    }
+    else if (!loadLevelFile(level, "default.lvl"))
+    {
+        loadDefaultLevel(level);
+    }
+    if (level.segments.fingerprint() != recording.levelFingerprint)
+    {
+        std::cerr << argv[1] << ": recorded on another level" << std::endl;
+        return 1;
+    }
+    if (recording.spatialIndex == SpatialIndex::PVS)
+    {
+        bakePVS(level);
+    }
+    level.spatialIndex = recording.spatialIndex;
+
+    Entity player(recording.playerStart);
+    ButtonInput input;
+    VisibilityResult vision;
+    VisibilityCache visionCache;
+    VisibilityQuery visionQuery;
+    VisionCone cone;
+    EntityStore enemies;
+    recording.restoreEnemies(enemies);
+
+    // the same order as a demo tick: player input and step, then the enemies against the player's view
+    float dt = recording.tickSeconds;
+    size_t matched = 0;
+    int64_t firstMismatch = -1;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t tick = 0; tick < recording.tickCount; tick++)
+    {
+        input.buttons = recording.buttonsAt(tick);
+        VisibilityEngine engine = (input.buttons & ButtonSweep) ? VisibilityEngine::AngularSweep : VisibilityEngine::RayCast;
+        input.update(player, dt);
+        stepPlayer(level, player, dt, vision, visionCache, visionQuery, engine, (input.buttons & ButtonCone) ? &cone : nullptr);
+        enemies.update(level, &visionQuery, dt);
+
+        int checksum = recording.checksumIndexAt(tick);
+        if (checksum >= 0)
+        {
+            if (simulationChecksum(player, vision, enemies) == recording.checksums[checksum])
+            {
+                matched++;
+            }
+            else if (firstMismatch < 0)
+            {
+                firstMismatch = tick;
+            }
+        }
+    }
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    double simulatedSeconds = recording.tickCount * (double)dt;
+    std::cout << argv[1] << ": " << recording.tickCount << " ticks (" << simulatedSeconds << " s, "
+        << recording.changeTicks.size() << " input changes) replayed in " << milliseconds << " ms, "
+        << (milliseconds > 0.0 ? recording.tickCount * 1000.0 / milliseconds : 0.0) << " ticks/s" << std::endl;
+    std::cout << "checksums: " << matched << " of " << recording.checksums.size() << " match" << std::endl;
+    if (firstMismatch >= 0)
+    {
+        std::cout << "first mismatch after tick " << firstMismatch << " (" << firstMismatch * (double)dt << " s)" << std::endl;
+        return 1;
+    }
+    return 0;
+}